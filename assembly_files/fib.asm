@@ -7,7 +7,6 @@ size: .word  12             # size of "array"
       la   $t5, size        # load address of size variable
       lw   $t5, 0($t5)      # load array size
       li   $t2, 1           # 1 is first and second Fib. number
-      add.d $f0, $f2, $f4
       sw   $t2, 0($t0)      # F[0] = 1
       sw   $t2, 4($t0)      # F[1] = F[0] = 1
       addi $t1, $t5, -2     # Counter for loop, will execute (size-2) times
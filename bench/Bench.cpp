@@ -0,0 +1,285 @@
+#include "ProgramGenerator.hpp"
+#include "MIPSParser.hpp"
+#include "Helpers.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/**
+ * Every allocation in the process goes through these counters, the live
+ * byte count uses the allocator's real block size so frees balance exactly
+ */
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<uint64_t> allocatedBytes{0};
+static std::atomic<int64_t> liveBytes{0};
+static std::atomic<int64_t> peakLiveBytes{0};
+
+static void *countedAlloc(std::size_t size)
+{
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    std::size_t usable = malloc_usable_size(ptr);
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(usable, std::memory_order_relaxed);
+    int64_t live = liveBytes.fetch_add(static_cast<int64_t>(usable), std::memory_order_relaxed) + static_cast<int64_t>(usable);
+    int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+    return ptr;
+}
+
+static void countedFree(void *ptr)
+{
+    if (ptr != nullptr)
+    {
+        liveBytes.fetch_sub(static_cast<int64_t>(malloc_usable_size(ptr)), std::memory_order_relaxed);
+        std::free(ptr);
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](std::size_t size)
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    countedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    countedFree(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    countedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    countedFree(ptr);
+}
+
+// One timed construction of MIPSParser
+struct Sample
+{
+    double seconds;
+    uint64_t allocations;
+    uint64_t bytes;
+    int64_t peakHeap;
+    std::size_t instructions;
+};
+
+static Sample runOnce(const std::string &path, unsigned threads)
+{
+    uint64_t allocationsBefore = allocationCount.load();
+    uint64_t bytesBefore = allocatedBytes.load();
+    int64_t liveBefore = liveBytes.load();
+    peakLiveBytes.store(liveBefore);
+
+    auto start = std::chrono::steady_clock::now();
+    MIPSParser parser(path, threads);
+    auto end = std::chrono::steady_clock::now();
+
+    return {std::chrono::duration<double>(end - start).count(),
+            allocationCount.load() - allocationsBefore,
+            allocatedBytes.load() - bytesBefore,
+            peakLiveBytes.load() - liveBefore,
+            parser.instructions.size()};
+}
+
+static void usage()
+{
+    std::cerr << "Usage: mips_bench [options]\n"
+                 "  --lines N          text lines to generate (default 100000)\n"
+                 "  --size-mb M        generate about M megabytes instead of a line count\n"
+                 "  --mix R,I,J,B,M,P  weights of R-type, I-type, jumps, branches, memory and pseudo lines\n"
+                 "  --labels K         a label every K lines, 0 for none (default 8)\n"
+                 "  --data N           data directives (default 1000)\n"
+                 "  --seed S           generator seed (default 1)\n"
+                 "  --threads T        encode threads, 0 for one per core (default 1)\n"
+                 "  --iterations I     timed runs, the median is reported (default 5)\n"
+                 "  --emit FILE        write the generated program to FILE and exit\n"
+                 "  --input FILE       benchmark an existing source instead of generating one\n";
+}
+
+// Splitting "40,20,5,10,15,10" into the six weights
+static void parseMix(std::string_view text, GeneratorOptions &options)
+{
+    unsigned *weights[] = {&options.rType, &options.iType, &options.jType, &options.branch, &options.memory, &options.pseudo};
+    const std::vector<std::string_view> fields = splitFields(text);
+    for (std::size_t i = 0; i < std::min(fields.size(), std::size(weights)); ++i)
+    {
+        *weights[i] = static_cast<unsigned>(handleValue(fields[i]));
+    }
+}
+
+/**
+ * Generates a program, writes it to a temporary file and assembles it a few
+ * times. Time, allocations and peak heap cover MIPSParser construction only.
+ */
+int main(int argc, char *argv[])
+{
+    GeneratorOptions options;
+    unsigned threads = 1;
+    int iterations = 5;
+    std::string emitPath;
+    std::string inputPath;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view arg = argv[i];
+            if (arg == "--help" || i + 1 >= argc)
+            {
+                usage();
+                return arg == "--help" ? 0 : 1;
+            }
+            std::string_view value = argv[++i];
+            if (arg == "--lines")
+            {
+                options.lines = static_cast<std::size_t>(handleValue(value));
+            }
+            else if (arg == "--size-mb")
+            {
+                options.targetBytes = static_cast<std::size_t>(handleValue(value)) << 20;
+            }
+            else if (arg == "--mix")
+            {
+                parseMix(value, options);
+            }
+            else if (arg == "--labels")
+            {
+                options.labelEvery = static_cast<unsigned>(handleValue(value));
+            }
+            else if (arg == "--data")
+            {
+                options.dataDirectives = static_cast<std::size_t>(handleValue(value));
+            }
+            else if (arg == "--seed")
+            {
+                options.seed = static_cast<uint32_t>(handleValue(value));
+            }
+            else if (arg == "--threads")
+            {
+                threads = static_cast<unsigned>(handleValue(value));
+            }
+            else if (arg == "--iterations")
+            {
+                iterations = std::max(1, handleValue(value));
+            }
+            else if (arg == "--emit")
+            {
+                emitPath = value;
+            }
+            else if (arg == "--input")
+            {
+                inputPath = value;
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << error.what() << "\n";
+        usage();
+        return 1;
+    }
+
+    // Resolved as ThreadPool does, so the report shows what encoding ran on
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The generated text is freed before timing so it does not count towards peak memory
+    std::string path = inputPath;
+    if (path.empty())
+    {
+        path = emitPath.empty() ? (std::filesystem::temp_directory_path() / std::format("mips_bench_{}.asm", static_cast<long>(::getpid()))).string() : emitPath;
+        std::string program = generateProgram(options);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(program.data(), static_cast<std::streamsize>(program.size()));
+        if (!file)
+        {
+            std::cerr << "Failed to write " << path << "\n";
+            return 1;
+        }
+        if (!emitPath.empty())
+        {
+            return 0;
+        }
+    }
+    std::size_t sourceBytes = std::filesystem::file_size(path);
+    std::size_t lines = 0;
+    {
+        std::ifstream file(path, std::ios::binary);
+        lines = static_cast<std::size_t>(std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n'));
+    }
+
+    std::vector<Sample> samples;
+    try
+    {
+        // Untimed run to warm the page cache and the allocator
+        runOnce(path, threads);
+        for (int i = 0; i < iterations; ++i)
+        {
+            samples.push_back(runOnce(path, threads));
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Assembly failed: " << error.what() << "\n";
+        return 1;
+    }
+    if (inputPath.empty())
+    {
+        std::filesystem::remove(path);
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b)
+              { return a.seconds < b.seconds; });
+    const Sample &median = samples[samples.size() / 2];
+    double instructions = static_cast<double>(std::max<std::size_t>(median.instructions, 1));
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+
+    std::cout << std::format("source:             {} lines, {:.2f} MB, {} instructions\n", lines, sourceBytes / 1048576.0, median.instructions)
+              << std::format("runs:               {} (median), {} thread(s)\n", samples.size(), threads)
+              << std::format("time:               {:.2f} ms\n", median.seconds * 1e3)
+              << std::format("lines/sec:          {:.0f}\n", lines / median.seconds)
+              << std::format("ns/instruction:     {:.1f}\n", median.seconds * 1e9 / instructions)
+              << std::format("allocations/instr:  {:.3f}\n", median.allocations / instructions)
+              << std::format("bytes/instr:        {:.1f}\n", median.bytes / instructions)
+              << std::format("peak heap:          {:.2f} MB\n", median.peakHeap / 1048576.0)
+              << std::format("peak RSS:           {:.2f} MB\n", usage.ru_maxrss / 1024.0);
+    return 0;
+}
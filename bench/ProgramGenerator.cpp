@@ -0,0 +1,193 @@
+#include "ProgramGenerator.hpp"
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+#include <random>
+#include <string_view>
+
+static constexpr std::array<std::string_view, 10> R_THREE = {"add", "addu", "sub", "subu", "and", "or", "xor", "nor", "slt", "sltu"};
+static constexpr std::array<std::string_view, 4> R_TWO = {"mult", "multu", "div", "divu"};
+static constexpr std::array<std::string_view, 3> SHIFTS = {"sll", "srl", "sra"};
+static constexpr std::array<std::string_view, 7> I_TYPE = {"addi", "addiu", "andi", "ori", "xori", "slti", "sltiu"};
+static constexpr std::array<std::string_view, 7> MEMORY = {"lw", "sw", "lb", "sb", "lbu", "lh", "sh"};
+static constexpr std::array<std::string_view, 16> REGISTERS = {
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$v0", "$v1", "$a0", "$a1"};
+
+// Branches reach at most this many labels away so offsets stay within 16 bits
+static constexpr long BRANCH_LABEL_RANGE = 200;
+
+template <std::size_t N>
+static std::string_view pick(const std::array<std::string_view, N> &names, std::mt19937 &rng)
+{
+    return names[rng() % N];
+}
+
+/**
+ * Data comes first so every data label exists before the text refers to it,
+ * text labels are numbered by position so jumps can target any of them
+ */
+static std::string generateLines(const GeneratorOptions &options, std::size_t lines)
+{
+    std::mt19937 rng(options.seed);
+    std::string out;
+    auto line = std::back_inserter(out);
+    std::size_t dataCount = std::max<std::size_t>(options.dataDirectives, 1);
+
+    out += "\t.data\n";
+    for (std::size_t i = 0; i < dataCount; ++i)
+    {
+        switch (i % 5)
+        {
+        case 0:
+            std::format_to(line, "d{}:\t.word {}, {}\n", i, rng() % 1000, static_cast<int>(rng() % 2000) - 1000);
+            break;
+        case 1:
+            std::format_to(line, "d{}:\t.half {}\n", i, rng() % 30000);
+            break;
+        case 2:
+            std::format_to(line, "d{}:\t.byte {}, {}, {}\n", i, rng() % 128, rng() % 128, rng() % 128);
+            break;
+        case 3:
+            std::format_to(line, "d{}:\t.asciiz \"entry {}\\n\"\n", i, i);
+            break;
+        default:
+            std::format_to(line, "d{}:\t.space {}\n", i, 4 + rng() % 16);
+            break;
+        }
+    }
+
+    // Labels are placed by line number, so their count is known up front
+    std::size_t labelCount = options.labelEvery > 0 ? (lines + options.labelEvery - 1) / options.labelEvery : 0;
+    unsigned rType = options.rType;
+    unsigned total = rType + options.iType + options.jType + options.branch + options.memory + options.pseudo;
+    if (total == 0)
+    {
+        total = rType = 1;
+    }
+
+    out += "\t.text\n\t.globl main\nmain:\n";
+    for (std::size_t i = 0; i < lines; ++i)
+    {
+        std::size_t labelIndex = options.labelEvery > 0 ? i / options.labelEvery : 0;
+        if (options.labelEvery > 0 && i % options.labelEvery == 0)
+        {
+            std::format_to(line, "L{}:", labelIndex);
+        }
+        out += '\t';
+
+        unsigned roll = rng() % total;
+        std::string_view d = pick(REGISTERS, rng);
+        std::string_view s = pick(REGISTERS, rng);
+        std::string_view t = pick(REGISTERS, rng);
+        if (roll < rType)
+        {
+            switch (rng() % 4)
+            {
+            case 0:
+                std::format_to(line, "{} {}, {}\n", pick(R_TWO, rng), s, t);
+                break;
+            case 1:
+                std::format_to(line, "{} {}, {}, {}\n", pick(SHIFTS, rng), d, t, rng() % 32);
+                break;
+            default:
+                std::format_to(line, "{} {}, {}, {}\n", pick(R_THREE, rng), d, s, t);
+                break;
+            }
+        }
+        else if ((roll -= rType) < options.iType)
+        {
+            if (rng() % 8 == 0)
+            {
+                std::format_to(line, "lui {}, {}\n", t, rng() % 0x7FFF);
+            }
+            else
+            {
+                std::format_to(line, "{} {}, {}, {}\n", pick(I_TYPE, rng), t, s, static_cast<int>(rng() % 2000) - 1000);
+            }
+        }
+        else if ((roll -= options.iType) < options.jType)
+        {
+            std::string_view mnemonic = rng() % 2 ? "j" : "jal";
+            if (labelCount > 0)
+            {
+                std::format_to(line, "{} L{}\n", mnemonic, rng() % labelCount);
+            }
+            else
+            {
+                std::format_to(line, "{} main\n", mnemonic);
+            }
+        }
+        else if ((roll -= options.jType) < options.branch)
+        {
+            // Numeric offsets when there are no labels to aim at
+            std::string target = std::format("{}", static_cast<int>(rng() % 64) - 32);
+            if (labelCount > 0)
+            {
+                long near = static_cast<long>(labelIndex) + static_cast<long>(rng() % (2 * BRANCH_LABEL_RANGE)) - BRANCH_LABEL_RANGE;
+                target = std::format("L{}", std::clamp<long>(near, 0, static_cast<long>(labelCount) - 1));
+            }
+            switch (rng() % 4)
+            {
+            case 0:
+                std::format_to(line, "bgtz {}, {}\n", s, target);
+                break;
+            case 1:
+                std::format_to(line, "bltz {}, {}\n", s, target);
+                break;
+            default:
+                std::format_to(line, "{} {}, {}, {}\n", rng() % 2 ? "beq" : "bne", s, t, target);
+                break;
+            }
+        }
+        else if ((roll -= options.branch) < options.memory)
+        {
+            if (rng() % 4 == 0)
+            {
+                // Word entries only, so the label is aligned for lw and sw
+                std::format_to(line, "{} {}, d{}\n", rng() % 2 ? "lw" : "sw", t, (rng() % dataCount) / 5 * 5);
+            }
+            else
+            {
+                std::format_to(line, "{} {}, {}({})\n", pick(MEMORY, rng), t, (rng() % 64) * 4, rng() % 2 ? "$sp" : "$gp");
+            }
+        }
+        else
+        {
+            switch (rng() % 3)
+            {
+            case 0:
+                std::format_to(line, "li {}, {}\n", t, static_cast<int>(rng() % 200) - 100);
+                break;
+            case 1:
+                std::format_to(line, "li {}, {}\n", t, 0x10000 + rng() % 0xFFFFFF);
+                break;
+            default:
+                std::format_to(line, "la {}, d{}\n", t, rng() % dataCount);
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+/**
+ * A size target is met by measuring a short sample with the same mix and
+ * scaling the line count, so the program still has a fixed set of labels
+ */
+std::string generateProgram(const GeneratorOptions &options)
+{
+    if (options.targetBytes == 0)
+    {
+        return generateLines(options, options.lines);
+    }
+    constexpr std::size_t SAMPLE_LINES = 4096;
+    GeneratorOptions sample = options;
+    sample.dataDirectives = 0;
+    std::size_t header = generateLines(sample, 0).size();
+    double bytesPerLine = static_cast<double>(generateLines(sample, SAMPLE_LINES).size() - header) / SAMPLE_LINES;
+    std::size_t dataBytes = generateLines(options, 0).size();
+    std::size_t textBytes = options.targetBytes > dataBytes ? options.targetBytes - dataBytes : 0;
+    return generateLines(options, static_cast<std::size_t>(static_cast<double>(textBytes) / bytesPerLine));
+}
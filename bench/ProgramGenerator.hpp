@@ -0,0 +1,31 @@
+#ifndef PROGRAMGENERATOR_HPP
+#define PROGRAMGENERATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shape of a generated program, weights are relative to each other
+struct GeneratorOptions
+{
+    // Text lines, ignored when targetBytes is set
+    std::size_t lines = 100000;
+    // Generating lines until the source reaches this size
+    std::size_t targetBytes = 0;
+    unsigned rType = 40;  // add $d, $s, $t and shifts
+    unsigned iType = 20;  // addi $t, $s, imm and lui
+    unsigned jType = 5;   // j and jal to any label
+    unsigned branch = 10; // beq, bne, bgtz, bltz to a nearby label
+    unsigned memory = 15; // lw $t, off($s) and lw $t, label
+    unsigned pseudo = 10; // li and la
+    // A label every labelEvery text lines, 0 for none
+    unsigned labelEvery = 8;
+    // Labelled .word, .half, .byte, .asciiz and .space entries
+    std::size_t dataDirectives = 1000;
+    uint32_t seed = 1;
+};
+
+// Valid assembly for the given mix, the same options always give the same text
+std::string generateProgram(const GeneratorOptions &options);
+
+#endif
@@ -0,0 +1,192 @@
+#include "MIPS.hpp"
+#include "CPU.hpp"
+#include "Program.hpp"
+#include "Helpers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+// A loop over loads, stores, arithmetic, a branch and a call, run iterations times
+static std::string loopProgram(uint64_t iterations)
+{
+    return std::format("\t.data\n"
+                       "arr:\t.word 0 : 64\n"
+                       "\t.text\n"
+                       "\t.globl main\n"
+                       "main:\tli $s0, {}\n"
+                       "\tla $s1, arr\n"
+                       "\tli $t0, 0\n"
+                       "loop:\taddi $t0, $t0, 1\n"
+                       "\tandi $t1, $t0, 63\n"
+                       "\tsll $t1, $t1, 2\n"
+                       "\tadd $t2, $s1, $t1\n"
+                       "\tlw $t3, 0($t2)\n"
+                       "\taddu $t3, $t3, $t0\n"
+                       "\tsw $t3, 0($t2)\n"
+                       "\tbne $t1, $zero, next\n"
+                       "\tjal bump\n"
+                       "next:\tbne $t0, $s0, loop\n"
+                       "\tli $v0, 10\n"
+                       "\tsyscall\n"
+                       "bump:\taddiu $t4, $t4, 1\n"
+                       "\tjr $ra\n",
+                       iterations);
+}
+
+// One way of running the program, set on each fresh CPU
+struct Setup
+{
+    std::string_view name;
+    std::function<void(CPU &)> apply;
+    std::vector<double> seconds;
+};
+
+static void usage()
+{
+    std::cerr << "Usage: mips_run_bench [options]\n"
+                 "  --loop N           iterations of the generated loop (default 5000000)\n"
+                 "  --iterations I     timed runs of each setup, the median is reported (default 5)\n"
+                 "  --input FILE       run an existing program instead of the generated loop\n";
+}
+
+/**
+ * Runs a program under each execution policy the simulator compiles, the
+ * setups taking turns so drift on the host hits them alike. The plain
+ * policy is the baseline. The dynamic one runs the same loop with every
+ * feature present but switched off at runtime, which is what the plain one
+ * would cost if features were checked rather than compiled out.
+ */
+int main(int argc, char *argv[])
+{
+    uint64_t loop = 5000000;
+    int iterations = 5;
+    std::string inputPath;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view arg = argv[i];
+            if (arg == "--help" || i + 1 >= argc)
+            {
+                usage();
+                return arg == "--help" ? 0 : 1;
+            }
+            std::string_view value = argv[++i];
+            if (arg == "--loop")
+            {
+                loop = static_cast<uint64_t>(handleValue(value));
+            }
+            else if (arg == "--iterations")
+            {
+                iterations = std::max(1, handleValue(value));
+            }
+            else if (arg == "--input")
+            {
+                inputPath = value;
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << error.what() << "\n";
+        usage();
+        return 1;
+    }
+
+    std::string path = inputPath;
+    if (path.empty())
+    {
+        path = (std::filesystem::temp_directory_path() / std::format("mips_run_bench_{}.asm", static_cast<long>(::getpid()))).string();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << loopProgram(loop);
+        if (!file)
+        {
+            std::cerr << "Failed to write " << path << "\n";
+            return 1;
+        }
+    }
+    std::unique_ptr<Program> program;
+    try
+    {
+        program = std::make_unique<Program>(MIPS(path));
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Assembly failed: " << error.what() << "\n";
+        return 1;
+    }
+    if (inputPath.empty())
+    {
+        std::filesystem::remove(path);
+    }
+
+    std::vector<Setup> setups = {
+        {"plain", [](CPU &) {}, {}},
+        {"dynamic", [](CPU &cpu) { cpu.setDynamicOnly(true); }, {}},
+        {"budget", [](CPU &cpu) { cpu.setBudget(std::numeric_limits<uint64_t>::max() - 1); }, {}},
+        {"profile", [](CPU &cpu) { cpu.enableProfiler(); }, {}},
+        {"timing", [](CPU &cpu) { cpu.enableTiming(); }, {}},
+        {"caches", [](CPU &cpu) { cpu.enableCaches(CacheLevels()); }, {}},
+        {"predict", [](CPU &cpu) { cpu.enablePredictor(PredictorConfig()); }, {}},
+    };
+    uint64_t executed = 0;
+    try
+    {
+        // The first round is untimed and warms the host caches
+        for (int i = 0; i <= iterations; ++i)
+        {
+            for (Setup &setup : setups)
+            {
+                std::istringstream in;
+                std::ostringstream out;
+                CPU cpu(*program, in, out);
+                setup.apply(cpu);
+                auto start = std::chrono::steady_clock::now();
+                cpu.run();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (i > 0)
+                {
+                    setup.seconds.push_back(seconds);
+                }
+                executed = cpu.executed;
+            }
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Run failed: " << error.what() << "\n";
+        return 1;
+    }
+
+    auto median = [](std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    };
+    const double plain = median(setups.front().seconds);
+    std::cout << std::format("program:  {} instructions per run, {} runs per setup (median)\n", executed, iterations);
+    std::cout << std::format("{:<10} {:>10} {:>10} {:>10}\n", "policy", "ms", "ns/instr", "vs plain");
+    for (const Setup &setup : setups)
+    {
+        double seconds = median(setup.seconds);
+        std::cout << std::format("{:<10} {:>10.2f} {:>10.2f} {:>+9.1f}%\n", setup.name, seconds * 1e3, seconds * 1e9 / static_cast<double>(std::max<uint64_t>(executed, 1)),
+                                 (seconds / plain - 1) * 100);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef BATCHRUNNER_HPP
+#define BATCHRUNNER_HPP
+
+#include "Program.hpp"
+#include "ThreadPool.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One run of a batch: what it reads on stdin and how far it may go
+struct BatchJob
+{
+    std::string input;
+    // Instructions the run may execute, 0 for no limit
+    uint64_t budget = 0;
+};
+
+struct BatchResult
+{
+    enum class Status
+    {
+        EXITED,
+        FAILED,
+        OUT_OF_BUDGET
+    };
+    Status status = Status::EXITED;
+    int exitCode = 0;
+    uint64_t executed = 0;
+    // Everything the run printed, output up to the failure included
+    std::string output;
+    // The runtime error for FAILED and OUT_OF_BUDGET runs
+    std::string error;
+};
+
+/**
+ * Runs one program over many inputs in parallel. Each thread of the pool
+ * keeps its own CPU built from the shared Program and rewinds it to a
+ * snapshot between runs, so a run costs the pages it wrote rather than a
+ * fresh address space, and translated blocks and compiled code carry over
+ * from one run to the next.
+ */
+class BatchRunner
+{
+public:
+    // 0 threads uses one per hardware thread
+    BatchRunner(const Program &program, unsigned threads = 0);
+    ~BatchRunner();
+    BatchRunner(const BatchRunner &) = delete;
+    BatchRunner &operator=(const BatchRunner &) = delete;
+
+    // Compiles hot blocks in every thread's CPU, false when the host has no JIT
+    bool enableJit();
+    // One result per job, in the order of jobs
+    std::vector<BatchResult> run(const std::vector<BatchJob> &jobs);
+    unsigned threads() const;
+
+private:
+    struct Worker;
+
+    const Program &program;
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+    bool jit;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef BLOCKCACHE_HPP
+#define BLOCKCACHE_HPP
+
+#include "Op.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Compiled block, takes the register file and memory hooks and returns the next op index
+using NativeBlock = uint32_t (*)(uint32_t *regs, void *memory);
+
+/**
+ * A straight run of ops from one leader up to and including the first
+ * control transfer. A block that reaches the next leader without one ends in
+ * a CHAIN op. Successors are linked on first use, so a hot loop goes from
+ * block to block through these pointers and never comes back to lookup().
+ */
+struct Block
+{
+    static constexpr int FALLTHROUGH = 0;
+    static constexpr int TAKEN = 1;
+
+    // Op index of the first op, so its address is PC_START + start * 4
+    uint32_t start;
+    // Op index after the last op, where the block falls through to
+    uint32_t end;
+    // MIPS instructions retired by running the whole block
+    uint32_t instructions;
+    // Times the block was entered
+    uint64_t entries;
+    // Linked successors, TAKEN of a jr holds the last target it went to
+    Block *next[2];
+    std::vector<Op> ops;
+    // Compiled code once the block is hot, see Jit
+    NativeBlock native;
+    bool nativeTried;
+};
+
+/**
+ * Aggregate block counters. chainHits counts transfers that found their
+ * successor already linked, chainMisses the ones that had to look it up.
+ */
+struct BlockStats
+{
+    std::size_t blocks;
+    double averageLength;
+    uint64_t chainHits;
+    uint64_t chainMisses;
+    double chainHitRate() const;
+};
+
+/**
+ * Translates the predecoded text into basic blocks on demand. Leaders are
+ * the text labels, every branch and jump target and every instruction after
+ * a control transfer. A jr into the middle of a block gets its own block
+ * starting there.
+ */
+class BlockCache
+{
+public:
+    BlockCache(std::vector<Op> ops, const std::vector<uint32_t> &labelIndices);
+    BlockCache(const BlockCache &) = delete;
+    BlockCache &operator=(const BlockCache &) = delete;
+
+    // The block starting at op index, translated on first use
+    Block *lookup(uint32_t index);
+    // Successor in slot of from, linking it the first time
+    Block *follow(Block *from, int slot, uint32_t index)
+    {
+        Block *next = from->next[slot];
+        if (next != nullptr)
+        {
+            ++this->chainHits;
+            return next;
+        }
+        return link(from, slot, index);
+    }
+    // Same for a jr, whose target can change from one run of the block to the next
+    Block *followIndirect(Block *from, uint32_t index)
+    {
+        Block *next = from->next[Block::TAKEN];
+        if (next != nullptr && next->start == index)
+        {
+            ++this->chainHits;
+            return next;
+        }
+        return link(from, Block::TAKEN, index);
+    }
+    // Successor of from after compiled code returned index, linked like the interpreter's transfers
+    Block *successor(Block *from, uint32_t index);
+    BlockStats stats() const;
+    // Predecoded text, the HALT and BAD_TARGET ops included
+    const std::vector<Op> &source() const;
+    // Replaces the op at index in the text and in every block translated
+    // over it, returns the op it replaced. Blocks keep their bounds.
+    Op patch(uint32_t index, const Op &op);
+
+private:
+    Block *link(Block *from, int slot, uint32_t index);
+    Block *translate(uint32_t index);
+
+    std::vector<Op> ops;
+    std::vector<bool> leaders;
+    // Whether the op at each index ends a block, as predecoded, so patched
+    // ops do not move block ends
+    std::vector<bool> transfers;
+    // Block starting at each op index, null until translated
+    std::vector<Block *> blockAt;
+    std::vector<std::unique_ptr<Block>> blocks;
+    uint64_t chainHits;
+    uint64_t chainMisses;
+};
+
+// Whether an op ends a basic block
+bool isControlTransfer(Handler handler);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef BRANCHPREDICTOR_HPP
+#define BRANCHPREDICTOR_HPP
+
+#include "Op.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MIPS;
+
+enum class PredictorKind : uint8_t
+{
+    // Backward branches taken, forward ones not
+    STATIC,
+    // A 2-bit counter per table entry, indexed by the branch address
+    BIMODAL,
+    // The same counters indexed by the branch address xor the global history
+    GSHARE
+};
+
+struct PredictorConfig
+{
+    PredictorKind kind = PredictorKind::BIMODAL;
+    // Table entries as a power of two, also the history length of gshare
+    uint32_t tableBits = 12;
+    // Return addresses kept for jr $ra, 0 leaves returns unpredicted
+    uint32_t stackDepth = 16;
+
+    // "static|bimodal|gshare[,table bits[,stack depth]]"
+    static PredictorConfig parse(std::string_view spec);
+    // "gshare, 4096 entries, 12 history bits, 16-entry return stack"
+    std::string describe() const;
+};
+
+/**
+ * Predicts the conditional branches and jr $ra returns of a run as they
+ * resolve and counts hits and misses per instruction, indexed like the
+ * predecoded text. Text addresses are PC_START plus four times the index
+ * and PC_START has its low 20 bits clear, so the index is the branch
+ * address shifted right by two as far as table bits are concerned. Tables
+ * are flat arrays of counters sized when the predictor is made, and
+ * predicting never allocates. State and counts accumulate over runs.
+ */
+class BranchPredictor
+{
+public:
+    BranchPredictor(const std::vector<Op> &ops, const PredictorConfig &config);
+
+    // The conditional branch at op index resolved to taken or not
+    void branch(uint32_t index, bool taken)
+    {
+        bool predicted;
+        if (this->settings.kind == PredictorKind::STATIC)
+        {
+            predicted = this->backward[index] != 0;
+        }
+        else
+        {
+            uint32_t slot = this->settings.kind == PredictorKind::GSHARE ? index ^ this->history : index;
+            uint8_t &counter = this->table[slot & this->mask];
+            predicted = counter >= 2;
+            counter = taken ? counter + (counter < 3) : counter - (counter > 0);
+            this->history = this->history << 1 | static_cast<uint32_t>(taken);
+        }
+        Counters &counters = this->counters[index];
+        ++counters.executed;
+        counters.taken += taken;
+        counters.mispredicted += predicted != taken;
+    }
+    // A jal pushes the op index it returns to
+    void call(uint32_t returnIndex)
+    {
+        if (this->settings.stackDepth == 0)
+        {
+            return;
+        }
+        this->top = this->top + 1 == this->settings.stackDepth ? 0 : this->top + 1;
+        this->stack[this->top] = returnIndex;
+        // A full stack loses its oldest entry
+        this->depth += this->depth < this->settings.stackDepth;
+    }
+    // The jr $ra at op index went to op index target
+    void ret(uint32_t index, uint32_t target)
+    {
+        bool hit = false;
+        if (this->depth > 0)
+        {
+            hit = this->stack[this->top] == target;
+            this->top = this->top == 0 ? this->settings.stackDepth - 1 : this->top - 1;
+            --this->depth;
+        }
+        Counters &counters = this->counters[index];
+        ++counters.executed;
+        ++counters.taken;
+        counters.mispredicted += !hit;
+    }
+
+    const PredictorConfig &config() const;
+    uint64_t executed(uint32_t index) const;
+    uint64_t mispredicted(uint32_t index) const;
+    // The branches most often mispredicted with their source, and the
+    // accuracy per text label, conditional branches and returns apart
+    void report(std::ostream &out, const MIPS &program, std::size_t hottest = 20) const;
+    void clear();
+
+private:
+    struct Counters
+    {
+        uint64_t executed = 0;
+        uint64_t taken = 0;
+        uint64_t mispredicted = 0;
+    };
+
+    PredictorConfig settings;
+    uint32_t mask;
+    std::vector<uint8_t> table;
+    uint32_t history;
+    // Per text index, whether a branch there goes backwards
+    std::vector<uint8_t> backward;
+    // Circular, top is the newest entry and depth how many are valid
+    std::vector<uint32_t> stack;
+    uint32_t top;
+    uint32_t depth;
+    std::vector<Counters> counters;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include "Instruction.hpp"
+#include "BlockCache.hpp"
+#include "Jit.hpp"
+#include "DataSegment.hpp"
+#include "Heap.hpp"
+#include "SyscallIO.hpp"
+#include "Program.hpp"
+#include "Profiler.hpp"
+#include "Trace.hpp"
+#include "Pipeline.hpp"
+#include "CacheModel.hpp"
+#include "BranchPredictor.hpp"
+#include "Debugger.hpp"
+#include "ExecutionPolicy.hpp"
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+class MIPS;
+
+// Thrown by CPU::run when a run reaches its instruction budget
+class BudgetExhausted : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Runs an assembled program. The text is predecoded once into a dense array
+ * of ops indexed by (pc - PC_START) / 4, followed by a HALT op for running
+ * off the end and a BAD_TARGET op that branches outside the text point at.
+ * Execution goes through the basic blocks of that array, see BlockCache.
+ */
+class CPU
+{
+public:
+    // Everything a run changes, see snapshot
+    struct Snapshot
+    {
+        std::array<uint32_t, 32> regs;
+        uint32_t hi;
+        uint32_t lo;
+        uint32_t pc;
+        DataSegment::Snapshot memory;
+        Heap::State heap;
+    };
+
+    CPU(const MIPS &program, std::istream &in = std::cin, std::ostream &out = std::cout);
+    // Starts from an already prepared program, which may be shared with other CPUs
+    CPU(const Program &program, std::istream &in = std::cin, std::ostream &out = std::cout);
+    // Runs from pc (the entry point unless restored elsewhere) until exit, returns the exit code
+    int run();
+    // Predecoding a whole text section
+    static std::vector<Op> predecode(const std::vector<Instruction> &instructions);
+    // Blocks translated so far and how often transfers were chained
+    BlockStats blockStats() const;
+    // Compiles hot blocks from the next run on, false when the host has no JIT
+    bool enableJit();
+    // Stops later runs at the first block that would take them past instructions,
+    // 0 removes the limit
+    void setBudget(uint64_t instructions);
+    // Counts every instruction and branch of later runs. Profiled runs are
+    // interpreted even with the JIT enabled.
+    void enableProfiler();
+    // The counters, null unless enableProfiler was called
+    const Profiler *profiler() const;
+    // Traces every instruction of later runs into a stream of writer, which
+    // must outlive the runs. Traced runs are interpreted like profiled ones.
+    void enableTrace(TraceWriter &writer);
+    // Times later runs on the five-stage pipeline model. Timed runs are
+    // interpreted like profiled ones.
+    void enableTiming();
+    // The pipeline model, null unless enableTiming was called
+    const Pipeline *pipeline() const;
+    // Models the given caches on the fetches, loads and stores of later
+    // runs, replacing any model from before. Runs with caches are interpreted
+    // like profiled ones.
+    void enableCaches(const CacheLevels &levels);
+    // The cache model, null unless enableCaches was called
+    const CacheModel *cacheModel() const;
+    // Predicts the conditional branches and returns of later runs, replacing
+    // any predictor from before. Runs with one are interpreted like profiled
+    // ones.
+    void enablePredictor(const PredictorConfig &config);
+    // The branch predictor, null unless enablePredictor was called
+    const BranchPredictor *branchPredictor() const;
+    // Takes the dynamic instance of the run loop for later undebugged runs,
+    // even where one is compiled for their features, to measure what
+    // checking each feature at runtime would cost. Such runs interpret.
+    void setDynamicOnly(bool dynamic);
+    // The block compiler, null unless enableJit succeeded
+    const Jit *jit() const;
+    // Guest memory pages allocated so far
+    std::size_t residentPages() const;
+    // Break and growth counters of the sbrk heap
+    const Heap &heapUsage() const;
+    // Captures registers, memory and the heap break. Memory pages are shared
+    // copy-on-write, so taking one copies nothing.
+    Snapshot snapshot();
+    // Rewinds to a snapshot of this CPU, touching only the pages written since
+    // the last snapshot or restore when it is that one
+    void restore(const Snapshot &snapshot);
+    // The buffered console behind the print and read syscalls
+    SyscallIO &console();
+
+    std::array<uint32_t, 32> regs;
+    uint32_t hi;
+    uint32_t lo;
+    // Address of the next instruction, or of the one that stopped the run
+    uint32_t pc;
+    // Instructions executed by run
+    uint64_t executed;
+
+private:
+    friend class Debugger;
+
+    // The run loop with the features of Policy compiled in, see ExecutionPolicy.hpp
+    template <typename Policy>
+    int execute();
+    // Handles the syscall in $v0, returns false when the program exits
+    bool syscall(int &exitCode);
+    // Memory hooks for compiled code, see JitTarget
+    static int64_t jitLoad(void *memory, uint32_t address, uint32_t kind);
+    static bool jitStore(void *memory, uint32_t address, uint32_t value, uint32_t kind);
+
+    BlockCache blocks;
+    std::unique_ptr<Jit> compiler;
+    std::unique_ptr<Profiler> profile;
+    std::shared_ptr<TraceStream> trace;
+    std::unique_ptr<Pipeline> timing;
+    std::unique_ptr<CacheModel> caches;
+    std::unique_ptr<BranchPredictor> predictor;
+    // Attached debugger, whose runs take the debug instance of the run loop
+    Debugger *debugger;
+    bool dynamicOnly;
+    // Instructions retired by compiled code during run
+    uint64_t jitExecuted;
+    // Value of jitExecuted compiled self-loops return before passing
+    uint64_t jitLimit;
+    uint64_t budget;
+    // Text, static data from $gp - 0x8000 and the stack below 0x80000000
+    DataSegment memory;
+    Heap heap;
+    SyscallIO io;
+};
+
+#endif
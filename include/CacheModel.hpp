@@ -0,0 +1,240 @@
+#ifndef CACHEMODEL_HPP
+#define CACHEMODEL_HPP
+
+#include "Op.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class MIPS;
+
+enum class Replacement : uint8_t
+{
+    LRU,
+    // Tree pseudo-LRU, one bit per inner node of a binary tree over the ways
+    PLRU,
+    RANDOM
+};
+
+// Geometry and policy of one cache, sizes in bytes and powers of two
+struct CacheConfig
+{
+    uint32_t size = 8 * 1024;
+    uint32_t ways = 2;
+    uint32_t lineSize = 32;
+    Replacement replacement = Replacement::LRU;
+
+    // "size,ways,line[,lru|plru|random]", size may end in K or M
+    static CacheConfig parse(std::string_view spec);
+    // "8KB 2-way 32B LRU"
+    std::string describe() const;
+};
+
+/**
+ * One write-back, write-allocate set-associative cache. The tags of a set
+ * sit next to each other, padded to a multiple of four ways with a tag no
+ * address has, so a lookup compares the whole set with one SSE2 compare per
+ * four ways and never branches on the way count.
+ */
+class Cache
+{
+public:
+    // What an access did, victim is the line address of a dirty line evicted
+    struct Outcome
+    {
+        bool hit;
+        bool writeback;
+        uint32_t victim;
+    };
+
+    explicit Cache(const CacheConfig &config);
+
+    Outcome access(uint32_t address, bool write)
+    {
+        const uint32_t line = address >> this->lineBits;
+        const uint32_t set = line & this->setMask;
+        const uint32_t tag = line >> this->setBits;
+        const uint32_t way = find(set, tag);
+        if (way < this->ways) [[likely]]
+        {
+            ++this->hitCount;
+            touch(set, way, write);
+            return {true, false, 0};
+        }
+        return miss(set, tag, write);
+    }
+    // Counts count more accesses that could only hit, like the other
+    // instructions of a line just fetched
+    void hits(uint64_t count)
+    {
+        this->hitCount += count;
+    }
+    // The line size as a shift
+    uint32_t lineShift() const
+    {
+        return this->lineBits;
+    }
+    const CacheConfig &config() const;
+    uint64_t accesses() const;
+    uint64_t misses() const;
+    uint64_t writebacks() const;
+    // Empties the cache and its counters
+    void clear();
+
+private:
+    // Held by invalid lines and padding, tags of real addresses are below 2^30
+    static constexpr uint32_t INVALID = 0xFFFFFFFF;
+
+    // Way of set holding tag, ways when none does
+    uint32_t find(uint32_t set, uint32_t tag) const
+    {
+        const uint32_t *tags = &this->tags[set * this->stride];
+        uint32_t found = 0;
+#if defined(__SSE2__)
+        const __m128i wanted = _mm_set1_epi32(static_cast<int>(tag));
+        for (uint32_t w = 0; w < this->stride; w += 4)
+        {
+            __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + w));
+            found |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, wanted)))) << w;
+        }
+#else
+        for (uint32_t w = 0; w < this->stride; ++w)
+        {
+            found |= static_cast<uint32_t>(tags[w] == tag) << w;
+        }
+#endif
+        return found == 0 ? this->ways : static_cast<uint32_t>(std::countr_zero(found));
+    }
+    // Updates replacement state for a use of way, and its dirty bit
+    void touch(uint32_t set, uint32_t way, bool write)
+    {
+        const uint32_t slot = set * this->stride + way;
+        this->dirty[slot] |= static_cast<uint8_t>(write);
+        if (this->settings.replacement == Replacement::LRU)
+        {
+            this->stamps[slot] = ++this->clock;
+        }
+        else if (this->settings.replacement == Replacement::PLRU)
+        {
+            // Point every node on the way's path at the other half
+            uint32_t &tree = this->trees[set];
+            uint32_t node = 1;
+            for (uint32_t level = this->waysBits; level-- > 0;)
+            {
+                uint32_t right = (way >> level) & 1;
+                tree = (tree & ~(1u << node)) | (right ^ 1) << node;
+                node = node * 2 + right;
+            }
+        }
+    }
+    Outcome miss(uint32_t set, uint32_t tag, bool write);
+    uint32_t victim(uint32_t set);
+
+    CacheConfig settings;
+    uint32_t ways;
+    uint32_t waysBits;
+    // Ways rounded up to a multiple of four, the distance between sets
+    uint32_t stride;
+    uint32_t lineBits;
+    uint32_t setBits;
+    uint32_t setMask;
+    std::vector<uint32_t> tags;
+    // Laid out like tags
+    std::vector<uint8_t> dirty;
+    // LRU: last use per way, laid out like tags
+    std::vector<uint64_t> stamps;
+    // PLRU: bit n is inner node n of the set's tree, root at 1
+    std::vector<uint32_t> trees;
+    uint64_t clock;
+    uint64_t random;
+    uint64_t hitCount;
+    uint64_t missCount;
+    uint64_t writebackCount;
+};
+
+// The caches to model, no L2 unless second is set
+struct CacheLevels
+{
+    CacheConfig instruction;
+    CacheConfig data;
+    std::optional<CacheConfig> second;
+};
+
+/**
+ * Split L1 instruction and data caches with an optional unified L2 behind
+ * them, fed from the CPU's block entries and its loads and stores. Fetches
+ * are looked up once per line a block touches, the other instructions in
+ * that line hit by construction, and like the pipeline model a block is
+ * fetched once it is known how far it ran, so its fetches reach L2 after
+ * its data accesses. Hits and misses are counted per instruction, indexed
+ * like the predecoded text, and accumulate over runs.
+ */
+class CacheModel
+{
+public:
+    CacheModel(std::size_t instructions, const CacheLevels &levels);
+
+    // The block at start runs, instructions long unless the run stops inside it
+    void enter(uint32_t start, uint32_t instructions)
+    {
+        fetch(this->pendingStart, this->pendingLength);
+        this->pendingStart = start;
+        this->pendingLength = instructions;
+    }
+    // The load or store at op index reads or writes address
+    void data(uint32_t index, uint32_t address, bool write)
+    {
+        Cache::Outcome outcome = this->l1d.access(address, write);
+        if (!outcome.hit) [[unlikely]]
+        {
+            ++this->counters[index].dataMisses;
+            below(index, address, outcome);
+        }
+        ++this->counters[index].dataAccesses;
+    }
+    // Ends a run that stopped at op index stop (which ran), or RUN_COMPLETE
+    void stop(uint32_t stop);
+
+    const Cache &instructionCache() const;
+    const Cache &dataCache() const;
+    // Null without an L2
+    const Cache *secondLevel() const;
+    // Totals per cache and miss rates per text label, most misses first
+    void report(std::ostream &out, const MIPS &program, std::size_t hottest = 20) const;
+    void clear();
+
+private:
+    struct Counters
+    {
+        uint64_t fetches = 0;
+        uint64_t fetchMisses = 0;
+        uint64_t dataAccesses = 0;
+        uint64_t dataMisses = 0;
+        uint64_t secondMisses = 0;
+    };
+
+    // Looks up every line of length instructions from start in L1I
+    void fetch(uint32_t start, uint32_t length);
+    // Passes an L1 miss of the instruction at index and its writeback on to L2
+    void below(uint32_t index, uint32_t address, const Cache::Outcome &outcome);
+
+    Cache l1i;
+    Cache l1d;
+    std::unique_ptr<Cache> l2;
+    std::vector<Counters> counters;
+    // Block entered last, fetched once the next is entered or the run stops
+    uint32_t pendingStart;
+    uint32_t pendingLength;
+};
+
+#endif
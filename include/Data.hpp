@@ -1,22 +1,33 @@
 #ifndef DATA_HPP
 #define DATA_HPP
 
+#include "Lexer.hpp"
 #include <string>
+#include <string_view>
+#include <span>
+#include <vector>
 #include <cstdint>
 class Data
 {
 public:
     Data();
-    Data(std::string &dataline, u_int32_t address);
+    // toks starts at the directive, address is aligned for it
+    Data(std::string_view label, std::span<const Token> toks, uint32_t address);
     ~Data();
+    // Writing the directive's bytes big-endian into an image starting at DATA_START
+    void writeImage(std::span<const Token> toks, std::vector<uint8_t> &image) const;
     uint32_t address;
-    std::string dataline;
+    // Number of bytes the directive reserves
+    uint32_t size;
     std::string label;
     std::string directive;
     std::string val;
 
 private:
-    void processData(std::string &dataline);
+    void processData(std::span<const Token> toks);
 };
 
-#endif
\ No newline at end of file
+// Length of a string literal once escapes are decoded
+std::size_t unescapedLength(std::string_view str);
+
+#endif
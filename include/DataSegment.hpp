@@ -1,23 +1,179 @@
 #ifndef DATASEGMENT_H
 #define DATASEGMENT_H
 
-#include "vector"
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
+// Raised for misaligned, unmapped and permission-violating guest accesses
+class MemoryFault : public std::runtime_error
+{
+public:
+    enum class Kind
+    {
+        UNALIGNED,
+        UNMAPPED,
+        PROTECTION
+    };
+    MemoryFault(Kind kind, uint32_t address, const std::string &message);
+    Kind kind;
+    uint32_t address;
+};
+
+/**
+ * Sparse big-endian guest memory over the whole 32-bit address space.
+ * Regions are mapped with permissions, the 4KB pages backing them are only
+ * allocated on first write (reads of untouched pages see a shared zero
+ * page), and a two-level table finds them. Recently used pages sit in a
+ * small direct-mapped TLB per access type, so a hit costs one compare.
+ * Pages are shared with snapshots and copied on the first write after one,
+ * so restoring a snapshot only touches the pages written since.
+ */
 class DataSegment
 {
 public:
-    // Constructor
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    static constexpr uint32_t TLB_SIZE = 64;
+    enum Permission : uint8_t
+    {
+        READ = 1,
+        WRITE = 2,
+        EXECUTE = 4
+    };
+
+    // Pages and regions at one point, see snapshot and restore
+    struct Snapshot;
+
     DataSegment();
     ~DataSegment();
-    // Memory
-    bool write(const void *data);
-    uint8_t read(uint32_t address);
-    std::uint32_t address;
+    DataSegment(const DataSegment &) = delete;
+    DataSegment &operator=(const DataSegment &) = delete;
+
+    // Makes [start, start + size) accessible, both ends are rounded out to pages.
+    // A range starting where a region with the same permissions ends extends it.
+    void map(uint32_t start, uint32_t size, uint8_t permissions);
+    // Copies bytes in whatever the permissions, for loading the program
+    void load(uint32_t address, std::span<const uint8_t> bytes);
+
+    uint32_t readWord(uint32_t address)
+    {
+        const uint8_t *p = readable(address, 4);
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+    uint16_t readHalf(uint32_t address)
+    {
+        const uint8_t *p = readable(address, 2);
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+    uint8_t read(uint32_t address)
+    {
+        return *readable(address, 1);
+    }
+    void writeWord(uint32_t address, uint32_t value)
+    {
+        uint8_t *p = writable(address, 4);
+        p[0] = static_cast<uint8_t>(value >> 24);
+        p[1] = static_cast<uint8_t>(value >> 16);
+        p[2] = static_cast<uint8_t>(value >> 8);
+        p[3] = static_cast<uint8_t>(value);
+    }
+    void writeHalf(uint32_t address, uint16_t value)
+    {
+        uint8_t *p = writable(address, 2);
+        p[0] = static_cast<uint8_t>(value >> 8);
+        p[1] = static_cast<uint8_t>(value);
+    }
+    void write(uint32_t address, uint8_t value)
+    {
+        *writable(address, 1) = value;
+    }
+
+    // Host pointer to size bytes at address, or null where the access would fault
+    const uint8_t *tryRead(uint32_t address, uint32_t size);
+    uint8_t *tryWrite(uint32_t address, uint32_t size);
+    // Pages actually allocated
+    std::size_t residentPages() const;
+    // Captures every page and region, sharing the pages rather than copying them
+    Snapshot snapshot();
+    // Puts back the contents of a snapshot of this segment. Restoring the snapshot
+    // last taken or restored only swaps back the pages written since.
+    void restore(const Snapshot &snapshot);
 
 private:
-    std::vector<uint8_t> memory;
-    bool resize();
+    struct Page
+    {
+        uint8_t bytes[PAGE_SIZE];
+    };
+    // Second level of the page table, covering 4MB
+    struct Table
+    {
+        std::array<std::shared_ptr<Page>, 1024> pages;
+    };
+    struct Region
+    {
+        uint32_t start;
+        uint64_t end;
+        uint8_t permissions;
+    };
+    struct TlbEntry
+    {
+        uint32_t page;
+        uint8_t *data;
+    };
+
+    const uint8_t *readable(uint32_t address, uint32_t size)
+    {
+        const TlbEntry &entry = this->readTlb[(address >> PAGE_BITS) % TLB_SIZE];
+        if (entry.page == (address >> PAGE_BITS) && (address & (size - 1)) == 0)
+        {
+            return entry.data + (address & (PAGE_SIZE - 1));
+        }
+        return readMiss(address, size);
+    }
+    uint8_t *writable(uint32_t address, uint32_t size)
+    {
+        const TlbEntry &entry = this->writeTlb[(address >> PAGE_BITS) % TLB_SIZE];
+        if (entry.page == (address >> PAGE_BITS) && (address & (size - 1)) == 0)
+        {
+            return entry.data + (address & (PAGE_SIZE - 1));
+        }
+        return writeMiss(address, size);
+    }
+    const uint8_t *readMiss(uint32_t address, uint32_t size);
+    uint8_t *writeMiss(uint32_t address, uint32_t size);
+    // Base of the page holding address for the access, filling the TLB, null on a fault
+    uint8_t *resolve(uint32_t address, Permission access);
+    [[noreturn]] void raise(uint32_t address, uint32_t size, Permission access) const;
+    const Region *regionOf(uint32_t address) const;
+    Page *pageAt(uint32_t page) const;
+    // Page to write to, allocated or copied away from a snapshot first
+    Page *allocate(uint32_t page);
+    void flushTlb();
+
+    std::array<std::unique_ptr<Table>, 1024> directory;
+    std::vector<Region> regions;
+    std::array<TlbEntry, TLB_SIZE> readTlb;
+    std::array<TlbEntry, TLB_SIZE> writeTlb;
+    std::size_t resident;
+    // Snapshot the pages are tracked against, and the pages written since
+    uint64_t baseline;
+    std::vector<uint32_t> dirty;
+};
+
+struct DataSegment::Snapshot
+{
+    // Resident pages ordered by page number
+    std::vector<std::pair<uint32_t, std::shared_ptr<Page>>> pages;
+    std::vector<Region> regions;
+    const DataSegment *owner = nullptr;
+    uint64_t generation = 0;
 };
 
 #endif
@@ -0,0 +1,127 @@
+#ifndef DEBUGGER_HPP
+#define DEBUGGER_HPP
+
+#include "Op.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class CPU;
+class MIPS;
+
+// Why a debugged run gave control back
+struct DebugStop
+{
+    enum Reason : uint8_t
+    {
+        EXITED,
+        BREAKPOINT,
+        WATCHPOINT,
+        STEPPED
+    };
+
+    Reason reason;
+    // Address of the next instruction to run, the one hit or watched
+    uint32_t pc;
+    // For EXITED, the code the program exited with
+    int exitCode;
+    // For WATCHPOINT, the symbol, the address accessed and whether it was a store
+    std::string symbol;
+    uint32_t address;
+    bool write;
+};
+
+/**
+ * Breakpoints, watchpoints and single-stepping for one CPU. Breakpoints
+ * replace their op in the predecoded text with a BREAKPOINT op, so the run
+ * loop only meets them where they are set. Stepping and watchpoints are
+ * checked only in the debug instance of the run loop, which the CPU uses
+ * while a debugger is attached, so runs without one pay for none of it.
+ * Debugged runs interpret and leave the profiler and the other models out.
+ * A stop leaves the CPU before the instruction hit or watched, and going on
+ * runs that instruction first without stopping on it again.
+ */
+class Debugger
+{
+public:
+    // Accesses a watchpoint stops on
+    static constexpr uint8_t READ = 1;
+    static constexpr uint8_t WRITE = 2;
+
+    // Attaches to cpu, which must be running program and outlive the debugger
+    Debugger(CPU &cpu, const MIPS &program);
+    // Removes every breakpoint and detaches
+    ~Debugger();
+    Debugger(const Debugger &) = delete;
+    Debugger &operator=(const Debugger &) = delete;
+
+    // Breaks before the instruction at a text label or an address such as
+    // 0x00400010, returns its address
+    uint32_t addBreakpoint(std::string_view where);
+    // False when there was no breakpoint at where
+    bool removeBreakpoint(std::string_view where);
+    // Addresses with a breakpoint, in order
+    std::vector<uint32_t> breakpoints() const;
+    // Stops before loads (READ), stores (WRITE) or both touching any byte of
+    // a dataTable symbol
+    void addWatchpoint(std::string_view symbol, uint8_t access);
+    bool removeWatchpoint(std::string_view symbol);
+    // Runs until a breakpoint, a watchpoint or the end of the program
+    DebugStop resume();
+    // Same, stopping after count instructions at the latest
+    DebugStop step(uint64_t count = 1);
+    // Instructions run over every resume and step
+    uint64_t executed() const;
+    bool exited() const;
+
+private:
+    friend class CPU;
+
+    struct Watch
+    {
+        uint32_t start;
+        uint32_t end;
+        uint8_t access;
+        std::string symbol;
+    };
+
+    // Called by the debug loop before each load or store, true to stop before it
+    bool watched(uint32_t address, uint32_t size, bool write)
+    {
+        if (address >= this->watchEnd || address + size <= this->watchStart || !this->armed)
+        {
+            return false;
+        }
+        return hit(address, size, write);
+    }
+    bool hit(uint32_t address, uint32_t size, bool write);
+    // Op index of a label or address in the text
+    uint32_t indexOf(std::string_view where) const;
+    // One run of the debug loop, count instructions at most
+    DebugStop run(uint64_t count);
+    DebugStop go(uint64_t count);
+    // Recomputes the range covering every watchpoint
+    void bound();
+
+    CPU &cpu;
+    const MIPS &program;
+    // Op each breakpoint replaced, by op index
+    std::unordered_map<uint32_t, Op> patched;
+    std::vector<Watch> watches;
+    uint32_t watchStart;
+    uint32_t watchEnd;
+    // Cleared while the instruction a watchpoint stopped before runs
+    bool armed;
+    // Instructions the debug loop may still run, counted down by it
+    uint64_t stepsLeft;
+    // Set by the debug loop when it stops before an instruction
+    DebugStop stop;
+    bool stopped;
+    uint64_t total;
+    bool finished;
+    int exitCode;
+};
+
+#endif
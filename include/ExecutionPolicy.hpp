@@ -0,0 +1,74 @@
+#ifndef EXECUTIONPOLICY_HPP
+#define EXECUTIONPOLICY_HPP
+
+#include <cstdint>
+
+/**
+ * Features of the run loop, each a policy type that an instance of
+ * CPU::execute either compiles in or leaves out entirely
+ */
+namespace Feature
+{
+// Hot blocks run as compiled code
+struct Jit
+{
+    static constexpr uint32_t BIT = 1;
+};
+// Runs stop before the block that would pass the instruction budget
+struct Budget
+{
+    static constexpr uint32_t BIT = 2;
+};
+// Per-instruction counters, see Profiler
+struct Profile
+{
+    static constexpr uint32_t BIT = 4;
+};
+// Blocks and memory addresses into a TraceStream
+struct Trace
+{
+    static constexpr uint32_t BIT = 8;
+};
+// The five-stage pipeline model, see Pipeline
+struct Timing
+{
+    static constexpr uint32_t BIT = 16;
+};
+// Fetches, loads and stores through a CacheModel
+struct Caches
+{
+    static constexpr uint32_t BIT = 32;
+};
+// Conditional branches and returns through a BranchPredictor
+struct Predict
+{
+    static constexpr uint32_t BIT = 64;
+};
+// Stepping, watchpoints and breakpoints, see Debugger
+struct Debug
+{
+    static constexpr uint32_t BIT = 128;
+};
+// Budget and every observer compiled in and each checked at runtime, for
+// combinations without an instance of their own
+struct Dynamic
+{
+    static constexpr uint32_t BIT = 256;
+};
+}
+
+// A combination of features as one type, FEATURES has the bit of each
+template <uint32_t Features>
+struct ExecutionPolicy
+{
+    static constexpr uint32_t FEATURES = Features;
+
+    template <typename F>
+    static constexpr bool has = (Features & F::BIT) != 0;
+};
+
+// ExecutionPolicy<Feature::Profile::BIT | Feature::Budget::BIT> as Policy<Feature::Profile, Feature::Budget>
+template <typename... Features>
+using Policy = ExecutionPolicy<(0u | ... | Features::BIT)>;
+
+#endif
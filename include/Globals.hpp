@@ -2,7 +2,10 @@
 #define GLOBALS_H
 #include <cstdint>
 
-extern uint32_t PC_START; // Declaration
-extern uint32_t DATA_START;
-extern uint32_t DATA_SEGMENT_SIZE;
-#endif
\ No newline at end of file
+// Memory layout, fixed for every program so assembled programs can be shared
+inline constexpr uint32_t PC_START = 0x00400000;        // First address for text
+inline constexpr uint32_t DATA_START = 0x10010000;      // First Address for data
+inline constexpr uint32_t DATA_SEGMENT_SIZE = 0x100000; // 1MB Size for static memory
+inline constexpr uint32_t STACK_START = 0x7FFFEFFC;     // Initial $sp
+inline constexpr uint32_t GLOBAL_POINTER = 0x10008000;  // Initial $gp
+#endif
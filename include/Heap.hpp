@@ -0,0 +1,56 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include "DataSegment.hpp"
+#include <cstdint>
+
+/**
+ * The dynamic data region above the static data, grown by sbrk. The break
+ * moves by any word-aligned amount, but the region mapped behind it grows
+ * in chunks that double with the heap, so a program calling sbrk for a few
+ * bytes at a time only touches DataSegment once per chunk. Pages inside the
+ * mapped part are still only allocated when written.
+ */
+class Heap
+{
+public:
+    // Smallest extension of the mapped region
+    static constexpr uint32_t GROWTH_CHUNK = 0x40000;
+
+    // Break and counters, restored along with a memory snapshot
+    struct State
+    {
+        uint32_t current;
+        uint32_t mappedEnd;
+        uint32_t peak;
+        uint64_t growths;
+    };
+
+    Heap(DataSegment &memory, uint32_t base, uint32_t limit);
+    // Syscall 9: moves the break up by bytes rounded to a word and returns the old break
+    uint32_t sbrk(int32_t bytes);
+
+    uint32_t base() const;
+    // First address past the allocated heap
+    uint32_t brk() const;
+    // Most bytes the heap ever held
+    uint32_t highWater() const;
+    // Bytes of address space mapped for the heap so far
+    uint32_t mapped() const;
+    // Times the mapped region had to grow
+    uint64_t growthEvents() const;
+    State state() const;
+    // The mapping behind the break is the caller's to restore
+    void restore(const State &state);
+
+private:
+    DataSegment &memory;
+    uint32_t start;
+    uint32_t limit;
+    uint32_t current;
+    uint32_t mappedEnd;
+    uint32_t peak;
+    uint64_t growths;
+};
+
+#endif
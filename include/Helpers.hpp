@@ -7,8 +7,8 @@
 #include <bitset>
 #include <cstdint>
 #include <sstream>
-
-std::vector<std::string> split(const std::string &s, char delim);
+#include <string_view>
+#include <unordered_map>
 
 template <typename T>
 std::string vectorToString(const std::vector<T> &vec)
@@ -27,16 +27,49 @@ std::string vectorToString(const std::vector<T> &vec)
     return oss.str();
 }
 
-void validateVectorSize(int expSize, const std::vector<std::string> &toks);
-
 std::string toBinaryString(int32_t value, std::size_t bitWidth);
 
 bool fitsIn16Bits(std::int32_t value);
 
 bool fitsIn32Bits(std::int32_t value);
 
-bool isHexadecimal(const std::string &str);
-bool isInteger(const std::string &str);
-std::int32_t handleValue(const std::string &str);
+// Error code for a parsed literal
+enum class LiteralError : std::uint8_t
+{
+    NONE,         // Parsed successfully
+    EMPTY,        // No characters
+    NOT_LITERAL,  // Does not start like a number or character, e.g. a label
+    INVALID,      // Starts like a literal but is malformed
+    OUT_OF_RANGE  // Does not fit the requested width
+};
+
+struct Literal
+{
+    std::int32_t value;
+    LiteralError error;
+};
+
+// Decimal, hex (0x), signed and character ('a', '\n') literals without exceptions.
+// 16 bits is the signed immediate range, 32 bits also accepts unsigned values.
+Literal parseLiteral(std::string_view str, unsigned bits = 32);
+// Value of an escape such as the n in \n, or -1 if unknown
+int decodeEscape(char c);
+// Parses a literal that must be valid, throwing with the text otherwise
+std::int32_t handleValue(std::string_view str);
+// The fields of a spec such as "8K,2,32" between separators, empty ones included
+std::vector<std::string_view> splitFields(std::string_view text, char separator = ',');
+
+// Hash allowing string_view lookups in string keyed maps without a copy
+struct StringHash
+{
+    using is_transparent = void;
+    std::size_t operator()(std::string_view str) const
+    {
+        return std::hash<std::string_view>{}(str);
+    }
+};
+
+template <typename T>
+using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
 
 #endif
\ No newline at end of file
@@ -1,112 +1,234 @@
 #ifndef INSTRUCTION_HPP
 #define INSTRUCTION_HPP
 
-#include "Data.hpp"
+#include "PerfectHash.hpp"
+#include "Lexer.hpp"
+#include <array>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
-#include <functional>
-#include <vector>
-#include <optional>
+#include <span>
+
+// Operand layouts, each parsed by its own function
+enum class Layout : uint8_t
+{
+    DST,    // add $d, $s, $t
+    ST,     // mult $s, $t
+    S,      // jr $s
+    D,      // mfhi $d
+    DTSHA,  // sll $d, $t, shamt
+    TSIMM,  // addi $t, $s, imm
+    TIMM,   // lui $t, imm
+    STOFF,  // beq $s, $t, offset
+    TOFFS,  // lw $t, offset($s)
+    SOFF,   // bgtz $s, offset
+    TARG,   // j target
+    SYSCALL // syscall
+};
 
 struct InstructionInfo
 {
-    std::string opcode; // The opcode in binary string form
-    std::string funct;  // The function in binary string form (optional)
+    std::string_view name; // The mnemonic
+    uint8_t opcode;        // The 6-bit opcode
+    uint8_t funct;         // The 6-bit function (R-format only)
+    Layout layout;         // Operand layout
 };
 
 // Define a structure to hold the register information
 struct RegisterInfo
 {
-    uint32_t decVal;    // The integer representation
-    std::string binStr; // The binary string representation
+    std::string_view name; // The register name
+    uint32_t decVal;       // The integer representation
 };
 
 class Instruction
 {
 public:
     // Constructors
-    Instruction(const std::string &curInstruction,
-                uint32_t pc,
-                const std::unordered_map<std::string, uint32_t> &labelTable,
-                const std::unordered_map<std::string, Data> &dataTable);
+    Instruction();
+    // Any label operand is written to symbol and left as zero for the parser to patch
+    Instruction(std::span<const Token> toks, uint32_t pc, uint32_t line, std::string_view &symbol);
+    // Building from fields, used by pseudo instruction expansion
+    Instruction(const InstructionInfo &info, uint8_t rd, uint8_t rs, uint8_t rt, int32_t imm, uint32_t pc, uint32_t line);
     ~Instruction();
-    // Mapping sizes
-    static const std::unordered_map<std::string, int> LAYOUT_INPUT_SIZES;
-    // Mapping instructions to parser function
-    static const std::unordered_map<std::string, std::function<void(Instruction &, std::vector<std::string> &)>> MNEMONIC_FUNCTION_MAP;
-    // Mapping instructions to their binary/decimal representaion
-    static const std::unordered_map<std::string, InstructionInfo> INSTRUCTIONMAP;
-    // Mapping registers to their binary/decimal representaions
-    static const std::unordered_map<std::string, RegisterInfo> REGISTER_MAP;
-    // Label and data table
-    const std::unordered_map<std::string, uint32_t> &labelTable;
-    const std::unordered_map<std::string, Data> &dataTable;
-    // Attributes
-    std::string ASMInstruction;
-    std::string mnemonic;
-    std::string opcode;
-    std::string funct;
-    std::string label;
-    std::string data;
+    // Rebuilding the decoded fields from an encoded word
+    static Instruction decode(uint32_t machine, uint32_t address, uint32_t line);
+    // Mapping layouts to the number of tokens including the mnemonic
+    static constexpr std::array<int, 12> LAYOUT_INPUT_SIZES = {
+        4, // DST
+        3, // ST
+        2, // S
+        2, // D
+        4, // DTSHA
+        4, // TSIMM
+        3, // TIMM
+        4, // STOFF
+        3, // TOFFS
+        3, // SOFF
+        2, // TARG
+        1  // SYSCALL
+    };
+    // Mapping instructions to their opcode, function and layout
+    static constexpr PerfectHashTable<InstructionInfo, 43, 256> INSTRUCTIONMAP{{{
+        // Arithmetic and Logical Instructions
+        {"add", 0b000000, 0b100000, Layout::DST},
+        {"addu", 0b000000, 0b100001, Layout::DST},
+        {"sub", 0b000000, 0b100010, Layout::DST},
+        {"subu", 0b000000, 0b100011, Layout::DST},
+        {"mult", 0b000000, 0b011000, Layout::ST},
+        {"multu", 0b000000, 0b011001, Layout::ST},
+        {"div", 0b000000, 0b011010, Layout::ST},
+        {"divu", 0b000000, 0b011011, Layout::ST},
+        {"mfhi", 0b000000, 0b010000, Layout::D},
+        {"mflo", 0b000000, 0b010010, Layout::D},
+        {"and", 0b000000, 0b100100, Layout::DST},
+        {"or", 0b000000, 0b100101, Layout::DST},
+        {"xor", 0b000000, 0b100110, Layout::DST},
+        {"nor", 0b000000, 0b100111, Layout::DST},
+        {"sll", 0b000000, 0b000000, Layout::DTSHA},
+        {"srl", 0b000000, 0b000010, Layout::DTSHA},
+        {"sra", 0b000000, 0b000011, Layout::DTSHA},
+        {"slt", 0b000000, 0b101010, Layout::DST},
+        {"sltu", 0b000000, 0b101011, Layout::DST},
+
+        // Data Transfer Instructions
+        {"lw", 0b100011, 0, Layout::TOFFS},
+        {"sw", 0b101011, 0, Layout::TOFFS},
+        {"lb", 0b100000, 0, Layout::TOFFS},
+        {"sb", 0b101000, 0, Layout::TOFFS},
+        {"lbu", 0b100100, 0, Layout::TOFFS},
+        {"lh", 0b100001, 0, Layout::TOFFS},
+        {"sh", 0b101001, 0, Layout::TOFFS},
+        {"lui", 0b001111, 0, Layout::TIMM},
+
+        // Branch and Jump Instructions
+        {"beq", 0b000100, 0, Layout::STOFF},
+        {"bne", 0b000101, 0, Layout::STOFF},
+        {"bgtz", 0b000111, 0, Layout::SOFF},
+        {"bltz", 0b000001, 0, Layout::SOFF},
+        {"j", 0b000010, 0, Layout::TARG},
+        {"jal", 0b000011, 0, Layout::TARG},
+        {"jr", 0b000000, 0b001000, Layout::S},
+
+        // Immediate Instructions
+        {"addi", 0b001000, 0, Layout::TSIMM},
+        {"addiu", 0b001001, 0, Layout::TSIMM},
+        {"andi", 0b001100, 0, Layout::TSIMM},
+        {"ori", 0b001101, 0, Layout::TSIMM},
+        {"xori", 0b001110, 0, Layout::TSIMM},
+        {"slti", 0b001010, 0, Layout::TSIMM},
+        {"sltiu", 0b001011, 0, Layout::TSIMM},
+
+        // Special Instructions
+        {"nop", 0b000000, 0b000000, Layout::SYSCALL},
+        {"syscall", 0b000000, 0b001100, Layout::SYSCALL},
+    }}};
+    // Mapping registers to their decimal representaions
+    static constexpr PerfectHashTable<RegisterInfo, 32, 128> REGISTER_MAP{{{
+        {"$zero", 0},
+        {"$at", 1},
+        {"$v0", 2},
+        {"$v1", 3},
+        {"$a0", 4},
+        {"$a1", 5},
+        {"$a2", 6},
+        {"$a3", 7},
+        {"$t0", 8},
+        {"$t1", 9},
+        {"$t2", 10},
+        {"$t3", 11},
+        {"$t4", 12},
+        {"$t5", 13},
+        {"$t6", 14},
+        {"$t7", 15},
+        {"$s0", 16},
+        {"$s1", 17},
+        {"$s2", 18},
+        {"$s3", 19},
+        {"$s4", 20},
+        {"$s5", 21},
+        {"$s6", 22},
+        {"$s7", 23},
+        {"$t8", 24},
+        {"$t9", 25},
+        {"$k0", 26},
+        {"$k1", 27},
+        {"$gp", 28},
+        {"$sp", 29},
+        {"$fp", 30},
+        {"$ra", 31},
+    }}};
+    // Register names indexed by number
+    static const char *const REGISTER_NAMES[32];
+    // Machine Code
+    uint32_t machine;
     uint32_t address;
-    // Registers
-    std::string rdName;
-    std::string rsName;
-    std::string rtName;
-    // Decimal representations
-    int16_t imm;
+    // Index of the source line in the parser's text lines
+    uint32_t line;
+    // Sign extended immediate, shift amount or jump target
+    int32_t imm;
+    // Decoded fields
+    uint8_t opcode;
+    uint8_t funct;
     uint8_t rd;
     uint8_t rs;
     uint8_t rt;
-    // Binary represenations
-    std::string rdBit;
-    std::string rsBit;
-    std::string rtBit;
-    std::string immBit;
-    // Machine Code
-    std::string machine;
 
     // Method
+    // Filling in the immediate or target field once a symbol is resolved
+    void patch(int32_t value);
+    // Formatting only when asked
+    std::string mnemonic() const;
+    std::string machineBits() const;
+    std::string disassemble() const;
+    bool isJump() const;
+    // checking registers validate
+    static RegisterInfo validateRegister(std::string_view reg);
     friend std::ostream &operator<<(std::ostream &os, const Instruction &instruction);
 
 private:
-    std::string buildMachine(std::string one, std::string two, std::string three, std::string four, std::string five, std::string six);
+    // Packing fields into the machine word
+    void encodeR(uint8_t shamt = 0);
+    void encodeI();
+    void encodeJ();
     // checking if enough tokens avaibale for instructions
-    // checking registers validate
-    static RegisterInfo validateRegister(const std::string &reg);
+    static constexpr int layoutSize(Layout layout)
+    {
+        return LAYOUT_INPUT_SIZES[static_cast<std::size_t>(layout)];
+    }
     // Setting register values
-    static void setRegisters(std::string &reg, std::string &regName, uint8_t &dec, std::string &bit);
+    static void setRegisters(std::string_view reg, uint8_t &dec);
     // Setting offset
-    static void setOffset(std::string &offset, Instruction &instr);
+    static void setOffset(std::string_view offset, Instruction &instr, std::string_view &symbol);
     // Setting immediate
-    static void setIMM(std::string &immStr, Instruction &instr);
+    static void setIMM(std::string_view immStr, Instruction &instr);
     // parse instructions
-    static void parseInstruction(Instruction &instr, std::vector<std::string> &toks);
+    static void parseInstruction(Layout layout, Instruction &instr, std::span<const Token> toks, std::string_view &symbol);
     // mnemonic $d, $s, $t
-    static void parseDST(Instruction &instr, std::vector<std::string> &toks);
+    static void parseDST(Instruction &instr, std::span<const Token> toks);
     // mnemonic $s $t
-    static void parseST(Instruction &instr, std::vector<std::string> &toks);
+    static void parseST(Instruction &instr, std::span<const Token> toks);
     // mnemonic $s
-    static void parseS(Instruction &instr, std::vector<std::string> &toks);
+    static void parseS(Instruction &instr, std::span<const Token> toks);
+    // mnemonic $d
+    static void parseD(Instruction &instr, std::span<const Token> toks);
     // mnemonic $d, $t shamt
-    static void parseDTSHA(Instruction &instr, std::vector<std::string> &toks);
+    static void parseDTSHA(Instruction &instr, std::span<const Token> toks);
     // mnemonic $t, $s imm
-    static void parseTSIMM(Instruction &instr, std::vector<std::string> &toks);
+    static void parseTSIMM(Instruction &instr, std::span<const Token> toks);
     // mnemonic $t, imm
-    static void parseTIMM(Instruction &instr, std::vector<std::string> &toks);
+    static void parseTIMM(Instruction &instr, std::span<const Token> toks);
     // mnemonic $s, $t, offset
-    static void parseSTOFF(Instruction &instr, std::vector<std::string> &toks);
+    static void parseSTOFF(Instruction &instr, std::span<const Token> toks, std::string_view &symbol);
     // mnemonic $t, offset($s)
-    static void parseTOFFS(Instruction &instr, std::vector<std::string> &toks);
+    static void parseTOFFS(Instruction &instr, std::span<const Token> toks, std::string_view &symbol);
     // mnemonic $s, offset
-    static void parseSOFF(Instruction &instr, std::vector<std::string> &toks);
+    static void parseSOFF(Instruction &instr, std::span<const Token> toks, std::string_view &symbol);
     // mnemonic target
-    static void parseTARG(Instruction &instr, std::vector<std::string> &toks);
-    // syscall
-    static void parseSyscall(Instruction &instr, std::vector<std::string> &toks);
+    static void parseTARG(Instruction &instr, std::span<const Token> toks, std::string_view &symbol);
+    // syscall or nop
+    static void parseSyscall(Instruction &instr, std::span<const Token> toks);
 };
 
-#endif
\ No newline at end of file
+#endif
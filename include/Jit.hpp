@@ -0,0 +1,73 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include "BlockCache.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Compiled code exists for x86-64 hosts with mmap, elsewhere compile() always declines
+#if defined(__x86_64__) && defined(__unix__)
+#define MIPS_JIT_SUPPORTED 1
+#else
+#define MIPS_JIT_SUPPORTED 0
+#endif
+
+/**
+ * Where compiled code finds the guest state. Everything is addressed
+ * relative to the register file, so the offsets are byte distances from
+ * regs to the other fields of the same CPU. Memory goes through the two
+ * hooks, which never throw: a load returns a negative value and a store
+ * returns false when the access would fault.
+ */
+struct JitTarget
+{
+    uint32_t *regs;
+    int32_t hiOffset;
+    int32_t loOffset;
+    // uint64_t the compiled code adds its retired instructions to
+    int32_t executedOffset;
+    // uint64_t bound on that counter, a block looping on itself returns rather than pass it
+    int32_t limitOffset;
+    // Op index of the HALT op, the highest valid jr target
+    uint32_t textCount;
+    void *memory;
+    int64_t (*load)(void *memory, uint32_t address, uint32_t kind);
+    bool (*store)(void *memory, uint32_t address, uint32_t value, uint32_t kind);
+};
+
+/**
+ * Compiles hot blocks into x86-64 code. Compiled code runs the block and
+ * returns the op index to continue at. Syscalls, overflow traps, memory
+ * faults, bad jr targets and ops without a translation leave the compiled
+ * code at that op with everything before it done and INTERPRET set, so the
+ * interpreter runs it and produces the same state and errors it would have
+ * on its own. A
+ * block whose branch returns to its own start loops without leaving.
+ */
+class Jit
+{
+public:
+    // Block entries before a block is compiled
+    static constexpr uint64_t HOT_BLOCK_ENTRIES = 64;
+    // Set in a returned index when the op there must be interpreted
+    static constexpr uint32_t INTERPRET = 0x80000000;
+
+    explicit Jit(const JitTarget &target);
+    ~Jit();
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // Native code for block, or null when none could be made
+    NativeBlock compile(const Block &block);
+    std::size_t compiledBlocks() const;
+    std::size_t codeBytes() const;
+
+private:
+    JitTarget target;
+    uint8_t *buffer;
+    std::size_t capacity;
+    std::size_t used;
+    std::size_t compiled;
+};
+
+#endif
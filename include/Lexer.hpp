@@ -0,0 +1,67 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include "SourceFile.hpp"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Kind of each token on a source line
+enum class TokenType : uint8_t
+{
+    SYMBOL,    // Mnemonic or label reference
+    REGISTER,  // $t0
+    MEMORY,    // offset($s), text holds the offset and base the register
+    DIRECTIVE, // .word
+    STRING,    // "text" without the quotes, escapes left as written
+    LITERAL,   // 12, -4, 0x10, 'a'
+    COLON      // Standalone ':' as in .word 0 : 12
+};
+
+struct Token
+{
+    TokenType type;
+    std::string_view text;
+    std::string_view base;
+};
+
+// One lexed line, every view points into the source buffer
+struct SourceLine
+{
+    // Label defined at the start of the line, without the colon
+    std::string_view label;
+    // Tokens after the label, reused between lines so lexing does not allocate
+    std::vector<Token> tokens;
+    // Line text after the label with the comment and surrounding space removed
+    std::string_view text;
+};
+
+class Lexer
+{
+public:
+    // Lexing a buffer already in memory
+    Lexer(std::string_view source);
+    // Lexing lines as they are read from a file or stream
+    Lexer(SourceFile &file);
+    // Lexes the next line into line, returns false at the end of the source
+    bool next(SourceLine &line);
+    // 1-based number of the line last returned
+    uint32_t lineNumber() const;
+    // Lexes a single line
+    static void lexLine(std::string_view text, SourceLine &line);
+
+private:
+    std::string_view source;
+    SourceFile *file;
+    std::size_t pos;
+    uint32_t curLine;
+};
+
+// Checks a line has exactly expSize tokens
+void validateTokenCount(std::size_t expSize, std::span<const Token> toks);
+// Joins tokens back into text for error messages
+std::string tokensToString(std::span<const Token> toks);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef LISTING_HPP
+#define LISTING_HPP
+
+#include "MIPS.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// How much the assembler reports, nothing is printed by default
+enum class Verbosity
+{
+    QUIET,   // No output
+    LISTING, // One line per machine word
+    VERBOSE  // Every field of every instruction
+};
+
+enum class ListingFormat
+{
+    TEXT, // Columns of address, machine word and source
+    JSON  // Instructions, labels and data as one JSON object
+};
+
+/**
+ * Writes an assembled program to a stream through a large buffer so a listing
+ * costs a handful of writes rather than one per instruction.
+ */
+class Listing
+{
+public:
+    Listing(std::ostream &out);
+    ~Listing();
+    void write(const MIPS &mips, Verbosity verbosity, ListingFormat format);
+    // Pushing the buffer to the stream
+    void flush();
+
+private:
+    void writeText(const MIPS &mips);
+    void writeJSON(const MIPS &mips);
+    void writeVerbose(const MIPS &mips);
+    void append(std::string_view text);
+    void appendJSONString(std::string_view text);
+
+    std::ostream &out;
+    std::string buffer;
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+};
+
+#endif
@@ -4,27 +4,47 @@
 #include "Instruction.hpp"
 #include "MIPSParser.hpp"
 #include "Data.hpp"
+#include "Helpers.hpp"
+#include "SourceFile.hpp"
+#include <iostream>
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <memory>
 #include <optional>
 
+struct AssemblerOptions
+{
+    // Threads encoding the text section, 0 means one per core
+    unsigned threads = 0;
+    // Directory of the assembled program cache, empty disables it
+    std::string cacheDir;
+};
+
 class MIPS
 {
 public:
     MIPS();
-    MIPS(const std::string &file);
+    MIPS(const std::string &file, const AssemblerOptions &options = {});
     ~MIPS();
+    // Executes the program on a fresh CPU, returns its exit code
+    int run(std::istream &in = std::cin, std::ostream &out = std::cout) const;
     // Table to map label to adress for jumping
-    std::unordered_map<std::string, uint32_t> &labelTable;
+    StringMap<uint32_t> labelTable;
     // Data tables
-    std::unordered_map<std::string, Data> &dataTable;
+    StringMap<Data> dataTable;
+    // Initial contents of the data segment from DATA_START
+    std::vector<uint8_t> dataImage;
     // List of each instruction sequentially found in file
-    std::vector<Instruction> &instructions;
-    std::string &global;
+    std::vector<Instruction> instructions;
+    // Source text of each instruction, indexed by Instruction::line
+    std::vector<std::string_view> textLines;
+    std::string global;
 
 private:
-    MIPSParser parser;
+    friend class ProgramCache;
+    // Whichever of these holds the text textLines point into
+    std::unique_ptr<SourceFile> source;
+    std::string cachedText;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,11 +3,15 @@
 
 #include "Instruction.hpp"
 #include "Data.hpp"
+#include "Lexer.hpp"
+#include "Helpers.hpp"
+#include "SourceFile.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
+#include <memory>
+#include <span>
+#include <string_view>
 
 // Enum to represent the current section of the assembly file
 enum Section
@@ -21,42 +25,136 @@ enum Section
     // KDATA   // .kdata section
 };
 
+// Enum to represent each supported pseudo instruction
+enum Pseudo
+{
+    LI,   // Load Immediate
+    LA,   // Load Address
+    MOVE, // Move from one register to another
+    BLT,  // Branch Less Than
+    BGT,  // Branch Greater Than
+    BLE,  // Branch Less Than or Equal
+    BGE,  // Branch Greater Than or Equal
+    BEQZ, // Branch if Equal to Zero
+    BNEZ, // Branch if Not Equal to Zero
+    NOT,  // Bitwise Not
+    NEG,  // Negate
+    SEQ,  // Set on Equal
+    SNE,  // Set on Not Equal
+    SLE,  // Set on Less or Equal
+    SGE   // Set on Greater or Equal
+};
+
+struct PseudoInfo
+{
+    std::string_view name;
+    Pseudo op;
+    uint8_t size; // Words emitted, 0 when it depends on the operands
+};
+
+struct SectionInfo
+{
+    std::string_view name;
+    Section section;
+};
+
+// Enum to represent how a symbol reference is patched once its address is known
+enum FixupKind
+{
+    BRANCH,      // 16-bit word offset relative to pc + 4
+    JUMP,        // 26-bit pseudo-direct target
+    ADDR_HI,     // upper 16 bits for lui/ori pairs
+    ADDR_HI_ADJ, // upper 16 bits for lui/load pairs (low half is sign extended)
+    ADDR_LO,     // lower 16 bits
+    DATA_OFFSET  // offset from the start of the data segment
+};
+
+// Symbol reference waiting for its label or data address
+struct Fixup
+{
+    std::size_t index;       // Index into instructions
+    std::string_view symbol; // Label or data name referenced, points into the source
+    FixupKind kind;          // How the address is encoded
+};
+
+// Instructions encoded by one task of the encode stage
+struct EncodeBatch
+{
+    std::size_t next;          // Index of the next slot to fill in instructions
+    std::vector<Fixup> fixups; // Symbol references met in the batch
+};
+
 class MIPSParser
 {
 public:
-    // Constructor
-    MIPSParser(const std::string &inputfile);
+    // Constructor, threads is the encode parallelism with 0 meaning one per core
+    MIPSParser(const std::string &inputfile, unsigned threads = 0);
+    // Assembling a source already opened
+    MIPSParser(std::unique_ptr<SourceFile> source, unsigned threads = 0);
     ~MIPSParser();
     // Pseudo Instructions
-    static const std::unordered_set<std::string> PSEUDO_INSTRUCTIONS;
+    static constexpr PerfectHashTable<PseudoInfo, 15, 64> PSEUDO_INSTRUCTIONS{{{
+        {"li", LI, 0},
+        {"la", LA, 2},
+        {"move", MOVE, 1},
+        {"blt", BLT, 2},
+        {"bgt", BGT, 2},
+        {"ble", BLE, 2},
+        {"bge", BGE, 2},
+        {"beqz", BEQZ, 1},
+        {"bnez", BNEZ, 1},
+        {"not", NOT, 1},
+        {"neg", NEG, 1},
+        {"seq", SEQ, 2},
+        {"sne", SNE, 2},
+        {"sle", SLE, 2},
+        {"sge", SGE, 2},
+    }}};
     // File Name
     const std::string inputfile;
-    const std::string instructionfile;
+    // Source text, every token and text line points into it
+    std::unique_ptr<SourceFile> source;
     // Table to map label to adress for jumping
-    std::unordered_map<std::string, uint32_t> labelTable;
+    StringMap<uint32_t> labelTable;
     // Data tables
-    std::unordered_map<std::string, Data> dataTable;
+    StringMap<Data> dataTable;
+    // Initial contents of the data segment from DATA_START
+    std::vector<uint8_t> dataImage;
     // List of each instruction sequentially found in file
     std::vector<Instruction> instructions;
+    // Text lines without comments, indexed by Instruction::line
+    std::vector<std::string_view> textLines;
     std::string global;
 
 private:
     // Handle Pseudo Instruction
-    uint32_t handlePseudoInstr(std::vector<std::string> &stringVector, uint32_t pc);
-
-    // Getting symbol table
-    void createTables();
-    // Create instructions
-    void createInstructions();
-    // Current address being processed
-
-    uint32_t currentAddress;
-    static const std::unordered_map<std::string, Section> sectionMap;
+    uint32_t handlePseudoInstr(Pseudo op, std::span<const Token> toks, uint32_t pc, uint32_t line, EncodeBatch &batch);
+    // Load or store with a bare data label
+    uint32_t handleSymbolicMemory(std::span<const Token> toks, uint32_t pc, uint32_t line, EncodeBatch &batch);
+    // Adds a single instruction and records a fixup if it references a symbol
+    uint32_t emitInstruction(EncodeBatch &batch, const Instruction &instr, std::string_view symbol = {}, FixupKind kind = BRANCH);
+    // Number of words a text line encodes to, known without encoding it
+    static uint32_t instructionCount(std::span<const Token> toks);
+    // Pass over the source building symbol tables and laying out text lines
+    void assemble();
+    // Encoding text lines into their precomputed slots, split across threads
+    void encode(unsigned threads);
+    // Encoding text lines [first, last) into their slots
+    void encodeLines(std::size_t first, std::size_t last, EncodeBatch &batch);
+    // Patching symbol references once every label is known
+    void resolveFixups(std::span<const Fixup> fixups);
+    // Index of the first instruction of each text line, one extra entry for the end
+    std::vector<uint32_t> lineStarts;
+    // Text lines encoded per task
+    static constexpr std::size_t ENCODE_CHUNK_LINES = 1 << 13;
+    static constexpr PerfectHashTable<SectionInfo, 4, 16> SECTION_MAP{{{
+        {".text", TEXT},
+        {".data", DATA},
+        {".bss", BSS},
+        {".rodata", RODATA},
+    }}};
 };
 
-void cleanASMFile(const std::string &inputfile, const std::string &outfile);
-void cleanASMLine(std::string &curLine);
 void printFile(const std::string &inputfile);
-const std::string generateCleanName(const std::string &filename);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef OP_HPP
+#define OP_HPP
+
+#include <cstdint>
+
+// Every operation the interpreter dispatches on, in handler table order.
+// CHAIN only appears in translated blocks, see BlockCache, and BREAKPOINT
+// only where a Debugger patched the text.
+#define MIPS_HANDLERS(X)                                                 \
+    X(ADD) X(ADDU) X(SUB) X(SUBU) X(MULT) X(MULTU) X(DIV) X(DIVU)        \
+    X(MFHI) X(MFLO) X(AND) X(OR) X(XOR) X(NOR) X(SLL) X(SRL) X(SRA)      \
+    X(SLT) X(SLTU) X(JR) X(SYSCALL) X(NOP)                               \
+    X(LW) X(SW) X(LB) X(SB) X(LBU) X(LH) X(SH) X(LUI)                    \
+    X(BEQ) X(BNE) X(BGTZ) X(BLTZ) X(J) X(JAL)                            \
+    X(ADDI) X(ADDIU) X(ANDI) X(ORI) X(XORI) X(SLTI) X(SLTIU)             \
+    X(HALT) X(BAD_TARGET) X(CHAIN) X(BREAKPOINT)
+
+enum class Handler : uint8_t
+{
+#define MIPS_HANDLER_ENUM(name) name,
+    MIPS_HANDLERS(MIPS_HANDLER_ENUM)
+#undef MIPS_HANDLER_ENUM
+};
+
+/**
+ * One predecoded instruction. Immediates are already sign or zero extended
+ * (lui is pre-shifted) and branch and jump targets are indices into the op
+ * array, so executing an op never looks at the machine word again.
+ */
+struct Op
+{
+    Handler handler;
+    uint8_t rd;
+    uint8_t rs;
+    uint8_t rt;
+    int32_t imm;
+};
+
+// Stop index of a run that ran its last block to the end, for the models
+// and the trace that hear where a run stopped
+inline constexpr uint32_t RUN_COMPLETE = 0xFFFFFFFF;
+
+// How many ops of the block of length ops at start ran before a run
+// stopped at op index stop (which ran), or all of them for RUN_COMPLETE
+inline uint32_t opsRan(uint32_t start, uint32_t length, uint32_t stop)
+{
+    if (stop == RUN_COMPLETE)
+    {
+        return length;
+    }
+    return stop < start ? 0 : stop - start + 1 < length ? stop - start + 1 : length;
+}
+
+#endif
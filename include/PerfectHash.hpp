@@ -0,0 +1,90 @@
+#ifndef PERFECTHASH_HPP
+#define PERFECTHASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// FNV-1a over the key, mixed with a seed picked at compile time
+constexpr uint32_t hashKey(std::string_view key, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : key)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/**
+ * Read-only table of entries with a string_view name. The seed is searched at
+ * compile time so every name lands in its own slot, and a lookup is one hash,
+ * one slot load and one compare with no allocation.
+ */
+template <typename T, std::size_t N, std::size_t SLOTS>
+class PerfectHashTable
+{
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "Slot count must be a power of two");
+    static_assert(N < SLOTS && N < 255, "Too many entries for the slot table");
+
+public:
+    constexpr PerfectHashTable(const std::array<T, N> &entries)
+        : entries(entries), seed(findSeed(entries)), slots{}
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            this->slots[hashKey(entries[i].name, this->seed) & (SLOTS - 1)] = static_cast<uint8_t>(i + 1);
+        }
+    }
+
+    // Returns the entry for key or nullptr
+    constexpr const T *find(std::string_view key) const
+    {
+        uint8_t slot = this->slots[hashKey(key, this->seed) & (SLOTS - 1)];
+        if (slot == 0 || this->entries[slot - 1].name != key)
+        {
+            return nullptr;
+        }
+        return &this->entries[slot - 1];
+    }
+
+    constexpr bool contains(std::string_view key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    constexpr const std::array<T, N> &all() const
+    {
+        return this->entries;
+    }
+
+private:
+    // Fails to compile (throw in a constant expression) if no seed is perfect
+    static constexpr uint32_t findSeed(const std::array<T, N> &entries)
+    {
+        for (uint32_t seed = 0; seed < 4096; ++seed)
+        {
+            std::array<bool, SLOTS> used{};
+            bool perfect = true;
+            for (std::size_t i = 0; i < N && perfect; ++i)
+            {
+                std::size_t slot = hashKey(entries[i].name, seed) & (SLOTS - 1);
+                perfect = !used[slot];
+                used[slot] = true;
+            }
+            if (perfect)
+            {
+                return seed;
+            }
+        }
+        throw "No perfect hash seed found";
+    }
+
+    std::array<T, N> entries;
+    uint32_t seed;
+    std::array<uint8_t, SLOTS> slots;
+};
+
+#endif
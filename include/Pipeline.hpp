@@ -0,0 +1,164 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "Op.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+class MIPS;
+
+/**
+ * Cycle-approximate timing of the classic IF/ID/EX/MEM/WB pipeline with
+ * full forwarding, branches and jumps resolved in ID and fetch predicting
+ * not taken. Instead of moving instructions through stage objects it keeps
+ * a scoreboard of the last three instructions placed, the only ones close
+ * enough to stall or forward to the next, and of when HI and LO are ready,
+ * so placing an instruction in its EX cycle takes a few compares.
+ *
+ * The CPU only reports the blocks it enters. A block is placed once it is
+ * known how far it ran, and since the scoreboard on entry decides
+ * everything about it, the result is kept per entry state: a block entered
+ * the way it was before adds its earlier result instead of being placed
+ * again. Counts are indexed like the predecoded text and accumulate over
+ * runs as if they ran back to back.
+ */
+class Pipeline
+{
+public:
+    enum Stall : uint8_t
+    {
+        // A result needed in EX right after the load producing it
+        LOAD_USE,
+        // A branch or jr waiting in ID for an operand not yet forwardable
+        BRANCH_DATA,
+        // mfhi, mflo or another mult or div waiting for the multiplier
+        HILO,
+        // The fetch thrown away after a taken branch or a jump
+        CONTROL,
+        STALL_KINDS
+    };
+    enum Path : uint8_t
+    {
+        // Operand taken from the EX/MEM latch into EX
+        EX_MEM,
+        // Operand taken from the MEM/WB latch into EX
+        MEM_WB,
+        // Operand forwarded into ID for a branch or jr
+        TO_ID,
+        PATHS,
+        // Read from the register file, not counted
+        NONE = PATHS
+    };
+    // Cycles from EX until HI and LO hold the result, as on the R3000
+    static constexpr uint32_t MULT_LATENCY = 12;
+    static constexpr uint32_t DIV_LATENCY = 35;
+
+    explicit Pipeline(const std::vector<Op> &ops);
+
+    // The block at start runs, instructions long unless the run stops inside it
+    void enter(uint32_t start, uint32_t instructions)
+    {
+        place(this->pendingStart, this->pendingLength);
+        this->pendingStart = start;
+        this->pendingLength = instructions;
+    }
+    // Ends a run that stopped at op index stop (which ran), or RUN_COMPLETE
+    void stop(uint32_t stop);
+
+    uint64_t instructions() const;
+    // Cycles from the first fetch to the last write back
+    uint64_t cycles() const;
+    uint64_t stalls(Stall kind) const;
+    uint64_t forwards(Path path) const;
+    // Totals, the forwarding paths used and cycles, CPI and stalls per text
+    // label, most cycles first
+    void report(std::ostream &out, const MIPS &program, std::size_t hottest = 20) const;
+    void clear();
+
+private:
+    enum Kind : uint8_t
+    {
+        ALU,
+        LOAD,
+        STORE,
+        BRANCH,
+        JUMP,
+        JUMP_REGISTER,
+        // Kinds from here on use the multiplier
+        MULT,
+        DIV,
+        MOVE_FROM_HILO
+    };
+    // What the scoreboard needs to know about one instruction
+    struct Timing
+    {
+        Kind kind;
+        // Registers read, $zero when unused, and cycles after (or before)
+        // EX they are needed: +1 for ID, -1 for store data needed in MEM
+        std::array<uint8_t, 2> sources;
+        std::array<int8_t, 2> adjust;
+        // Register written, NO_REGISTER when none
+        uint8_t destination;
+        // Forwarding path of each source by distance in cycles from its producer's EX
+        std::array<std::array<uint8_t, 4>, 2> paths;
+    };
+    struct Counters
+    {
+        std::array<uint64_t, STALL_KINDS> stalls{};
+        // Operands of each source by forwarding path, each row sums to the executions
+        std::array<std::array<uint64_t, PATHS + 1>, 2> forwards{};
+    };
+    // An instruction in the scoreboard window
+    struct Placed
+    {
+        int64_t ex;
+        uint8_t destination;
+        // Cycles after EX until the result can be forwarded
+        uint8_t latency;
+    };
+    // How a block ran from one entry state, with EX cycles relative to its first
+    struct Result
+    {
+        uint64_t state;
+        uint32_t length;
+        int64_t cycles;
+        std::array<Placed, 3> window;
+        bool setsHilo;
+        int64_t hiloReady;
+        // Entries since the counts were last added to the totals
+        uint64_t pending;
+        std::vector<Counters> counts;
+    };
+    // Destination of instructions writing no register, which no source matches
+    static constexpr uint8_t NO_REGISTER = 32;
+    // Entry states remembered per block, blocks entered in more are placed every time
+    static constexpr std::size_t MAX_RESULTS = 16;
+
+    // Places length instructions from start after the ones placed before
+    void place(uint32_t start, uint32_t length);
+    // The scoreboard proper, counting into counts[0, length)
+    void score(uint32_t start, uint32_t length, int64_t ex, Counters *counts);
+    // The window and multiplier relative to ex, packed
+    uint64_t stateAt(int64_t ex) const;
+    // Adds the results entered since the last call to the totals
+    void fold();
+
+    std::vector<Timing> timings;
+    // One more than the text, the slot of the fetch before the first instruction
+    std::vector<Counters> counters;
+    std::vector<std::vector<Result>> results;
+    // Newest first
+    std::array<Placed, 3> window;
+    int64_t hiloReady;
+    int64_t lastEx;
+    uint32_t lastIndex;
+    // Block entered last, placed once the next is entered or the run stops
+    uint32_t pendingStart;
+    uint32_t pendingLength;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+class MIPS;
+
+/**
+ * Execution counts per instruction, indexed like the predecoded text by
+ * (pc - PC_START) / 4, and how often each branch was taken. The CPU only
+ * counts in its profiling run loop, so a CPU without a profiler pays
+ * nothing for it.
+ */
+class Profiler
+{
+public:
+    // Counters for a text of instructions ops, plus the HALT and BAD_TARGET ops
+    explicit Profiler(std::size_t instructions);
+
+    void hit(uint32_t index)
+    {
+        ++this->counts[index];
+    }
+    void taken(uint32_t index)
+    {
+        ++this->takenCounts[index];
+    }
+    uint64_t executed(uint32_t index) const;
+    uint64_t branchesTaken(uint32_t index) const;
+    uint64_t total() const;
+    // Time per function label, the loops that ran most and the hottest
+    // instructions with their source, hottest of each list first
+    void report(std::ostream &out, const MIPS &program, std::size_t hottest = 10) const;
+    void clear();
+
+private:
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> takenCounts;
+};
+
+#endif
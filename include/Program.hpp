@@ -0,0 +1,34 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "Op.hpp"
+#include <cstdint>
+#include <vector>
+
+class MIPS;
+
+/**
+ * What a CPU starts from, taken out of an assembled program once: the
+ * predecoded text, the memory images and the entry point. It is never
+ * changed afterwards, so any number of CPUs on any threads can share one.
+ */
+class Program
+{
+public:
+    explicit Program(const MIPS &assembled);
+
+    // Predecoded text followed by HALT and BAD_TARGET, see CPU::predecode
+    std::vector<Op> ops;
+    // Op indices of the text labels, the block leaders the source marks
+    std::vector<uint32_t> labels;
+    // Machine words of the text, big-endian from PC_START
+    std::vector<uint8_t> text;
+    // Initial static data from DATA_START
+    std::vector<uint8_t> data;
+    // Address of the global entry label, or PC_START
+    uint32_t entry;
+    // First page past the static data, where the heap starts
+    uint32_t dataEnd;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PROGRAMCACHE_HPP
+#define PROGRAMCACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class MIPS;
+
+// Part of every cache key, bump it whenever encodings or the entry layout change
+static constexpr std::string_view ASSEMBLER_VERSION = "mips-assembler 1.0, cache format 1";
+
+/**
+ * Assembled programs on disk, one file per source keyed by a hash of the
+ * assembler version, the segment addresses and the source text. An entry
+ * holds everything MIPS keeps: text words, source lines, the data image,
+ * both symbol tables and the .globl name.
+ *
+ * Entries carry their key and a checksum of their contents, anything that
+ * does not match is treated as a miss and assembled again.
+ */
+class ProgramCache
+{
+public:
+    ProgramCache(const std::string &directory);
+    // Key for a source text under the running assembler
+    static uint64_t keyFor(std::string_view source);
+    // Fills mips from the entry for key, false if it is missing, stale or corrupt
+    bool load(uint64_t key, MIPS &mips) const;
+    // Writes the entry for key, a failure only costs a later miss
+    void store(uint64_t key, const MIPS &mips) const;
+
+private:
+    std::string pathFor(uint64_t key) const;
+    std::string directory;
+};
+
+#endif
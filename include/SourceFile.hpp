@@ -0,0 +1,60 @@
+#ifndef SOURCEFILE_HPP
+#define SOURCEFILE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Assembly source handed out one line at a time. Regular files are mapped
+ * into memory and lines are views straight into the mapping, so the bytes are
+ * backed by the page cache rather than the heap. Pipes, terminals and stdin
+ * ("-") cannot be mapped and are read in large chunks instead.
+ *
+ * Every line returned stays valid for the lifetime of the SourceFile. The
+ * parser keeps views of text lines and symbols, so streamed input is held
+ * in full until the SourceFile goes: reading a pipe saves the copy into a
+ * std::string, not memory proportional to the input.
+ */
+class SourceFile
+{
+public:
+    // "-" reads standard input
+    SourceFile(const std::string &path);
+    ~SourceFile();
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    // Next line without its '\n', returns false at the end of the input
+    bool nextLine(std::string_view &line);
+    // True when the input was mapped rather than streamed
+    bool isMapped() const;
+    // Whole mapped file, empty for streamed input
+    std::string_view contents() const;
+
+private:
+    // Reading more of a stream, returns false once nothing is left
+    bool refill();
+
+    // Mapped input
+    void *mapping;
+    std::size_t mappedSize;
+    std::size_t pos;
+
+    // Streamed input, chunks are never moved or freed once lines point into them
+    int fd;
+    bool ownsFd;
+    bool eof;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::size_t chunkSize;
+    // Start of the line being read, end of the bytes read so far and where the
+    // search for '\n' resumes, all within the last chunk
+    char *lineStart;
+    char *filled;
+    char *scan;
+    static constexpr std::size_t CHUNK_SIZE = 1 << 20;
+};
+
+#endif
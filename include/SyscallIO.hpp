@@ -0,0 +1,58 @@
+#ifndef SYSCALLIO_HPP
+#define SYSCALLIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * Console behind the print and read syscalls. Output collects in one large
+ * buffer that goes to the stream only when it fills, before an input
+ * syscall (so prompts show up) and when the program stops, so printing a
+ * character costs a store rather than a write(2). Input is parsed straight
+ * from the stream's own buffer. Unbuffered mode flushes after every print
+ * and produces the same bytes.
+ */
+class SyscallIO
+{
+public:
+    static constexpr std::size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+    SyscallIO(std::istream &in, std::ostream &out);
+    ~SyscallIO();
+    SyscallIO(const SyscallIO &) = delete;
+    SyscallIO &operator=(const SyscallIO &) = delete;
+
+    void printInt(int32_t value);
+    void printString(std::string_view text);
+    void printChar(char c);
+    // Syscall 5, false when the input holds no integer
+    bool readInt(int32_t &value);
+    // Syscall 8, the rest of the line including its newline if it had one
+    std::string readLine();
+    // Syscall 12, EOF at the end of the input
+    int readChar();
+
+    // Hands buffered output to the stream and flushes it
+    void flush();
+    void setBuffered(bool buffered);
+    // Bytes printed and how many times they were handed to the stream
+    uint64_t bytesWritten() const;
+    uint64_t flushCount() const;
+
+private:
+    void append(const char *data, std::size_t size);
+
+    std::streambuf *input;
+    std::ostream &out;
+    std::unique_ptr<char[]> buffer;
+    std::size_t used;
+    bool buffered;
+    uint64_t written;
+    uint64_t flushes;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TEXTLABELS_HPP
+#define TEXTLABELS_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MIPS;
+
+/**
+ * The text labels of a program by op index, for the reports that group
+ * instructions per label. Each instruction belongs to the closest label at
+ * or before it, and instructions before the first label to "(start)".
+ * Names point into the program's label table.
+ */
+class TextLabels
+{
+public:
+    // A label and the ops [start, end) that belong to it
+    struct Range
+    {
+        std::string_view name;
+        uint32_t start;
+        uint32_t end;
+    };
+
+    // Labels of program within its first count ops
+    TextLabels(const MIPS &program, uint32_t count);
+
+    // Every label in text order, a label sharing its index with a later one covers nothing
+    const std::vector<Range> &ranges() const;
+    // "loop" at a label, "loop+8" two instructions after it
+    std::string nameOf(uint32_t index) const;
+
+private:
+    std::vector<Range> labels;
+};
+
+#endif
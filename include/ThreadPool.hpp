@@ -0,0 +1,46 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads fed from one queue. Work is handed out as
+ * indices so callers split their data however suits them.
+ */
+class ThreadPool
+{
+public:
+    // 0 uses one thread per hardware thread
+    ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Runs task(i) for every i in [0, count), the caller helps, returns once all are done.
+    // If tasks throw, the exception from the lowest index is rethrown.
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)> &task);
+    // Same contract, but every thread starts on its own contiguous share of the
+    // indices and steals half of the largest remaining share once its own is
+    // done. task gets the index and the thread's slot in [0, size()), the
+    // caller being 0, so callers can keep state per thread.
+    void stealingFor(std::size_t count, const std::function<void(std::size_t, unsigned)> &task);
+    // Number of threads working on a parallelFor including the caller
+    unsigned size() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping;
+};
+
+#endif
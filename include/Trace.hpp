@@ -0,0 +1,183 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "Op.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TraceWriter;
+
+/**
+ * What the running CPU hands over: the blocks it enters and the addresses
+ * its loads and stores use. Everything else about an instruction follows
+ * from the text, which the writer thread has, so the CPU stores one entry
+ * per block and one per memory access and does nothing else.
+ */
+struct TraceEntry
+{
+    // Op index of a block start, MEMORY for an access or END for the end of a run
+    uint32_t tag;
+    // Instructions in the block, the address, or the op index the run stopped at
+    uint32_t value;
+};
+
+/**
+ * One CPU's side of a trace: a lock-free single-producer ring of entry
+ * chunks. The CPU fills the chunk at the head and publishes it when full,
+ * the writer thread consumes chunks at the tail. A full ring makes the CPU
+ * wait, so nothing is ever dropped.
+ */
+class TraceStream
+{
+public:
+    static constexpr std::size_t CHUNK_ENTRIES = 1 << 15;
+    static constexpr std::size_t RING_CHUNKS = 8;
+    static constexpr uint32_t MEMORY = 0xFFFFFFFE;
+    static constexpr uint32_t END = 0xFFFFFFFF;
+    // Set in a destination byte when the instruction accesses memory
+    static constexpr uint8_t ACCESSES_MEMORY = 0x80;
+
+    // words is the text, destinations the register each instruction writes
+    // (0 for none) with ACCESSES_MEMORY added for loads and stores
+    TraceStream(uint32_t id, std::vector<uint32_t> words, std::vector<uint8_t> destinations);
+
+    // The block at start runs, instructions long unless the run stops inside it
+    void block(uint32_t start, uint32_t instructions)
+    {
+        push({start, instructions});
+    }
+    // The next load or store of the block uses address
+    void memory(uint32_t address)
+    {
+        push({MEMORY, address});
+    }
+    // Closes a run that stopped at op index stop, or RUN_COMPLETE, and publishes the partial chunk
+    void finish(uint32_t stop);
+
+private:
+    friend class TraceWriter;
+
+    void push(TraceEntry entry)
+    {
+        *this->cursor++ = entry;
+        if (this->cursor == this->limit)
+        {
+            publish();
+        }
+    }
+    void publish();
+    TraceEntry *chunk(uint64_t sequence);
+
+    const uint32_t id;
+    const std::vector<uint32_t> words;
+    const std::vector<uint8_t> destinations;
+    std::unique_ptr<TraceEntry[]> entries;
+    std::size_t counts[RING_CHUNKS];
+    // Chunks published and consumed so far, apart so the two sides do not share a line
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) TraceEntry *cursor;
+    TraceEntry *limit;
+    // Set by the writer, woken when a chunk is published
+    TraceWriter *writer;
+};
+
+/**
+ * Drains the streams of any number of CPUs into one file on a background
+ * thread. Every chunk becomes a block of delta-encoded records, compressed
+ * and tagged with its stream, so blocks decode on their own. See
+ * TraceReader for the format.
+ */
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const std::string &path);
+    ~TraceWriter();
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    // A new stream for a CPU running the given text, see TraceStream
+    std::shared_ptr<TraceStream> open(std::vector<uint32_t> words, std::vector<uint8_t> destinations);
+    // Writes out whatever the streams still hold and stops the thread, streams must be idle
+    void close();
+    uint64_t records() const;
+    uint64_t bytesWritten() const;
+
+private:
+    friend class TraceStream;
+
+    void wake();
+    void writerLoop();
+    // Encodes and writes every published chunk of stream, false when there were none
+    bool drain(TraceStream &stream);
+
+    std::ofstream out;
+    std::vector<std::shared_ptr<TraceStream>> streams;
+    // Per stream: the block waiting for where it stopped, and whether the stream was declared
+    struct StreamState;
+    std::vector<std::unique_ptr<StreamState>> states;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping;
+    bool signalled;
+    std::atomic<uint64_t> recordCount;
+    std::atomic<uint64_t> written;
+    std::thread thread;
+};
+
+// One decoded instruction of a trace
+struct TraceRecord
+{
+    uint32_t stream;
+    uint32_t pc;
+    uint32_t word;
+    // Register written, 0 when the instruction writes none
+    uint8_t reg;
+    bool memory;
+    uint32_t address;
+};
+
+/**
+ * Reads a trace back. The file starts with "MIPSTRC1", then holds
+ * blocks of a one-byte kind, the stream id and the payload:
+ *  'S' declares a stream: text size, then each text word and its
+ *      destination byte (see TraceStream)
+ *  'B' holds records: record count, raw and compressed size, then the
+ *      compressed bytes
+ * Each raw record is one run through a basic block: a varint of the
+ * zigzagged distance, in words, from where the previous record ended to
+ * its first instruction (0 when execution ran straight on), the number of
+ * instructions, then for each load or store among them the zigzagged change
+ * of the address. Positions and the last address start at zero in every
+ * block of the file.
+ */
+class TraceReader
+{
+public:
+    explicit TraceReader(const std::string &path);
+    // The next record, false at the end of the trace
+    bool next(TraceRecord &record);
+
+private:
+    bool readBlock();
+
+    struct Text
+    {
+        std::vector<uint32_t> words;
+        std::vector<uint8_t> destinations;
+    };
+    std::ifstream in;
+    std::vector<Text> texts;
+    std::vector<TraceRecord> records;
+    std::size_t position;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "BatchRunner.hpp"
+#include "CPU.hpp"
+#include <exception>
+#include <sstream>
+
+// A thread's machine, its console streams and the state it starts every run from
+struct BatchRunner::Worker
+{
+    std::istringstream in;
+    std::ostringstream out;
+    std::unique_ptr<CPU> cpu;
+    CPU::Snapshot start;
+};
+
+BatchRunner::BatchRunner(const Program &program, unsigned threads)
+    : program(program), pool(threads), jit(false)
+{
+    this->workers.resize(this->pool.size());
+}
+
+BatchRunner::~BatchRunner()
+{
+}
+
+bool BatchRunner::enableJit()
+{
+    this->jit = MIPS_JIT_SUPPORTED;
+    return this->jit;
+}
+
+unsigned BatchRunner::threads() const
+{
+    return this->pool.size();
+}
+
+/**
+ * CPUs are built on first use by the thread that owns them. Every run
+ * after that restores the snapshot taken right after construction.
+ */
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob> &jobs)
+{
+    std::vector<BatchResult> results(jobs.size());
+    auto runJob = [&](std::size_t index, unsigned slot)
+    {
+        std::unique_ptr<Worker> &worker = this->workers[slot];
+        if (worker == nullptr)
+        {
+            worker = std::make_unique<Worker>();
+            worker->cpu = std::make_unique<CPU>(this->program, worker->in, worker->out);
+            if (this->jit)
+            {
+                worker->cpu->enableJit();
+            }
+            worker->start = worker->cpu->snapshot();
+        }
+        else
+        {
+            worker->cpu->restore(worker->start);
+        }
+        const BatchJob &job = jobs[index];
+        BatchResult &result = results[index];
+        CPU &cpu = *worker->cpu;
+        worker->in.clear();
+        worker->in.str(job.input);
+        worker->out.str("");
+        cpu.setBudget(job.budget);
+        try
+        {
+            result.exitCode = cpu.run();
+        }
+        catch (const BudgetExhausted &error)
+        {
+            result.status = BatchResult::Status::OUT_OF_BUDGET;
+            result.error = error.what();
+        }
+        catch (const std::exception &error)
+        {
+            result.status = BatchResult::Status::FAILED;
+            result.error = error.what();
+        }
+        result.executed = cpu.executed;
+        result.output = worker->out.str();
+    };
+    this->pool.stealingFor(jobs.size(), runJob);
+    return results;
+}
@@ -0,0 +1,169 @@
+#include "BlockCache.hpp"
+#include <utility>
+
+bool isControlTransfer(Handler handler)
+{
+    switch (handler)
+    {
+    case Handler::BEQ:
+    case Handler::BNE:
+    case Handler::BGTZ:
+    case Handler::BLTZ:
+    case Handler::J:
+    case Handler::JAL:
+    case Handler::JR:
+    case Handler::HALT:
+    case Handler::BAD_TARGET:
+    case Handler::CHAIN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+double BlockStats::chainHitRate() const
+{
+    uint64_t transfers = this->chainHits + this->chainMisses;
+    return transfers == 0 ? 0.0 : static_cast<double>(this->chainHits) / static_cast<double>(transfers);
+}
+
+/**
+ * The last two ops are HALT and BAD_TARGET, which are leaders of their own
+ * one-op blocks so branches out of the text link to them like any other block
+ */
+BlockCache::BlockCache(std::vector<Op> ops, const std::vector<uint32_t> &labelIndices)
+    : ops(std::move(ops)), chainHits(0), chainMisses(0)
+{
+    const std::size_t count = this->ops.size();
+    this->leaders.assign(count, false);
+    this->transfers.assign(count, false);
+    this->blockAt.assign(count, nullptr);
+    this->leaders[0] = true;
+    for (uint32_t index : labelIndices)
+    {
+        if (index < count)
+        {
+            this->leaders[index] = true;
+        }
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Handler handler = this->ops[i].handler;
+        if (!isControlTransfer(handler))
+        {
+            continue;
+        }
+        this->transfers[i] = true;
+        if (i + 1 < count)
+        {
+            this->leaders[i + 1] = true;
+        }
+        if (handler != Handler::JR && handler != Handler::HALT && handler != Handler::BAD_TARGET)
+        {
+            this->leaders[static_cast<uint32_t>(this->ops[i].imm)] = true;
+        }
+    }
+}
+
+Block *BlockCache::lookup(uint32_t index)
+{
+    Block *block = this->blockAt[index];
+    return block != nullptr ? block : translate(index);
+}
+
+Block *BlockCache::link(Block *from, int slot, uint32_t index)
+{
+    ++this->chainMisses;
+    Block *next = lookup(index);
+    from->next[slot] = next;
+    return next;
+}
+
+/**
+ * Compiled code only reports where it is going. Taken and fall-through
+ * targets go through the links, an early exit in the middle of the block
+ * (a syscall or a trap) is looked up without linking.
+ */
+Block *BlockCache::successor(Block *from, uint32_t index)
+{
+    const Op &last = from->ops.back();
+    if (last.handler == Handler::JR)
+    {
+        return followIndirect(from, index);
+    }
+    if (index == from->end)
+    {
+        return follow(from, Block::FALLTHROUGH, index);
+    }
+    if (isControlTransfer(last.handler) && static_cast<uint32_t>(last.imm) == index)
+    {
+        return follow(from, Block::TAKEN, index);
+    }
+    return lookup(index);
+}
+
+Block *BlockCache::translate(uint32_t index)
+{
+    auto block = std::make_unique<Block>();
+    block->start = index;
+    block->entries = 0;
+    block->next[Block::FALLTHROUGH] = nullptr;
+    block->next[Block::TAKEN] = nullptr;
+    block->native = nullptr;
+    block->nativeTried = false;
+    uint32_t i = index;
+    while (true)
+    {
+        block->ops.push_back(this->ops[i]);
+        if (this->transfers[i++])
+        {
+            break;
+        }
+        if (this->leaders[i])
+        {
+            block->ops.push_back({Handler::CHAIN, 0, 0, 0, static_cast<int32_t>(i)});
+            break;
+        }
+    }
+    block->end = i;
+    // HALT, BAD_TARGET and CHAIN are not instructions of the program
+    Handler last = block->ops.back().handler;
+    bool synthetic = last == Handler::HALT || last == Handler::BAD_TARGET || last == Handler::CHAIN;
+    block->instructions = static_cast<uint32_t>(block->ops.size()) - (synthetic ? 1 : 0);
+    block->ops.shrink_to_fit();
+
+    Block *raw = block.get();
+    this->blocks.push_back(std::move(block));
+    this->blockAt[index] = raw;
+    return raw;
+}
+
+BlockStats BlockCache::stats() const
+{
+    std::size_t instructions = 0;
+    for (const auto &block : this->blocks)
+    {
+        instructions += block->instructions;
+    }
+    double average = this->blocks.empty() ? 0.0 : static_cast<double>(instructions) / static_cast<double>(this->blocks.size());
+    return {this->blocks.size(), average, this->chainHits, this->chainMisses};
+}
+
+const std::vector<Op> &BlockCache::source() const
+{
+    return this->ops;
+}
+
+Op BlockCache::patch(uint32_t index, const Op &op)
+{
+    Op replaced = this->ops[index];
+    this->ops[index] = op;
+    for (const auto &block : this->blocks)
+    {
+        if (index >= block->start && index < block->end)
+        {
+            block->ops[index - block->start] = op;
+        }
+    }
+    return replaced;
+}
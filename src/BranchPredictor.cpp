@@ -0,0 +1,202 @@
+#include "BranchPredictor.hpp"
+#include "MIPS.hpp"
+#include "CPU.hpp"
+#include "TextLabels.hpp"
+#include "Helpers.hpp"
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+
+// The link register, jr through it is a return
+static constexpr uint8_t RA = 31;
+
+PredictorConfig PredictorConfig::parse(std::string_view spec)
+{
+    const std::vector<std::string_view> fields = splitFields(spec);
+    if (fields.size() > 3)
+    {
+        throw std::runtime_error(std::format("Predictor spec must be kind[,table bits[,stack depth]], got \"{}\"", spec));
+    }
+    PredictorConfig config;
+    if (fields[0] == "static")
+    {
+        config.kind = PredictorKind::STATIC;
+    }
+    else if (fields[0] == "bimodal")
+    {
+        config.kind = PredictorKind::BIMODAL;
+    }
+    else if (fields[0] == "gshare")
+    {
+        config.kind = PredictorKind::GSHARE;
+    }
+    else
+    {
+        throw std::runtime_error(std::format("Unknown branch predictor \"{}\"", fields[0]));
+    }
+    auto number = [](std::string_view field, uint32_t limit)
+    {
+        uint32_t value = 0;
+        auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+        if (error != std::errc() || end != field.data() + field.size() || value > limit)
+        {
+            throw std::runtime_error(std::format("Invalid predictor size \"{}\"", field));
+        }
+        return value;
+    };
+    // Table bits past 20 would reach into the PC_START bits of the index
+    if (fields.size() > 1)
+    {
+        config.tableBits = number(fields[1], 20);
+    }
+    if (fields.size() > 2)
+    {
+        config.stackDepth = number(fields[2], 1 << 16);
+    }
+    return config;
+}
+
+std::string PredictorConfig::describe() const
+{
+    std::string stack = this->stackDepth == 0 ? "no return stack" : std::format("{}-entry return stack", this->stackDepth);
+    switch (this->kind)
+    {
+    case PredictorKind::STATIC:
+        return std::format("static backward taken, {}", stack);
+    case PredictorKind::BIMODAL:
+        return std::format("bimodal, {} entries, {}", 1u << this->tableBits, stack);
+    default:
+        return std::format("gshare, {} entries, {} history bits, {}", 1u << this->tableBits, this->tableBits, stack);
+    }
+}
+
+BranchPredictor::BranchPredictor(const std::vector<Op> &ops, const PredictorConfig &config)
+    : settings(config), mask((1u << config.tableBits) - 1), table(std::size_t{1} << config.tableBits), backward(ops.size() - 2),
+      stack(config.stackDepth), counters(ops.size() - 2)
+{
+    for (std::size_t i = 0; i < this->backward.size(); ++i)
+    {
+        const Op &op = ops[i];
+        bool conditional = op.handler == Handler::BEQ || op.handler == Handler::BNE || op.handler == Handler::BGTZ || op.handler == Handler::BLTZ;
+        this->backward[i] = conditional && static_cast<uint32_t>(op.imm) <= i;
+    }
+    clear();
+}
+
+const PredictorConfig &BranchPredictor::config() const
+{
+    return this->settings;
+}
+
+uint64_t BranchPredictor::executed(uint32_t index) const
+{
+    return this->counters[index].executed;
+}
+
+uint64_t BranchPredictor::mispredicted(uint32_t index) const
+{
+    return this->counters[index].mispredicted;
+}
+
+// Counters start weakly taken, so a loop branch is right from its second iteration
+void BranchPredictor::clear()
+{
+    std::fill(this->table.begin(), this->table.end(), 2);
+    this->history = 0;
+    std::fill(this->stack.begin(), this->stack.end(), 0);
+    this->top = 0;
+    this->depth = 0;
+    std::fill(this->counters.begin(), this->counters.end(), Counters{});
+}
+
+/**
+ * Prints the accuracy of the run, the most mispredicted branches and one row
+ * per label. Returns are counted apart from conditional branches, since the
+ * return stack predicts them rather than the counter table
+ */
+void BranchPredictor::report(std::ostream &out, const MIPS &program, std::size_t hottest) const
+{
+    const uint32_t count = static_cast<uint32_t>(this->counters.size());
+    const std::vector<Op> ops = CPU::predecode(program.instructions);
+    auto isReturn = [&ops](uint32_t index)
+    {
+        return ops[index].handler == Handler::JR && ops[index].rs == RA;
+    };
+    auto accuracy = [](uint64_t missed, uint64_t all)
+    {
+        return all == 0 ? 100.0 : 100.0 * static_cast<double>(all - missed) / static_cast<double>(all);
+    };
+
+    uint64_t branches = 0;
+    uint64_t branchMisses = 0;
+    uint64_t returns = 0;
+    uint64_t returnMisses = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const Counters &c = this->counters[i];
+        (isReturn(i) ? returns : branches) += c.executed;
+        (isReturn(i) ? returnMisses : branchMisses) += c.mispredicted;
+    }
+    out << std::format("predictor: {}\n", this->settings.describe());
+    out << std::format("branches:  {} conditional, {} mispredicted, accuracy {:.2f}%\n", branches, branchMisses, accuracy(branchMisses, branches));
+    out << std::format("returns:   {} jr $ra, {} mispredicted, accuracy {:.2f}%\n", returns, returnMisses, accuracy(returnMisses, returns));
+
+    const TextLabels labels(program, count);
+
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (this->counters[i].executed > 0)
+        {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+                     { return this->counters[a].mispredicted > this->counters[b].mispredicted; });
+    out << "most mispredicted:\n";
+    for (std::size_t h = 0; h < std::min(hottest, order.size()); ++h)
+    {
+        uint32_t i = order[h];
+        const Counters &c = this->counters[i];
+        const Instruction &instr = program.instructions[i];
+        out << std::format("  0x{:08x} {:<20} {:>14} {:>7.2f}% taken {:>12} mispredicted {:>7.2f}% accurate  {}\n", instr.address, labels.nameOf(i), c.executed,
+                           100.0 * static_cast<double>(c.taken) / static_cast<double>(c.executed), c.mispredicted,
+                           accuracy(c.mispredicted, c.executed), program.textLines[instr.line]);
+    }
+
+    out << std::format("  {:<24} {:>14} {:>12} {:>9} {:>14} {:>12} {:>9}\n", "label", "branches", "mispredicted", "accuracy", "returns",
+                       "mispredicted", "accuracy");
+    struct Row
+    {
+        std::string_view name;
+        uint64_t branches = 0;
+        uint64_t branchMisses = 0;
+        uint64_t returns = 0;
+        uint64_t returnMisses = 0;
+    };
+    std::vector<Row> rows;
+    for (const TextLabels::Range &label : labels.ranges())
+    {
+        Row row;
+        row.name = label.name;
+        for (uint32_t i = label.start; i < label.end; ++i)
+        {
+            const Counters &c = this->counters[i];
+            (isReturn(i) ? row.returns : row.branches) += c.executed;
+            (isReturn(i) ? row.returnMisses : row.branchMisses) += c.mispredicted;
+        }
+        if (row.branches + row.returns > 0)
+        {
+            rows.push_back(row);
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b)
+                     { return a.branchMisses + a.returnMisses > b.branchMisses + b.returnMisses; });
+    for (std::size_t r = 0; r < std::min(hottest, rows.size()); ++r)
+    {
+        const Row &row = rows[r];
+        out << std::format("  {:<24} {:>14} {:>12} {:>8.2f}% {:>14} {:>12} {:>8.2f}%\n", row.name, row.branches, row.branchMisses,
+                           accuracy(row.branchMisses, row.branches), row.returns, row.returnMisses, accuracy(row.returnMisses, row.returns));
+    }
+}
@@ -0,0 +1,1203 @@
+#include "CPU.hpp"
+#include "MIPS.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Computed goto where the compiler has it, a plain switch everywhere else
+#if defined(__GNUC__) || defined(__clang__)
+#define MIPS_COMPUTED_GOTO 1
+#else
+#define MIPS_COMPUTED_GOTO 0
+#endif
+
+// Marks a label only some instances of the run loop jump to
+#if defined(__GNUC__) || defined(__clang__)
+#define MIPS_MAYBE_UNUSED_LABEL __attribute__((unused))
+#else
+#define MIPS_MAYBE_UNUSED_LABEL
+#endif
+
+// Stack region below 0x80000000, pages are only allocated as it grows into them
+static constexpr uint32_t STACK_SEGMENT_SIZE = 0x800000;
+// Register numbers used by syscalls and calls
+static constexpr uint8_t V0 = 2;
+static constexpr uint8_t A0 = 4;
+static constexpr uint8_t A1 = 5;
+static constexpr uint8_t GP = 28;
+static constexpr uint8_t SP = 29;
+static constexpr uint8_t RA = 31;
+
+// Signed add and subtract that report overflow instead of wrapping, as add and sub trap
+static bool addOverflows(int32_t a, int32_t b, int32_t &result)
+{
+    int64_t wide = static_cast<int64_t>(a) + b;
+    result = static_cast<int32_t>(wide);
+    return wide != result;
+}
+
+static bool subOverflows(int32_t a, int32_t b, int32_t &result)
+{
+    int64_t wide = static_cast<int64_t>(a) - b;
+    result = static_cast<int32_t>(wide);
+    return wide != result;
+}
+
+CPU::CPU(const MIPS &program, std::istream &in, std::ostream &out)
+    : CPU(Program(program), in, out)
+{
+}
+
+CPU::CPU(const Program &program, std::istream &in, std::ostream &out)
+    : regs{}, hi(0), lo(0), pc(program.entry), executed(0),
+      blocks(program.ops, program.labels), debugger(nullptr), dynamicOnly(false), jitExecuted(0), jitLimit(0), budget(std::numeric_limits<uint64_t>::max()),
+      heap(memory, program.dataEnd, 0x80000000 - STACK_SEGMENT_SIZE), io(in, out)
+{
+    // Text is readable as machine words, static data reaches down to what $gp can address
+    this->memory.map(PC_START, static_cast<uint32_t>(program.text.size()), DataSegment::READ | DataSegment::EXECUTE);
+    this->memory.load(PC_START, program.text);
+    uint32_t dataBase = std::min(DATA_START, GLOBAL_POINTER - 0x8000);
+    this->memory.map(dataBase, program.dataEnd - dataBase, DataSegment::READ | DataSegment::WRITE);
+    this->memory.load(DATA_START, program.data);
+    this->memory.map(0x80000000 - STACK_SEGMENT_SIZE, STACK_SEGMENT_SIZE, DataSegment::READ | DataSegment::WRITE);
+    this->regs[SP] = STACK_START;
+    this->regs[GP] = GLOBAL_POINTER;
+}
+
+/**
+ * Registers written by an op whose destination is $zero turn it into a NOP,
+ * so handlers never have to protect $zero themselves. Loads keep their
+ * access (it can fault) and clear $zero afterwards.
+ */
+std::vector<Op> CPU::predecode(const std::vector<Instruction> &instructions)
+{
+    const int64_t count = static_cast<int64_t>(instructions.size());
+    std::vector<Op> ops(instructions.size() + 2);
+    ops[count] = {Handler::HALT, 0, 0, 0, 0};
+    ops[count + 1] = {Handler::BAD_TARGET, 0, 0, 0, 0};
+    // Index of a target address, or of BAD_TARGET when it is outside the text
+    auto indexOf = [count](int64_t index)
+    {
+        return static_cast<int32_t>(index < 0 || index > count ? count + 1 : index);
+    };
+
+    for (int64_t i = 0; i < count; ++i)
+    {
+        const uint32_t machine = instructions[i].machine;
+        const uint8_t opcode = static_cast<uint8_t>(machine >> 26);
+        const uint8_t rs = (machine >> 21) & 0x1F;
+        const uint8_t rt = (machine >> 16) & 0x1F;
+        const uint8_t rd = (machine >> 11) & 0x1F;
+        const int32_t simm = static_cast<int16_t>(machine & 0xFFFF);
+        const int32_t uimm = static_cast<int32_t>(machine & 0xFFFF);
+        Op op{Handler::NOP, rd, rs, rt, 0};
+        bool writesRd = false;
+        bool writesRt = false;
+
+        if (opcode == 0)
+        {
+            op.imm = (machine >> 6) & 0x1F;
+            writesRd = true;
+            switch (machine & 0x3F)
+            {
+            case 0b100000: op.handler = Handler::ADD; break;
+            case 0b100001: op.handler = Handler::ADDU; break;
+            case 0b100010: op.handler = Handler::SUB; break;
+            case 0b100011: op.handler = Handler::SUBU; break;
+            case 0b100100: op.handler = Handler::AND; break;
+            case 0b100101: op.handler = Handler::OR; break;
+            case 0b100110: op.handler = Handler::XOR; break;
+            case 0b100111: op.handler = Handler::NOR; break;
+            case 0b000000: op.handler = Handler::SLL; break;
+            case 0b000010: op.handler = Handler::SRL; break;
+            case 0b000011: op.handler = Handler::SRA; break;
+            case 0b101010: op.handler = Handler::SLT; break;
+            case 0b101011: op.handler = Handler::SLTU; break;
+            case 0b010000: op.handler = Handler::MFHI; break;
+            case 0b010010: op.handler = Handler::MFLO; break;
+            default:
+                writesRd = false;
+                switch (machine & 0x3F)
+                {
+                case 0b011000: op.handler = Handler::MULT; break;
+                case 0b011001: op.handler = Handler::MULTU; break;
+                case 0b011010: op.handler = Handler::DIV; break;
+                case 0b011011: op.handler = Handler::DIVU; break;
+                case 0b001000: op.handler = Handler::JR; break;
+                case 0b001100: op.handler = Handler::SYSCALL; break;
+                default:
+                    throw std::runtime_error(std::format("Cannot execute 0x{:08x} at 0x{:08x}", machine, instructions[i].address));
+                }
+            }
+        }
+        else
+        {
+            op.imm = simm;
+            writesRt = true;
+            switch (opcode)
+            {
+            case 0b001000: op.handler = Handler::ADDI; break;
+            case 0b001001: op.handler = Handler::ADDIU; break;
+            case 0b001010: op.handler = Handler::SLTI; break;
+            case 0b001011: op.handler = Handler::SLTIU; break;
+            case 0b001100: op.handler = Handler::ANDI; op.imm = uimm; break;
+            case 0b001101: op.handler = Handler::ORI; op.imm = uimm; break;
+            case 0b001110: op.handler = Handler::XORI; op.imm = uimm; break;
+            case 0b001111: op.handler = Handler::LUI; op.imm = static_cast<int32_t>(machine << 16); break;
+            default:
+                writesRt = false;
+                switch (opcode)
+                {
+                case 0b100011: op.handler = Handler::LW; break;
+                case 0b100000: op.handler = Handler::LB; break;
+                case 0b100100: op.handler = Handler::LBU; break;
+                case 0b100001: op.handler = Handler::LH; break;
+                case 0b101011: op.handler = Handler::SW; break;
+                case 0b101000: op.handler = Handler::SB; break;
+                case 0b101001: op.handler = Handler::SH; break;
+                case 0b000100: op.handler = Handler::BEQ; op.imm = indexOf(i + 1 + simm); break;
+                case 0b000101: op.handler = Handler::BNE; op.imm = indexOf(i + 1 + simm); break;
+                case 0b000111: op.handler = Handler::BGTZ; op.imm = indexOf(i + 1 + simm); break;
+                case 0b000001: op.handler = Handler::BLTZ; op.imm = indexOf(i + 1 + simm); break;
+                case 0b000010:
+                case 0b000011:
+                {
+                    uint32_t next = PC_START + static_cast<uint32_t>(i + 1) * 4;
+                    uint32_t target = (next & 0xF0000000) | ((machine & 0x3FFFFFF) << 2);
+                    op.handler = opcode == 0b000010 ? Handler::J : Handler::JAL;
+                    op.imm = indexOf((static_cast<int64_t>(target) - PC_START) / 4);
+                    break;
+                }
+                default:
+                    throw std::runtime_error(std::format("Cannot execute 0x{:08x} at 0x{:08x}", machine, instructions[i].address));
+                }
+            }
+        }
+        // Writes to $zero are dropped, but add, sub and addi still trap on overflow
+        bool traps = op.handler == Handler::ADD || op.handler == Handler::SUB || op.handler == Handler::ADDI;
+        if (((writesRd && rd == 0) || (writesRt && rt == 0)) && !traps)
+        {
+            op.handler = Handler::NOP;
+        }
+        ops[i] = op;
+    }
+    return ops;
+}
+
+// Combinations of features as a list of policies
+template <typename... Policies>
+struct PolicyList
+{
+};
+
+#if MIPS_ALL_POLICIES
+// Every combination of observers, each with and without the budget, after the JIT and debug ones
+template <std::size_t... Combinations>
+static auto allPolicies(std::index_sequence<Combinations...>)
+    -> PolicyList<Policy<>, Policy<Feature::Budget>, Policy<Feature::Jit>, Policy<Feature::Jit, Feature::Budget>, Policy<Feature::Debug>,
+                  Policy<Feature::Debug, Feature::Budget>,
+                  ExecutionPolicy<(Combinations & 1) * Feature::Budget::BIT | (Combinations >> 1) * Feature::Profile::BIT>...>;
+using CompiledPolicies = decltype(allPolicies(std::make_index_sequence<64>()));
+#else
+// The plain, JIT and debug runs with and without the budget and each observer on its own
+using CompiledPolicies =
+    PolicyList<Policy<>, Policy<Feature::Budget>, Policy<Feature::Jit>, Policy<Feature::Jit, Feature::Budget>, Policy<Feature::Debug>,
+               Policy<Feature::Debug, Feature::Budget>, Policy<Feature::Profile>, Policy<Feature::Trace>, Policy<Feature::Timing>,
+               Policy<Feature::Caches>, Policy<Feature::Predict>, Policy<Feature::Timing, Feature::Caches, Feature::Predict>>;
+#endif
+
+/**
+ * Picks the instance of the run loop compiled for the features this run
+ * has, or the dynamic one when none was. JIT and debugged runs always have
+ * an instance, the dynamic one only interprets and does not debug.
+ */
+int CPU::run()
+{
+    static constexpr auto INSTANCES = []<typename... Policies>(PolicyList<Policies...>)
+    {
+        std::array<int (CPU::*)(), Feature::Dynamic::BIT> instances;
+        instances.fill(&CPU::execute<Policy<Feature::Dynamic>>);
+        ((instances[Policies::FEATURES] = &CPU::execute<Policies>), ...);
+        return instances;
+    }(CompiledPolicies());
+    uint32_t features = this->budget != std::numeric_limits<uint64_t>::max() ? Feature::Budget::BIT : 0;
+    if (this->debugger != nullptr)
+    {
+        // Debugged runs leave the observers out
+        return (this->*INSTANCES[features | Feature::Debug::BIT])();
+    }
+    features |= (this->profile != nullptr ? Feature::Profile::BIT : 0) | (this->trace != nullptr ? Feature::Trace::BIT : 0) |
+                (this->timing != nullptr ? Feature::Timing::BIT : 0) | (this->caches != nullptr ? Feature::Caches::BIT : 0) |
+                (this->predictor != nullptr ? Feature::Predict::BIT : 0);
+    if (this->dynamicOnly)
+    {
+        return execute<Policy<Feature::Dynamic>>();
+    }
+    // Observed runs interpret
+    if (this->compiler != nullptr && features <= Feature::Budget::BIT)
+    {
+        features |= Feature::Jit::BIT;
+    }
+    return (this->*INSTANCES[features])();
+}
+
+/**
+ * The dispatch loop. Ops are reached through a pointer into the current
+ * block, control transfers move to the linked successor block, and errors
+ * thrown by handlers are rethrown with the address of the op that raised
+ * them. Instructions are counted a block at a time on entry. Each feature
+ * of ExecutionPolicy.hpp only exists in the instances whose Policy has it,
+ * so the plain loop pays for none of them. The dynamic instance has the
+ * budget and every observer behind a check of whether the CPU has it.
+ */
+template <typename Policy>
+int CPU::execute()
+{
+    BlockCache &cache = this->blocks;
+    const uint32_t textCount = static_cast<uint32_t>(cache.source().size()) - 2;
+    uint32_t *const r = this->regs.data();
+    Jit *const jit = this->compiler.get();
+    Profiler *const profile = this->profile.get();
+    TraceStream *const trace = this->trace.get();
+    Pipeline *const timing = this->timing.get();
+    CacheModel *const caches = this->caches.get();
+    BranchPredictor *const predictor = this->predictor.get();
+    Debugger *const debug = this->debugger;
+    uint64_t count = 0;
+    const uint64_t budget = this->budget;
+    constexpr bool dynamic = Policy::template has<Feature::Dynamic>;
+    constexpr bool useJit = Policy::template has<Feature::Jit>;
+    constexpr bool debugging = Policy::template has<Feature::Debug>;
+    // Constant outside the dynamic instance, where the hooks of the others fold away
+    const bool withBudget = Policy::template has<Feature::Budget> || (dynamic && budget != std::numeric_limits<uint64_t>::max());
+    const bool withProfile = Policy::template has<Feature::Profile> || (dynamic && profile != nullptr);
+    const bool withTrace = Policy::template has<Feature::Trace> || (dynamic && trace != nullptr);
+    const bool withTiming = Policy::template has<Feature::Timing> || (dynamic && timing != nullptr);
+    const bool withCaches = Policy::template has<Feature::Caches> || (dynamic && caches != nullptr);
+    const bool withPredictor = Policy::template has<Feature::Predict> || (dynamic && predictor != nullptr);
+    int exitCode = 0;
+    this->jitExecuted = 0;
+    const uint32_t offset = this->pc - PC_START;
+    Block *block = cache.lookup(offset % 4 == 0 && offset / 4 <= textCount ? offset / 4 : textCount + 1);
+    const Op *op = block->ops.data();
+    auto addressOf = [&block](const Op *at)
+    {
+        return PC_START + (block->start + static_cast<uint32_t>(at - block->ops.data())) * 4;
+    };
+    // Instructions of the current block after at were counted but never ran
+    auto retired = [&block, &count](const Op *at)
+    {
+        uint32_t ran = std::min(static_cast<uint32_t>(at - block->ops.data()) + 1, block->instructions);
+        return count - (block->instructions - ran);
+    };
+
+    // Op index of the op at, for the profiler and the trace
+    auto indexOf = [&block](const Op *at)
+    {
+        return block->start + static_cast<uint32_t>(at - block->ops.data());
+    };
+
+#if MIPS_COMPUTED_GOTO
+#define MIPS_HANDLER_LABEL(name) &&do_##name,
+    static const void *const LABELS[] = {MIPS_HANDLERS(MIPS_HANDLER_LABEL)};
+#undef MIPS_HANDLER_LABEL
+#define CASE(name) do_##name:
+#define JUMP() goto *LABELS[static_cast<uint8_t>(op->handler)]
+#else
+#define CASE(name) case Handler::name:
+#define JUMP() goto dispatch
+#endif
+// Every op that runs passes through here, CHAIN, HALT and BAD_TARGET are not instructions
+#define DISPATCH()                                                      \
+    do                                                                  \
+    {                                                                   \
+        if (withProfile)                                                \
+        {                                                               \
+            if (op->handler != Handler::CHAIN)                          \
+            {                                                           \
+                profile->hit(indexOf(op));                              \
+            }                                                           \
+        }                                                               \
+        if constexpr (debugging)                                        \
+        {                                                               \
+            if (op->handler != Handler::CHAIN)                          \
+            {                                                           \
+                if (debug->stepsLeft == 0)                              \
+                {                                                       \
+                    debug->stop.reason = DebugStop::STEPPED;            \
+                    goto paused;                                        \
+                }                                                       \
+                --debug->stepsLeft;                                     \
+            }                                                           \
+        }                                                               \
+        JUMP();                                                         \
+    } while (0)
+// Conditional branches resolve through these, jal and jr $ra through CALL and RETURN
+#define TAKEN()                            \
+    do                                     \
+    {                                      \
+        if (withProfile)                   \
+        {                                  \
+            profile->taken(indexOf(op));   \
+        }                                  \
+        if (withPredictor)                 \
+        {                                  \
+            predictor->branch(indexOf(op), true); \
+        }                                  \
+    } while (0)
+#define NOT_TAKEN()                        \
+    do                                     \
+    {                                      \
+        if (withPredictor)                 \
+        {                                  \
+            predictor->branch(indexOf(op), false); \
+        }                                  \
+    } while (0)
+#define CALL(returnIndex)                  \
+    do                                     \
+    {                                      \
+        if (withPredictor)                 \
+        {                                  \
+            predictor->call(returnIndex);  \
+        }                                  \
+    } while (0)
+#define RETURN(target)                     \
+    do                                     \
+    {                                      \
+        if (withPredictor)                 \
+        {                                  \
+            if (op->rs == RA)              \
+            {                              \
+                predictor->ret(indexOf(op), target); \
+            }                              \
+        }                                  \
+    } while (0)
+#define NEXT() \
+    do         \
+    {          \
+        ++op;  \
+        DISPATCH(); \
+    } while (0)
+#define ENTER(target)                      \
+    do                                     \
+    {                                      \
+        block = (target);                  \
+        ++block->entries;                  \
+        if constexpr (useJit)              \
+        {                                  \
+            goto native;                   \
+        }                                  \
+        if (withBudget && count + block->instructions > budget) [[unlikely]] \
+        {                                  \
+            goto exhausted;                \
+        }                                  \
+        count += block->instructions;      \
+        if (withTrace)                     \
+        {                                  \
+            trace->block(block->start, block->instructions); \
+        }                                  \
+        if (withTiming)                    \
+        {                                  \
+            timing->enter(block->start, block->instructions); \
+        }                                  \
+        if (withCaches)                    \
+        {                                  \
+            caches->enter(block->start, block->instructions); \
+        }                                  \
+        op = block->ops.data();            \
+        DISPATCH();                        \
+    } while (0)
+// Loads and stores hand their address to the trace, the caches and the
+// watchpoints before the access
+#define ACCESS(address, size, write)       \
+    do                                     \
+    {                                      \
+        if constexpr (debugging)           \
+        {                                  \
+            if (debug->watched(address, size, write)) \
+            {                              \
+                goto paused;               \
+            }                              \
+        }                                  \
+        if (withTrace)                     \
+        {                                  \
+            trace->memory(address);        \
+        }                                  \
+        if (withCaches)                    \
+        {                                  \
+            caches->data(indexOf(op), address, write); \
+        }                                  \
+    } while (0)
+
+    try
+    {
+        ENTER(block);
+#if !MIPS_COMPUTED_GOTO
+    dispatch:
+        switch (op->handler)
+        {
+#endif
+        CASE(ADD)
+        {
+            int32_t result;
+            if (addOverflows(static_cast<int32_t>(r[op->rs]), static_cast<int32_t>(r[op->rt]), result))
+            {
+                throw std::overflow_error("Arithmetic overflow");
+            }
+            r[op->rd] = static_cast<uint32_t>(result);
+            // The destination may be $zero, kept for the trap
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(ADDU)
+        {
+            r[op->rd] = r[op->rs] + r[op->rt];
+            NEXT();
+        }
+        CASE(SUB)
+        {
+            int32_t result;
+            if (subOverflows(static_cast<int32_t>(r[op->rs]), static_cast<int32_t>(r[op->rt]), result))
+            {
+                throw std::overflow_error("Arithmetic overflow");
+            }
+            r[op->rd] = static_cast<uint32_t>(result);
+            // The destination may be $zero, kept for the trap
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(SUBU)
+        {
+            r[op->rd] = r[op->rs] - r[op->rt];
+            NEXT();
+        }
+        CASE(MULT)
+        {
+            int64_t product = static_cast<int64_t>(static_cast<int32_t>(r[op->rs])) * static_cast<int32_t>(r[op->rt]);
+            this->lo = static_cast<uint32_t>(product);
+            this->hi = static_cast<uint32_t>(static_cast<uint64_t>(product) >> 32);
+            NEXT();
+        }
+        CASE(MULTU)
+        {
+            uint64_t product = static_cast<uint64_t>(r[op->rs]) * r[op->rt];
+            this->lo = static_cast<uint32_t>(product);
+            this->hi = static_cast<uint32_t>(product >> 32);
+            NEXT();
+        }
+        CASE(DIV)
+        {
+            // Division by zero leaves HI and LO as they were
+            int32_t dividend = static_cast<int32_t>(r[op->rs]);
+            int32_t divisor = static_cast<int32_t>(r[op->rt]);
+            if (divisor == -1 && dividend == std::numeric_limits<int32_t>::min())
+            {
+                this->lo = static_cast<uint32_t>(dividend);
+                this->hi = 0;
+            }
+            else if (divisor != 0)
+            {
+                this->lo = static_cast<uint32_t>(dividend / divisor);
+                this->hi = static_cast<uint32_t>(dividend % divisor);
+            }
+            NEXT();
+        }
+        CASE(DIVU)
+        {
+            if (r[op->rt] != 0)
+            {
+                this->lo = r[op->rs] / r[op->rt];
+                this->hi = r[op->rs] % r[op->rt];
+            }
+            NEXT();
+        }
+        CASE(MFHI)
+        {
+            r[op->rd] = this->hi;
+            NEXT();
+        }
+        CASE(MFLO)
+        {
+            r[op->rd] = this->lo;
+            NEXT();
+        }
+        CASE(AND)
+        {
+            r[op->rd] = r[op->rs] & r[op->rt];
+            NEXT();
+        }
+        CASE(OR)
+        {
+            r[op->rd] = r[op->rs] | r[op->rt];
+            NEXT();
+        }
+        CASE(XOR)
+        {
+            r[op->rd] = r[op->rs] ^ r[op->rt];
+            NEXT();
+        }
+        CASE(NOR)
+        {
+            r[op->rd] = ~(r[op->rs] | r[op->rt]);
+            NEXT();
+        }
+        CASE(SLL)
+        {
+            r[op->rd] = r[op->rt] << op->imm;
+            NEXT();
+        }
+        CASE(SRL)
+        {
+            r[op->rd] = r[op->rt] >> op->imm;
+            NEXT();
+        }
+        CASE(SRA)
+        {
+            r[op->rd] = static_cast<uint32_t>(static_cast<int32_t>(r[op->rt]) >> op->imm);
+            NEXT();
+        }
+        CASE(SLT)
+        {
+            r[op->rd] = static_cast<int32_t>(r[op->rs]) < static_cast<int32_t>(r[op->rt]);
+            NEXT();
+        }
+        CASE(SLTU)
+        {
+            r[op->rd] = r[op->rs] < r[op->rt];
+            NEXT();
+        }
+        CASE(JR)
+        {
+            uint32_t offset = r[op->rs] - PC_START;
+            if ((offset & 3) != 0 || offset / 4 > textCount)
+            {
+                throw std::runtime_error(std::format("Jump to 0x{:08x} outside the text segment", r[op->rs]));
+            }
+            RETURN(offset / 4);
+            ENTER(cache.followIndirect(block, offset / 4));
+        }
+        CASE(SYSCALL)
+        {
+            if (!syscall(exitCode))
+            {
+                goto done;
+            }
+            NEXT();
+        }
+        CASE(NOP)
+        {
+            NEXT();
+        }
+        CASE(LW)
+        {
+            ACCESS(r[op->rs] + op->imm, 4, false);
+            r[op->rt] = this->memory.readWord(r[op->rs] + op->imm);
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(SW)
+        {
+            ACCESS(r[op->rs] + op->imm, 4, true);
+            this->memory.writeWord(r[op->rs] + op->imm, r[op->rt]);
+            NEXT();
+        }
+        CASE(LB)
+        {
+            ACCESS(r[op->rs] + op->imm, 1, false);
+            r[op->rt] = static_cast<uint32_t>(static_cast<int8_t>(this->memory.read(r[op->rs] + op->imm)));
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(SB)
+        {
+            ACCESS(r[op->rs] + op->imm, 1, true);
+            this->memory.write(r[op->rs] + op->imm, static_cast<uint8_t>(r[op->rt]));
+            NEXT();
+        }
+        CASE(LBU)
+        {
+            ACCESS(r[op->rs] + op->imm, 1, false);
+            r[op->rt] = this->memory.read(r[op->rs] + op->imm);
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(LH)
+        {
+            ACCESS(r[op->rs] + op->imm, 2, false);
+            r[op->rt] = static_cast<uint32_t>(static_cast<int16_t>(this->memory.readHalf(r[op->rs] + op->imm)));
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(SH)
+        {
+            ACCESS(r[op->rs] + op->imm, 2, true);
+            this->memory.writeHalf(r[op->rs] + op->imm, static_cast<uint16_t>(r[op->rt]));
+            NEXT();
+        }
+        CASE(LUI)
+        {
+            r[op->rt] = static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(BEQ)
+        {
+            if (r[op->rs] == r[op->rt])
+            {
+                TAKEN();
+                ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+            }
+            NOT_TAKEN();
+            ENTER(cache.follow(block, Block::FALLTHROUGH, block->end));
+        }
+        CASE(BNE)
+        {
+            if (r[op->rs] != r[op->rt])
+            {
+                TAKEN();
+                ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+            }
+            NOT_TAKEN();
+            ENTER(cache.follow(block, Block::FALLTHROUGH, block->end));
+        }
+        CASE(BGTZ)
+        {
+            if (static_cast<int32_t>(r[op->rs]) > 0)
+            {
+                TAKEN();
+                ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+            }
+            NOT_TAKEN();
+            ENTER(cache.follow(block, Block::FALLTHROUGH, block->end));
+        }
+        CASE(BLTZ)
+        {
+            if (static_cast<int32_t>(r[op->rs]) < 0)
+            {
+                TAKEN();
+                ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+            }
+            NOT_TAKEN();
+            ENTER(cache.follow(block, Block::FALLTHROUGH, block->end));
+        }
+        CASE(J)
+        {
+            ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+        }
+        CASE(JAL)
+        {
+            r[RA] = PC_START + block->end * 4;
+            CALL(block->end);
+            ENTER(cache.follow(block, Block::TAKEN, static_cast<uint32_t>(op->imm)));
+        }
+        CASE(ADDI)
+        {
+            int32_t result;
+            if (addOverflows(static_cast<int32_t>(r[op->rs]), op->imm, result))
+            {
+                throw std::overflow_error("Arithmetic overflow");
+            }
+            r[op->rt] = static_cast<uint32_t>(result);
+            // The destination may be $zero, kept for the trap
+            r[0] = 0;
+            NEXT();
+        }
+        CASE(ADDIU)
+        {
+            r[op->rt] = r[op->rs] + static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(ANDI)
+        {
+            r[op->rt] = r[op->rs] & static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(ORI)
+        {
+            r[op->rt] = r[op->rs] | static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(XORI)
+        {
+            r[op->rt] = r[op->rs] ^ static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(SLTI)
+        {
+            r[op->rt] = static_cast<int32_t>(r[op->rs]) < op->imm;
+            NEXT();
+        }
+        CASE(SLTIU)
+        {
+            r[op->rt] = r[op->rs] < static_cast<uint32_t>(op->imm);
+            NEXT();
+        }
+        CASE(HALT)
+        {
+            // Ran off the end of the text
+            goto done;
+        }
+        CASE(BAD_TARGET)
+        {
+            throw std::runtime_error("Branch target outside the text segment");
+        }
+        CASE(CHAIN)
+        {
+            // The block ran into the next leader
+            ENTER(cache.follow(block, Block::FALLTHROUGH, block->end));
+        }
+        CASE(BREAKPOINT)
+        {
+            if constexpr (debugging)
+            {
+                debug->stop.reason = DebugStop::BREAKPOINT;
+                goto paused;
+            }
+            throw std::runtime_error("Breakpoint outside a debugged run");
+        }
+    native: MIPS_MAYBE_UNUSED_LABEL;
+        if constexpr (useJit)
+        {
+            // Hot blocks are compiled once
+            if (block->native == nullptr && !block->nativeTried && block->entries >= Jit::HOT_BLOCK_ENTRIES)
+            {
+                block->nativeTried = true;
+                block->native = jit->compile(*block);
+            }
+            if (withBudget && count + this->jitExecuted + block->instructions > budget) [[unlikely]]
+            {
+                goto exhausted;
+            }
+            if (block->native != nullptr)
+            {
+                // A self-looping block stops once it has used up what is left
+                this->jitLimit = budget - count;
+                uint32_t next = block->native(r, this);
+                if ((next & Jit::INTERPRET) == 0)
+                {
+                    ENTER(cache.successor(block, next));
+                }
+                block = cache.lookup(next & ~Jit::INTERPRET);
+            }
+            count += block->instructions;
+            op = block->ops.data();
+            DISPATCH();
+        }
+#if !MIPS_COMPUTED_GOTO
+        }
+#endif
+    }
+    catch (const std::exception &error)
+    {
+        this->pc = addressOf(op);
+        this->executed = retired(op) + this->jitExecuted;
+        this->io.flush();
+        if (withTiming)
+        {
+            timing->stop(indexOf(op));
+        }
+        if (withCaches)
+        {
+            caches->stop(indexOf(op));
+        }
+        if (withTrace)
+        {
+            trace->finish(indexOf(op));
+        }
+        throw std::runtime_error(std::format("{} at 0x{:08x}", error.what(), this->pc));
+    }
+#undef CASE
+#undef JUMP
+#undef DISPATCH
+#undef TAKEN
+#undef NOT_TAKEN
+#undef CALL
+#undef RETURN
+#undef NEXT
+#undef ENTER
+#undef ACCESS
+
+done:
+    this->pc = addressOf(op);
+    this->executed = retired(op) + this->jitExecuted;
+    this->io.flush();
+    if (withTiming)
+    {
+        timing->stop(indexOf(op));
+    }
+    if (withCaches)
+    {
+        caches->stop(indexOf(op));
+    }
+    if (withTrace)
+    {
+        trace->finish(indexOf(op));
+    }
+    return exitCode;
+
+paused: MIPS_MAYBE_UNUSED_LABEL;
+    // Stopped before op, which did not run
+    this->pc = addressOf(op);
+    this->executed = count - (block->instructions - static_cast<uint32_t>(op - block->ops.data()));
+    this->io.flush();
+    if constexpr (debugging)
+    {
+        debug->stopped = true;
+        debug->stop.pc = this->pc;
+    }
+    return 0;
+
+exhausted:
+    // Stopped before the block, which would have gone past the budget
+    this->pc = PC_START + block->start * 4;
+    this->executed = count + this->jitExecuted;
+    this->io.flush();
+    if (withTiming)
+    {
+        timing->stop(RUN_COMPLETE);
+    }
+    if (withCaches)
+    {
+        caches->stop(RUN_COMPLETE);
+    }
+    if (withTrace)
+    {
+        trace->finish(RUN_COMPLETE);
+    }
+    throw BudgetExhausted(std::format("Instruction budget of {} exhausted at 0x{:08x}", budget, this->pc));
+}
+
+BlockStats CPU::blockStats() const
+{
+    return this->blocks.stats();
+}
+
+/**
+ * Compiled code reaches the CPU through byte offsets from the register
+ * file, the CPU must stay where it is while it runs
+ */
+bool CPU::enableJit()
+{
+    if (!MIPS_JIT_SUPPORTED)
+    {
+        return false;
+    }
+    const char *base = reinterpret_cast<const char *>(this->regs.data());
+    auto offsetOf = [base](const void *field)
+    {
+        return static_cast<int32_t>(static_cast<const char *>(field) - base);
+    };
+    JitTarget target;
+    target.regs = this->regs.data();
+    target.hiOffset = offsetOf(&this->hi);
+    target.loOffset = offsetOf(&this->lo);
+    target.executedOffset = offsetOf(&this->jitExecuted);
+    target.limitOffset = offsetOf(&this->jitLimit);
+    target.textCount = static_cast<uint32_t>(this->blocks.source().size()) - 2;
+    target.memory = this;
+    target.load = &CPU::jitLoad;
+    target.store = &CPU::jitStore;
+    this->compiler = std::make_unique<Jit>(target);
+    return true;
+}
+
+void CPU::setBudget(uint64_t instructions)
+{
+    this->budget = instructions == 0 ? std::numeric_limits<uint64_t>::max() : instructions;
+}
+
+void CPU::enableProfiler()
+{
+    if (this->profile == nullptr)
+    {
+        this->profile = std::make_unique<Profiler>(this->blocks.source().size() - 2);
+    }
+}
+
+const Profiler *CPU::profiler() const
+{
+    return this->profile.get();
+}
+
+void CPU::enableTiming()
+{
+    if (this->timing == nullptr)
+    {
+        this->timing = std::make_unique<Pipeline>(this->blocks.source());
+    }
+}
+
+const Pipeline *CPU::pipeline() const
+{
+    return this->timing.get();
+}
+
+void CPU::enableCaches(const CacheLevels &levels)
+{
+    this->caches = std::make_unique<CacheModel>(this->blocks.source().size() - 2, levels);
+}
+
+const CacheModel *CPU::cacheModel() const
+{
+    return this->caches.get();
+}
+
+void CPU::enablePredictor(const PredictorConfig &config)
+{
+    this->predictor = std::make_unique<BranchPredictor>(this->blocks.source(), config);
+}
+
+const BranchPredictor *CPU::branchPredictor() const
+{
+    return this->predictor.get();
+}
+
+/**
+ * The stream gets the text words and, per instruction, the register it
+ * writes and whether it touches memory, from which the writer expands the
+ * blocks and addresses the CPU records
+ */
+void CPU::enableTrace(TraceWriter &writer)
+{
+    const std::vector<Op> &ops = this->blocks.source();
+    const std::size_t textCount = ops.size() - 2;
+    std::vector<uint32_t> words(textCount);
+    std::vector<uint8_t> destinations(textCount);
+    for (std::size_t i = 0; i < textCount; ++i)
+    {
+        const Op &op = ops[i];
+        words[i] = this->memory.readWord(PC_START + static_cast<uint32_t>(i) * 4);
+        switch (op.handler)
+        {
+        case Handler::ADD:
+        case Handler::ADDU:
+        case Handler::SUB:
+        case Handler::SUBU:
+        case Handler::MFHI:
+        case Handler::MFLO:
+        case Handler::AND:
+        case Handler::OR:
+        case Handler::XOR:
+        case Handler::NOR:
+        case Handler::SLL:
+        case Handler::SRL:
+        case Handler::SRA:
+        case Handler::SLT:
+        case Handler::SLTU:
+            destinations[i] = op.rd;
+            break;
+        case Handler::ADDI:
+        case Handler::ADDIU:
+        case Handler::ANDI:
+        case Handler::ORI:
+        case Handler::XORI:
+        case Handler::SLTI:
+        case Handler::SLTIU:
+        case Handler::LUI:
+            destinations[i] = op.rt;
+            break;
+        case Handler::LW:
+        case Handler::LB:
+        case Handler::LBU:
+        case Handler::LH:
+            destinations[i] = op.rt | TraceStream::ACCESSES_MEMORY;
+            break;
+        case Handler::SW:
+        case Handler::SB:
+        case Handler::SH:
+            destinations[i] = TraceStream::ACCESSES_MEMORY;
+            break;
+        case Handler::JAL:
+            destinations[i] = RA;
+            break;
+        case Handler::SYSCALL:
+            // Reads and sbrk return in $v0
+            destinations[i] = V0;
+            break;
+        default:
+            destinations[i] = 0;
+            break;
+        }
+    }
+    this->trace = writer.open(std::move(words), std::move(destinations));
+}
+
+void CPU::setDynamicOnly(bool dynamic)
+{
+    this->dynamicOnly = dynamic;
+}
+
+const Jit *CPU::jit() const
+{
+    return this->compiler.get();
+}
+
+std::size_t CPU::residentPages() const
+{
+    return this->memory.residentPages();
+}
+
+const Heap &CPU::heapUsage() const
+{
+    return this->heap;
+}
+
+CPU::Snapshot CPU::snapshot()
+{
+    return {this->regs, this->hi, this->lo, this->pc, this->memory.snapshot(), this->heap.state()};
+}
+
+void CPU::restore(const Snapshot &snapshot)
+{
+    this->regs = snapshot.regs;
+    this->hi = snapshot.hi;
+    this->lo = snapshot.lo;
+    this->pc = snapshot.pc;
+    this->memory.restore(snapshot.memory);
+    this->heap.restore(snapshot.heap);
+}
+
+SyscallIO &CPU::console()
+{
+    return this->io;
+}
+
+/**
+ * Services follow MARS: 1 print_int, 4 print_string, 5 read_int,
+ * 8 read_string, 9 sbrk, 10 exit, 11 print_char, 12 read_char, 17 exit2
+ */
+bool CPU::syscall(int &exitCode)
+{
+    uint32_t *r = this->regs.data();
+    switch (r[V0])
+    {
+    case 1:
+        this->io.printInt(static_cast<int32_t>(r[A0]));
+        return true;
+    case 4:
+    {
+        // A page at a time, the string ends at the first NUL
+        uint32_t address = r[A0];
+        for (;;)
+        {
+            const uint8_t *p = this->memory.tryRead(address, 1);
+            if (p == nullptr)
+            {
+                this->memory.read(address);
+            }
+            std::size_t available = DataSegment::PAGE_SIZE - (address & (DataSegment::PAGE_SIZE - 1));
+            const void *nul = std::memchr(p, 0, available);
+            std::size_t length = nul != nullptr ? static_cast<std::size_t>(static_cast<const uint8_t *>(nul) - p) : available;
+            this->io.printString(std::string_view(reinterpret_cast<const char *>(p), length));
+            if (nul != nullptr)
+            {
+                return true;
+            }
+            address += static_cast<uint32_t>(available);
+        }
+    }
+    case 5:
+    {
+        int32_t value = 0;
+        if (!this->io.readInt(value))
+        {
+            throw std::runtime_error("read_int: no integer on input");
+        }
+        r[V0] = static_cast<uint32_t>(value);
+        return true;
+    }
+    case 8:
+    {
+        // Up to $a1 - 1 characters including the newline, always terminated
+        std::string line = this->io.readLine();
+        uint32_t limit = r[A1];
+        if (limit == 0)
+        {
+            return true;
+        }
+        uint32_t length = std::min<uint32_t>(static_cast<uint32_t>(line.size()), limit - 1);
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            this->memory.write(r[A0] + i, static_cast<uint8_t>(line[i]));
+        }
+        this->memory.write(r[A0] + length, 0);
+        return true;
+    }
+    case 9:
+        r[V0] = this->heap.sbrk(static_cast<int32_t>(r[A0]));
+        return true;
+    case 10:
+        exitCode = 0;
+        return false;
+    case 11:
+        this->io.printChar(static_cast<char>(r[A0]));
+        return true;
+    case 12:
+    {
+        int c = this->io.readChar();
+        r[V0] = c == std::char_traits<char>::eof() ? 0 : static_cast<uint32_t>(c);
+        return true;
+    }
+    case 17:
+        exitCode = static_cast<int32_t>(r[A0]);
+        return false;
+    default:
+        throw std::runtime_error(std::format("Unsupported syscall {}", r[V0]));
+    }
+}
+
+int64_t CPU::jitLoad(void *memory, uint32_t address, uint32_t kind)
+{
+    DataSegment &segment = static_cast<CPU *>(memory)->memory;
+    switch (static_cast<Handler>(kind))
+    {
+    case Handler::LW:
+        if (const uint8_t *p = segment.tryRead(address, 4))
+        {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+        }
+        break;
+    case Handler::LH:
+        if (const uint8_t *p = segment.tryRead(address, 2))
+        {
+            return static_cast<uint32_t>(static_cast<int16_t>((p[0] << 8) | p[1]));
+        }
+        break;
+    case Handler::LB:
+        if (const uint8_t *p = segment.tryRead(address, 1))
+        {
+            return static_cast<uint32_t>(static_cast<int8_t>(*p));
+        }
+        break;
+    case Handler::LBU:
+        if (const uint8_t *p = segment.tryRead(address, 1))
+        {
+            return *p;
+        }
+        break;
+    default:
+        break;
+    }
+    return -1;
+}
+
+bool CPU::jitStore(void *memory, uint32_t address, uint32_t value, uint32_t kind)
+{
+    DataSegment &segment = static_cast<CPU *>(memory)->memory;
+    uint32_t size = kind == static_cast<uint32_t>(Handler::SW) ? 4 : kind == static_cast<uint32_t>(Handler::SH) ? 2 : 1;
+    uint8_t *p = segment.tryWrite(address, size);
+    if (p == nullptr)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        p[i] = static_cast<uint8_t>(value >> (8 * (size - 1 - i)));
+    }
+    return true;
+}
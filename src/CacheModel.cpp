@@ -0,0 +1,350 @@
+#include "CacheModel.hpp"
+#include "MIPS.hpp"
+#include "TextLabels.hpp"
+#include "Helpers.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * Sizes take a K or M suffix (and an optional B after it), the policy
+ * defaults to LRU
+ */
+CacheConfig CacheConfig::parse(std::string_view spec)
+{
+    const std::vector<std::string_view> fields = splitFields(spec);
+    if (fields.size() < 3 || fields.size() > 4)
+    {
+        throw std::runtime_error(std::format("Cache spec must be size,ways,line[,policy], got \"{}\"", spec));
+    }
+    auto number = [](std::string_view field)
+    {
+        uint64_t value = 0;
+        auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+        std::string_view suffix(end, field.data() + field.size() - end);
+        if (!suffix.empty() && (suffix.back() == 'B' || suffix.back() == 'b'))
+        {
+            suffix.remove_suffix(1);
+        }
+        if (suffix == "K" || suffix == "k")
+        {
+            value <<= 10;
+        }
+        else if (suffix == "M" || suffix == "m")
+        {
+            value <<= 20;
+        }
+        else if (!suffix.empty())
+        {
+            error = std::errc::invalid_argument;
+        }
+        if (error != std::errc() || value == 0 || value > 0x80000000)
+        {
+            throw std::runtime_error(std::format("Invalid cache size \"{}\"", field));
+        }
+        return static_cast<uint32_t>(value);
+    };
+
+    CacheConfig config;
+    config.size = number(fields[0]);
+    config.ways = number(fields[1]);
+    config.lineSize = number(fields[2]);
+    if (fields.size() == 4)
+    {
+        if (fields[3] == "lru")
+        {
+            config.replacement = Replacement::LRU;
+        }
+        else if (fields[3] == "plru")
+        {
+            config.replacement = Replacement::PLRU;
+        }
+        else if (fields[3] == "random")
+        {
+            config.replacement = Replacement::RANDOM;
+        }
+        else
+        {
+            throw std::runtime_error(std::format("Unknown replacement policy \"{}\"", fields[3]));
+        }
+    }
+    return config;
+}
+
+std::string CacheConfig::describe() const
+{
+    static constexpr const char *POLICIES[] = {"LRU", "PLRU", "random"};
+    std::string size = this->size % (1 << 20) == 0 ? std::format("{}MB", this->size >> 20)
+                       : this->size % 1024 == 0   ? std::format("{}KB", this->size >> 10)
+                                                  : std::format("{}B", this->size);
+    return std::format("{} {}-way {}B {}", size, this->ways, this->lineSize, POLICIES[static_cast<int>(this->replacement)]);
+}
+
+Cache::Cache(const CacheConfig &config)
+    : settings(config), ways(config.ways), waysBits(static_cast<uint32_t>(std::countr_zero(config.ways))),
+      stride((config.ways + 3) & ~3u), lineBits(static_cast<uint32_t>(std::countr_zero(config.lineSize))), setBits(0), setMask(0),
+      clock(0), random(0), hitCount(0), missCount(0), writebackCount(0)
+{
+    if (!std::has_single_bit(config.size) || !std::has_single_bit(config.ways) || !std::has_single_bit(config.lineSize))
+    {
+        throw std::runtime_error(std::format("Cache {} is not made of powers of two", config.describe()));
+    }
+    // Lines hold whole words and a set fits the lookup mask, the set size taken
+    // in 64 bits so a huge line cannot wrap it to zero
+    uint64_t setSize = static_cast<uint64_t>(config.ways) * config.lineSize;
+    if (config.lineSize < 4 || config.ways > 32 || config.size < setSize)
+    {
+        throw std::runtime_error(std::format("Cache {} cannot be built", config.describe()));
+    }
+    uint32_t sets = static_cast<uint32_t>(config.size / setSize);
+    this->setBits = static_cast<uint32_t>(std::countr_zero(sets));
+    this->setMask = sets - 1;
+    this->tags.resize(static_cast<std::size_t>(sets) * this->stride);
+    this->dirty.resize(this->tags.size());
+    if (config.replacement == Replacement::LRU)
+    {
+        this->stamps.resize(this->tags.size());
+    }
+    if (config.replacement == Replacement::PLRU)
+    {
+        this->trees.resize(sets);
+    }
+    clear();
+}
+
+const CacheConfig &Cache::config() const
+{
+    return this->settings;
+}
+
+uint64_t Cache::accesses() const
+{
+    return this->hitCount + this->missCount;
+}
+
+uint64_t Cache::misses() const
+{
+    return this->missCount;
+}
+
+uint64_t Cache::writebacks() const
+{
+    return this->writebackCount;
+}
+
+void Cache::clear()
+{
+    std::fill(this->tags.begin(), this->tags.end(), INVALID);
+    std::fill(this->dirty.begin(), this->dirty.end(), 0);
+    std::fill(this->stamps.begin(), this->stamps.end(), 0);
+    std::fill(this->trees.begin(), this->trees.end(), 0);
+    this->clock = 0;
+    this->random = 0x9E3779B97F4A7C15;
+    this->hitCount = 0;
+    this->missCount = 0;
+    this->writebackCount = 0;
+}
+
+Cache::Outcome Cache::miss(uint32_t set, uint32_t tag, bool write)
+{
+    ++this->missCount;
+    const uint32_t way = victim(set);
+    const uint32_t slot = set * this->stride + way;
+    Outcome outcome{false, false, 0};
+    if (this->tags[slot] != INVALID && this->dirty[slot] != 0)
+    {
+        ++this->writebackCount;
+        outcome.writeback = true;
+        outcome.victim = (this->tags[slot] << this->setBits | set) << this->lineBits;
+    }
+    this->tags[slot] = tag;
+    this->dirty[slot] = 0;
+    touch(set, way, write);
+    return outcome;
+}
+
+// An empty way if there is one, otherwise the policy's choice
+uint32_t Cache::victim(uint32_t set)
+{
+    const uint32_t *tags = &this->tags[set * this->stride];
+    for (uint32_t w = 0; w < this->ways; ++w)
+    {
+        if (tags[w] == INVALID)
+        {
+            return w;
+        }
+    }
+    switch (this->settings.replacement)
+    {
+    case Replacement::LRU:
+    {
+        const uint64_t *stamps = &this->stamps[set * this->stride];
+        return static_cast<uint32_t>(std::min_element(stamps, stamps + this->ways) - stamps);
+    }
+    case Replacement::PLRU:
+    {
+        // Follow the bits down to the leaf they point at
+        uint32_t node = 1;
+        for (uint32_t level = 0; level < this->waysBits; ++level)
+        {
+            node = node * 2 + ((this->trees[set] >> node) & 1);
+        }
+        return node - this->ways;
+    }
+    default:
+        // xorshift64
+        this->random ^= this->random << 13;
+        this->random ^= this->random >> 7;
+        this->random ^= this->random << 17;
+        return static_cast<uint32_t>(this->random & (this->ways - 1));
+    }
+}
+
+CacheModel::CacheModel(std::size_t instructions, const CacheLevels &levels)
+    : l1i(levels.instruction), l1d(levels.data), counters(instructions), pendingStart(0), pendingLength(0)
+{
+    if (levels.second)
+    {
+        this->l2 = std::make_unique<Cache>(*levels.second);
+    }
+}
+
+void CacheModel::stop(uint32_t stop)
+{
+    fetch(this->pendingStart, opsRan(this->pendingStart, this->pendingLength, stop));
+    this->pendingLength = 0;
+}
+
+void CacheModel::fetch(uint32_t start, uint32_t length)
+{
+    // Blocks running off the end finish in the HALT op past the text
+    const uint32_t count = static_cast<uint32_t>(this->counters.size());
+    const uint32_t end = std::min(start + length, count);
+    const uint32_t perLine = 1u << (this->l1i.lineShift() - 2);
+    for (uint32_t i = start; i < end;)
+    {
+        // The instructions from i to the end of its line, or of the block
+        const uint32_t next = std::min((i | (perLine - 1)) + 1, end);
+        const uint32_t address = PC_START + i * 4;
+        Counters &counters = this->counters[i];
+        Cache::Outcome outcome = this->l1i.access(address, false);
+        if (!outcome.hit)
+        {
+            ++counters.fetchMisses;
+            below(i, address, outcome);
+        }
+        this->l1i.hits(next - i - 1);
+        counters.fetches += next - i;
+        i = next;
+    }
+}
+
+void CacheModel::below(uint32_t index, uint32_t address, const Cache::Outcome &outcome)
+{
+    if (this->l2 == nullptr)
+    {
+        return;
+    }
+    // The dirty line goes out before the missing one comes in
+    if (outcome.writeback)
+    {
+        this->l2->access(outcome.victim, true);
+    }
+    if (!this->l2->access(address, false).hit)
+    {
+        ++this->counters[index].secondMisses;
+    }
+}
+
+const Cache &CacheModel::instructionCache() const
+{
+    return this->l1i;
+}
+
+const Cache &CacheModel::dataCache() const
+{
+    return this->l1d;
+}
+
+const Cache *CacheModel::secondLevel() const
+{
+    return this->l2.get();
+}
+
+void CacheModel::clear()
+{
+    this->l1i.clear();
+    this->l1d.clear();
+    if (this->l2 != nullptr)
+    {
+        this->l2->clear();
+    }
+    std::fill(this->counters.begin(), this->counters.end(), Counters{});
+    this->pendingStart = 0;
+    this->pendingLength = 0;
+}
+
+/**
+ * Prints the totals of each cache, then one row per label ranked by L1
+ * misses. A label's fetch misses are those of its instructions, its data
+ * misses those of its loads and stores, and its L2 misses both kinds of L1
+ * miss that missed again
+ */
+void CacheModel::report(std::ostream &out, const MIPS &program, std::size_t hottest) const
+{
+    const uint32_t count = static_cast<uint32_t>(this->counters.size());
+    auto percent = [](uint64_t part, uint64_t whole)
+    {
+        return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+    };
+    auto line = [&out, &percent](std::string_view name, const Cache &cache)
+    {
+        out << std::format("{} {}: {} accesses, {} misses ({:.2f}%), {} writebacks\n", name, cache.config().describe(), cache.accesses(),
+                           cache.misses(), percent(cache.misses(), cache.accesses()), cache.writebacks());
+    };
+    line("caches:   L1I", this->l1i);
+    line("          L1D", this->l1d);
+    if (this->l2 != nullptr)
+    {
+        line("          L2 ", *this->l2);
+    }
+
+    struct Row
+    {
+        std::string_view name;
+        Counters totals;
+    };
+    const TextLabels labels(program, count);
+    std::vector<Row> rows;
+    for (const TextLabels::Range &label : labels.ranges())
+    {
+        Row row{label.name, {}};
+        for (uint32_t i = label.start; i < label.end; ++i)
+        {
+            const Counters &c = this->counters[i];
+            row.totals.fetches += c.fetches;
+            row.totals.fetchMisses += c.fetchMisses;
+            row.totals.dataAccesses += c.dataAccesses;
+            row.totals.dataMisses += c.dataMisses;
+            row.totals.secondMisses += c.secondMisses;
+        }
+        if (row.totals.fetches > 0)
+        {
+            rows.push_back(row);
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b)
+                     { return a.totals.fetchMisses + a.totals.dataMisses > b.totals.fetchMisses + b.totals.dataMisses; });
+
+    out << std::format("  {:<24} {:>14} {:>10} {:>8} {:>14} {:>10} {:>8} {:>10}\n", "label", "fetches", "I misses", "I miss%", "data accesses",
+                       "D misses", "D miss%", "L2 misses");
+    for (std::size_t r = 0; r < std::min(hottest, rows.size()); ++r)
+    {
+        const Counters &c = rows[r].totals;
+        out << std::format("  {:<24} {:>14} {:>10} {:>8.2f} {:>14} {:>10} {:>8.2f} {:>10}\n", rows[r].name, c.fetches, c.fetchMisses,
+                           percent(c.fetchMisses, c.fetches), c.dataAccesses, c.dataMisses, percent(c.dataMisses, c.dataAccesses), c.secondMisses);
+    }
+}
@@ -1,20 +1,177 @@
 #include "Data.hpp"
+#include "Helpers.hpp"
+#include "Globals.hpp"
 #include <stdexcept>
 #include <iostream>
 
-Data::Data() {}
+// Bytes per value of .word, .half and .byte, 0 for directives without values
+static uint32_t valueSize(std::string_view directive)
+{
+    if (directive == ".word")
+    {
+        return 4;
+    }
+    if (directive == ".half")
+    {
+        return 2;
+    }
+    return directive == ".byte" ? 1 : 0;
+}
 
-Data::Data(std::string &dataline, u_int32_t address) : dataline(dataline), address(address)
+Data::Data() : address(0), size(0) {}
+
+Data::Data(std::string_view label, std::span<const Token> toks, uint32_t address)
+    : address(address), size(0), label(label)
 {
-    std::size_t colonPos = this->dataline.find(':');
-    if (colonPos == std::string::npos)
+    if (toks.empty() || toks[0].type != TokenType::DIRECTIVE)
     {
-        throw std::runtime_error("Data not properly formated with no colon");
+        throw std::runtime_error("Data not properly formated with no directive: " + tokensToString(toks));
     }
-    this->label = this->dataline.substr(0, colonPos);
-    // Must handle for value
-    this->val = this->dataline.substr(colonPos + 1);
+    this->directive = toks[0].text;
+    this->val = tokensToString(toks.subspan(1));
+    processData(toks.subspan(1));
 }
 Data::~Data()
 {
-}
\ No newline at end of file
+}
+
+/**
+ * Aligns the address for the directive and counts the bytes it reserves
+ */
+void Data::processData(std::span<const Token> toks)
+{
+    uint32_t elementSize = 0;
+    if (this->directive == ".word")
+    {
+        elementSize = 4;
+    }
+    else if (this->directive == ".half")
+    {
+        elementSize = 2;
+    }
+    else if (this->directive == ".byte")
+    {
+        elementSize = 1;
+    }
+    else if (this->directive == ".ascii" || this->directive == ".asciiz")
+    {
+        for (const Token &tok : toks)
+        {
+            if (tok.type != TokenType::STRING)
+            {
+                throw std::runtime_error("Expected string for " + this->directive + ": " + this->val);
+            }
+            this->size += static_cast<uint32_t>(unescapedLength(tok.text)) + (this->directive == ".asciiz" ? 1 : 0);
+        }
+        return;
+    }
+    else if (this->directive == ".space")
+    {
+        validateTokenCount(1, toks);
+        this->size = static_cast<uint32_t>(handleValue(toks[0].text));
+        return;
+    }
+    else if (this->directive == ".align")
+    {
+        validateTokenCount(1, toks);
+        uint32_t alignment = 1u << handleValue(toks[0].text);
+        this->address = (this->address + alignment - 1) & ~(alignment - 1);
+        return;
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported data directive: " + this->directive);
+    }
+
+    // Natural alignment for .word and .half
+    this->address = (this->address + elementSize - 1) & ~(elementSize - 1);
+    // Values, with "value : count" repeating a value
+    for (std::size_t i = 0; i < toks.size(); ++i)
+    {
+        if (i + 2 < toks.size() && toks[i + 1].type == TokenType::COLON)
+        {
+            this->size += elementSize * static_cast<uint32_t>(handleValue(toks[i + 2].text));
+            i += 2;
+        }
+        else
+        {
+            this->size += elementSize;
+        }
+    }
+}
+
+/**
+ * toks starts at the directive like the constructor's. Padding, .space and
+ * .align are left as the zeros the image is grown with.
+ */
+void Data::writeImage(std::span<const Token> toks, std::vector<uint8_t> &image) const
+{
+    std::size_t start = this->address - DATA_START;
+    if (image.size() < start + this->size)
+    {
+        image.resize(start + this->size);
+    }
+    uint8_t *out = image.data() + start;
+    toks = toks.subspan(1);
+    if (this->directive == ".ascii" || this->directive == ".asciiz")
+    {
+        for (const Token &tok : toks)
+        {
+            for (std::size_t i = 0; i < tok.text.size(); ++i)
+            {
+                int c = static_cast<unsigned char>(tok.text[i]);
+                if (c == '\\' && i + 1 < tok.text.size())
+                {
+                    c = decodeEscape(tok.text[++i]);
+                    if (c < 0)
+                    {
+                        throw std::runtime_error("Unknown escape in string: " + this->val);
+                    }
+                }
+                *out++ = static_cast<uint8_t>(c);
+            }
+            if (this->directive == ".asciiz")
+            {
+                *out++ = 0;
+            }
+        }
+        return;
+    }
+    uint32_t elementSize = valueSize(this->directive);
+    if (elementSize == 0)
+    {
+        return;
+    }
+    for (std::size_t i = 0; i < toks.size(); ++i)
+    {
+        uint32_t value = static_cast<uint32_t>(handleValue(toks[i].text));
+        uint32_t count = 1;
+        if (i + 2 < toks.size() && toks[i + 1].type == TokenType::COLON)
+        {
+            count = static_cast<uint32_t>(handleValue(toks[i + 2].text));
+            i += 2;
+        }
+        for (uint32_t n = 0; n < count; ++n)
+        {
+            // Most significant byte first
+            for (uint32_t b = elementSize; b-- > 0;)
+            {
+                *out++ = static_cast<uint8_t>(value >> (b * 8));
+            }
+        }
+    }
+}
+
+std::size_t unescapedLength(std::string_view str)
+{
+    std::size_t length = 0;
+    for (std::size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '\\')
+        {
+            i++;
+        }
+        length++;
+    }
+    return length;
+}
@@ -1,17 +1,277 @@
 #include "DataSegment.hpp"
-#include "Globals.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <format>
 
-DataSegment::DataSegment() : memory(DATA_SEGMENT_SIZE), address(DATA_START)
+// Backs every read of a mapped page nothing has written yet
+alignas(64) static const uint8_t ZERO_PAGE[DataSegment::PAGE_SIZE] = {};
+// Page number no address has, marks an empty TLB entry
+static constexpr uint32_t NO_PAGE = 0xFFFFFFFF;
+// Source of snapshot generations, zero is never handed out
+static std::atomic<uint64_t> generations{0};
+
+MemoryFault::MemoryFault(Kind kind, uint32_t address, const std::string &message)
+    : std::runtime_error(message), kind(kind), address(address)
+{
+}
+
+DataSegment::DataSegment() : resident(0), baseline(0)
+{
+    flushTlb();
+}
+
+DataSegment::~DataSegment()
+{
+}
+
+void DataSegment::map(uint32_t start, uint32_t size, uint8_t permissions)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    uint32_t first = start & ~(PAGE_SIZE - 1);
+    uint64_t end = (static_cast<uint64_t>(start) + size + PAGE_SIZE - 1) & ~static_cast<uint64_t>(PAGE_SIZE - 1);
+    flushTlb();
+    // Growing a region in place keeps the list short for regionOf
+    for (Region &region : this->regions)
+    {
+        if (region.end == first && region.permissions == permissions)
+        {
+            region.end = end;
+            return;
+        }
+    }
+    this->regions.push_back({first, end, permissions});
+}
+
+void DataSegment::load(uint32_t address, std::span<const uint8_t> bytes)
+{
+    while (!bytes.empty())
+    {
+        uint32_t offset = address & (PAGE_SIZE - 1);
+        std::size_t count = std::min<std::size_t>(bytes.size(), PAGE_SIZE - offset);
+        std::memcpy(allocate(address >> PAGE_BITS)->bytes + offset, bytes.data(), count);
+        bytes = bytes.subspan(count);
+        address += static_cast<uint32_t>(count);
+    }
+    flushTlb();
+}
+
+const uint8_t *DataSegment::tryRead(uint32_t address, uint32_t size)
+{
+    if ((address & (size - 1)) != 0)
+    {
+        return nullptr;
+    }
+    const TlbEntry &entry = this->readTlb[(address >> PAGE_BITS) % TLB_SIZE];
+    const uint8_t *base = entry.page == (address >> PAGE_BITS) ? entry.data : resolve(address, READ);
+    return base != nullptr ? base + (address & (PAGE_SIZE - 1)) : nullptr;
+}
+
+uint8_t *DataSegment::tryWrite(uint32_t address, uint32_t size)
+{
+    if ((address & (size - 1)) != 0)
+    {
+        return nullptr;
+    }
+    const TlbEntry &entry = this->writeTlb[(address >> PAGE_BITS) % TLB_SIZE];
+    uint8_t *base = entry.page == (address >> PAGE_BITS) ? entry.data : resolve(address, WRITE);
+    return base != nullptr ? base + (address & (PAGE_SIZE - 1)) : nullptr;
+}
+
+std::size_t DataSegment::residentPages() const
 {
+    return this->resident;
 }
 
-bool DataSegment::write(const void *data)
+/**
+ * Snapshots share the pages. Nothing is copied here, but the write TLB is
+ * dropped so the next write to each page goes through allocate and copies it.
+ */
+DataSegment::Snapshot DataSegment::snapshot()
 {
-    // const uint8_t byteData = static_cast<const uint8_t *>(data);
-    return true;
+    Snapshot snapshot;
+    for (uint32_t high = 0; high < this->directory.size(); ++high)
+    {
+        if (this->directory[high] == nullptr)
+        {
+            continue;
+        }
+        for (uint32_t low = 0; low < 1024; ++low)
+        {
+            if (const std::shared_ptr<Page> &page = this->directory[high]->pages[low])
+            {
+                snapshot.pages.emplace_back((high << 10) | low, page);
+            }
+        }
+    }
+    snapshot.regions = this->regions;
+    snapshot.owner = this;
+    snapshot.generation = ++generations;
+    this->baseline = snapshot.generation;
+    this->dirty.clear();
+    this->writeTlb.fill({NO_PAGE, nullptr});
+    return snapshot;
 }
 
-uint8_t read(uint32_t address)
+void DataSegment::restore(const Snapshot &snapshot)
 {
-    return 0;
-}
\ No newline at end of file
+    if (snapshot.owner != this)
+    {
+        throw std::runtime_error("Snapshot was taken from another memory");
+    }
+    auto saved = [&snapshot](uint32_t page)
+    {
+        auto it = std::lower_bound(snapshot.pages.begin(), snapshot.pages.end(), page,
+                                   [](const auto &entry, uint32_t number) { return entry.first < number; });
+        return it != snapshot.pages.end() && it->first == page ? it->second : nullptr;
+    };
+    if (snapshot.generation == this->baseline)
+    {
+        // Every other page is still the one the snapshot holds
+        for (uint32_t page : this->dirty)
+        {
+            std::shared_ptr<Page> &slot = this->directory[page >> 10]->pages[page & 1023];
+            std::shared_ptr<Page> previous = saved(page);
+            this->resident = this->resident - (slot != nullptr) + (previous != nullptr);
+            slot = std::move(previous);
+        }
+    }
+    else
+    {
+        for (std::unique_ptr<Table> &table : this->directory)
+        {
+            table.reset();
+        }
+        for (const auto &[page, data] : snapshot.pages)
+        {
+            std::unique_ptr<Table> &table = this->directory[page >> 10];
+            if (table == nullptr)
+            {
+                table = std::make_unique<Table>();
+            }
+            table->pages[page & 1023] = data;
+        }
+        this->resident = snapshot.pages.size();
+        this->baseline = snapshot.generation;
+    }
+    this->dirty.clear();
+    this->regions = snapshot.regions;
+    flushTlb();
+}
+
+const uint8_t *DataSegment::readMiss(uint32_t address, uint32_t size)
+{
+    const uint8_t *p = tryRead(address, size);
+    if (p == nullptr)
+    {
+        raise(address, size, READ);
+    }
+    return p;
+}
+
+uint8_t *DataSegment::writeMiss(uint32_t address, uint32_t size)
+{
+    uint8_t *p = tryWrite(address, size);
+    if (p == nullptr)
+    {
+        raise(address, size, WRITE);
+    }
+    return p;
+}
+
+/**
+ * Reads of a page nobody wrote get the zero page. The first write
+ * allocates the page and repoints the read TLB entry at it.
+ */
+uint8_t *DataSegment::resolve(uint32_t address, Permission access)
+{
+    const Region *region = regionOf(address);
+    if (region == nullptr || (region->permissions & access) == 0)
+    {
+        return nullptr;
+    }
+    uint32_t page = address >> PAGE_BITS;
+    uint8_t *data = nullptr;
+    if (access == WRITE)
+    {
+        data = allocate(page)->bytes;
+        TlbEntry &read = this->readTlb[page % TLB_SIZE];
+        if (read.page == page)
+        {
+            read.data = data;
+        }
+        this->writeTlb[page % TLB_SIZE] = {page, data};
+    }
+    else
+    {
+        Page *existing = pageAt(page);
+        data = existing != nullptr ? existing->bytes : const_cast<uint8_t *>(ZERO_PAGE);
+        this->readTlb[page % TLB_SIZE] = {page, data};
+    }
+    return data;
+}
+
+void DataSegment::raise(uint32_t address, uint32_t size, Permission access) const
+{
+    if ((address & (size - 1)) != 0)
+    {
+        throw MemoryFault(MemoryFault::Kind::UNALIGNED, address, std::format("Unaligned {}-byte access to 0x{:08x}", size, address));
+    }
+    if (regionOf(address) == nullptr)
+    {
+        throw MemoryFault(MemoryFault::Kind::UNMAPPED, address, std::format("Access to unmapped address 0x{:08x}", address));
+    }
+    throw MemoryFault(MemoryFault::Kind::PROTECTION, address,
+                      std::format("{} 0x{:08x} is not permitted", access == WRITE ? "Write to" : "Read from", address));
+}
+
+const DataSegment::Region *DataSegment::regionOf(uint32_t address) const
+{
+    for (const Region &region : this->regions)
+    {
+        if (address >= region.start && address < region.end)
+        {
+            return &region;
+        }
+    }
+    return nullptr;
+}
+
+DataSegment::Page *DataSegment::pageAt(uint32_t page) const
+{
+    const std::unique_ptr<Table> &table = this->directory[page >> 10];
+    return table != nullptr ? table->pages[page & 1023].get() : nullptr;
+}
+
+DataSegment::Page *DataSegment::allocate(uint32_t page)
+{
+    std::unique_ptr<Table> &table = this->directory[page >> 10];
+    if (table == nullptr)
+    {
+        table = std::make_unique<Table>();
+    }
+    std::shared_ptr<Page> &slot = table->pages[page & 1023];
+    if (slot == nullptr)
+    {
+        // Value-initialised, so a fresh page reads as zeros
+        slot = std::make_shared<Page>();
+        ++this->resident;
+        this->dirty.push_back(page);
+    }
+    else if (slot.use_count() > 1)
+    {
+        // Still shared with a snapshot
+        slot = std::make_shared<Page>(*slot);
+        this->dirty.push_back(page);
+    }
+    return slot.get();
+}
+
+void DataSegment::flushTlb()
+{
+    this->readTlb.fill({NO_PAGE, nullptr});
+    this->writeTlb.fill({NO_PAGE, nullptr});
+}
@@ -0,0 +1,240 @@
+#include "Debugger.hpp"
+#include "CPU.hpp"
+#include "MIPS.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+// What a breakpoint puts in place of its op
+static constexpr Op BREAK_OP = {Handler::BREAKPOINT, 0, 0, 0, 0};
+
+Debugger::Debugger(CPU &cpu, const MIPS &program)
+    : cpu(cpu), program(program), watchStart(0), watchEnd(0), armed(true), stepsLeft(0), stop{DebugStop::STEPPED, cpu.pc, 0, {}, 0, false},
+      stopped(false), total(0), finished(false), exitCode(0)
+{
+    if (cpu.debugger != nullptr)
+    {
+        throw std::runtime_error("The CPU already has a debugger");
+    }
+    cpu.debugger = this;
+}
+
+Debugger::~Debugger()
+{
+    for (const auto &[index, op] : this->patched)
+    {
+        this->cpu.blocks.patch(index, op);
+    }
+    this->cpu.debugger = nullptr;
+}
+
+uint32_t Debugger::indexOf(std::string_view where) const
+{
+    uint32_t address;
+    auto label = this->program.labelTable.find(where);
+    if (label != this->program.labelTable.end())
+    {
+        address = label->second;
+    }
+    else
+    {
+        try
+        {
+            address = static_cast<uint32_t>(handleValue(where));
+        }
+        catch (const std::exception &)
+        {
+            throw std::runtime_error(std::format("No label or address {}", where));
+        }
+    }
+    const uint32_t offset = address - PC_START;
+    if (offset % 4 != 0 || offset / 4 >= this->program.instructions.size())
+    {
+        throw std::runtime_error(std::format("No instruction at {}", where));
+    }
+    return offset / 4;
+}
+
+uint32_t Debugger::addBreakpoint(std::string_view where)
+{
+    const uint32_t index = indexOf(where);
+    if (!this->patched.contains(index))
+    {
+        this->patched.emplace(index, this->cpu.blocks.patch(index, BREAK_OP));
+    }
+    return PC_START + index * 4;
+}
+
+bool Debugger::removeBreakpoint(std::string_view where)
+{
+    auto it = this->patched.find(indexOf(where));
+    if (it == this->patched.end())
+    {
+        return false;
+    }
+    this->cpu.blocks.patch(it->first, it->second);
+    this->patched.erase(it);
+    return true;
+}
+
+std::vector<uint32_t> Debugger::breakpoints() const
+{
+    std::vector<uint32_t> addresses;
+    for (const auto &entry : this->patched)
+    {
+        addresses.push_back(PC_START + entry.first * 4);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    return addresses;
+}
+
+void Debugger::addWatchpoint(std::string_view symbol, uint8_t access)
+{
+    auto data = this->program.dataTable.find(symbol);
+    if (data == this->program.dataTable.end())
+    {
+        throw std::runtime_error(std::format("No data symbol {}", symbol));
+    }
+    removeWatchpoint(symbol);
+    // A symbol reserving nothing still watches the byte it labels
+    const uint32_t size = std::max<uint32_t>(data->second.size, 1);
+    this->watches.push_back({data->second.address, data->second.address + size, access, std::string(symbol)});
+    bound();
+}
+
+bool Debugger::removeWatchpoint(std::string_view symbol)
+{
+    auto it = std::find_if(this->watches.begin(), this->watches.end(), [symbol](const Watch &watch) { return watch.symbol == symbol; });
+    if (it == this->watches.end())
+    {
+        return false;
+    }
+    this->watches.erase(it);
+    bound();
+    return true;
+}
+
+void Debugger::bound()
+{
+    this->watchStart = 0;
+    this->watchEnd = 0;
+    for (const Watch &watch : this->watches)
+    {
+        this->watchStart = this->watchEnd == 0 ? watch.start : std::min(this->watchStart, watch.start);
+        this->watchEnd = std::max(this->watchEnd, watch.end);
+    }
+}
+
+bool Debugger::hit(uint32_t address, uint32_t size, bool write)
+{
+    for (const Watch &watch : this->watches)
+    {
+        if (address < watch.end && address + size > watch.start && (watch.access & (write ? WRITE : READ)) != 0)
+        {
+            this->stop.reason = DebugStop::WATCHPOINT;
+            this->stop.symbol = watch.symbol;
+            this->stop.address = address;
+            this->stop.write = write;
+            return true;
+        }
+    }
+    return false;
+}
+
+DebugStop Debugger::resume()
+{
+    return go(std::numeric_limits<uint64_t>::max());
+}
+
+DebugStop Debugger::step(uint64_t count)
+{
+    return go(std::max<uint64_t>(count, 1));
+}
+
+/**
+ * After a stop the instruction at pc runs on its own first when a
+ * breakpoint sits on it or a watchpoint stopped before it: the breakpoint
+ * is lifted and the watchpoints disarmed for that one instruction. Before
+ * the first stop a breakpoint at the entry point is hit like any other.
+ */
+DebugStop Debugger::go(uint64_t count)
+{
+    if (this->finished)
+    {
+        return this->stop;
+    }
+    const uint32_t index = (this->cpu.pc - PC_START) / 4;
+    auto breakpoint = this->stopped ? this->patched.find(index) : this->patched.end();
+    const bool watchedHere = this->stopped && this->stop.reason == DebugStop::WATCHPOINT && this->stop.pc == this->cpu.pc;
+    if (breakpoint == this->patched.end() && !watchedHere)
+    {
+        return run(count);
+    }
+
+    if (breakpoint != this->patched.end())
+    {
+        this->cpu.blocks.patch(index, breakpoint->second);
+    }
+    this->armed = !watchedHere;
+    DebugStop first;
+    try
+    {
+        first = run(1);
+    }
+    catch (...)
+    {
+        this->armed = true;
+        if (breakpoint != this->patched.end())
+        {
+            this->cpu.blocks.patch(index, BREAK_OP);
+        }
+        throw;
+    }
+    this->armed = true;
+    if (breakpoint != this->patched.end())
+    {
+        this->cpu.blocks.patch(index, BREAK_OP);
+    }
+    if (first.reason != DebugStop::STEPPED || count == 1)
+    {
+        return first;
+    }
+    return run(count == std::numeric_limits<uint64_t>::max() ? count : count - 1);
+}
+
+DebugStop Debugger::run(uint64_t count)
+{
+    this->stepsLeft = count;
+    this->stopped = false;
+    this->stop = {DebugStop::STEPPED, 0, 0, {}, 0, false};
+    int code;
+    try
+    {
+        code = this->cpu.run();
+    }
+    catch (...)
+    {
+        this->total += this->cpu.executed;
+        throw;
+    }
+    this->total += this->cpu.executed;
+    if (!this->stopped)
+    {
+        this->finished = true;
+        this->exitCode = code;
+        this->stop = {DebugStop::EXITED, this->cpu.pc, code, {}, 0, false};
+    }
+    return this->stop;
+}
+
+uint64_t Debugger::executed() const
+{
+    return this->total;
+}
+
+bool Debugger::exited() const
+{
+    return this->finished;
+}
@@ -1,5 +0,0 @@
-#include "Globals.hpp"
-
-uint32_t PC_START = 0x00400000;        // Declaration
-uint32_t DATA_START = 0x10010000;      // First Address for data
-uint32_t DATA_SEGMENT_SIZE = 0x100000; // 1MB Size for static memory
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "Heap.hpp"
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+Heap::Heap(DataSegment &memory, uint32_t base, uint32_t limit)
+    : memory(memory), start(base), limit(limit), current(base), mappedEnd(base), peak(base), growths(0)
+{
+}
+
+/**
+ * Follows MARS: negative requests and requests past the limit fail, and the
+ * new break is rounded up to the next word
+ */
+uint32_t Heap::sbrk(int32_t bytes)
+{
+    if (bytes < 0)
+    {
+        throw std::runtime_error(std::format("sbrk: request ({}) is a negative heap amount", bytes));
+    }
+    uint64_t next = (static_cast<uint64_t>(this->current) + static_cast<uint32_t>(bytes) + 3) & ~uint64_t{3};
+    if (next >= this->limit)
+    {
+        throw std::runtime_error(std::format("sbrk: request ({}) exceeds available heap storage", bytes));
+    }
+    if (next > this->mappedEnd)
+    {
+        // Grow by at least the current size so repeated small requests stay cheap
+        uint64_t step = std::max<uint64_t>(GROWTH_CHUNK, this->mappedEnd - this->start);
+        uint64_t end = std::max<uint64_t>(next, this->mappedEnd + step);
+        end = std::min<uint64_t>((end + DataSegment::PAGE_SIZE - 1) & ~static_cast<uint64_t>(DataSegment::PAGE_SIZE - 1), this->limit);
+        this->memory.map(this->mappedEnd, static_cast<uint32_t>(end - this->mappedEnd), DataSegment::READ | DataSegment::WRITE);
+        this->mappedEnd = static_cast<uint32_t>(end);
+        ++this->growths;
+    }
+    uint32_t previous = this->current;
+    this->current = static_cast<uint32_t>(next);
+    this->peak = std::max(this->peak, this->current);
+    return previous;
+}
+
+uint32_t Heap::base() const
+{
+    return this->start;
+}
+
+uint32_t Heap::brk() const
+{
+    return this->current;
+}
+
+uint32_t Heap::highWater() const
+{
+    return this->peak - this->start;
+}
+
+uint32_t Heap::mapped() const
+{
+    return this->mappedEnd - this->start;
+}
+
+uint64_t Heap::growthEvents() const
+{
+    return this->growths;
+}
+
+Heap::State Heap::state() const
+{
+    return {this->current, this->mappedEnd, this->peak, this->growths};
+}
+
+void Heap::restore(const State &state)
+{
+    this->current = state.current;
+    this->mappedEnd = state.mappedEnd;
+    this->peak = state.peak;
+    this->growths = state.growths;
+}
@@ -2,33 +2,8 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
-#include <regex>
-
-std::vector<std::string> split(const std::string &s, char delim)
-{
-
-    std::vector<std::string> result;
-    std::stringstream ss(s);
-    std::string item;
-
-    while (getline(ss, item, delim))
-    {
-        if (!item.empty()) // Only add non-empty items
-        {
-            result.push_back(item);
-        }
-    }
-
-    return result;
-}
-
-void validateVectorSize(int expSize, const std::vector<std::string> &toks)
-{
-    if (toks.size() != expSize)
-    {
-        throw std::runtime_error("Incorrect number of tokens for instruction: " + vectorToString(toks));
-    }
-}
+#include <charconv>
+#include <stdexcept>
 
 // Function to convert a signed integer to a binary string
 std::string toBinaryString(int32_t value, std::size_t bitWidth)
@@ -73,29 +48,118 @@ bool fitsIn32Bits(std::int32_t value)
     return value >= std::numeric_limits<std::int32_t>::min() && value <= std::numeric_limits<std::int32_t>::max();
 }
 
-std::int32_t handleValue(const std::string &str)
+int decodeEscape(char c)
+{
+    switch (c)
+    {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    case '0':
+        return '\0';
+    case '\\':
+    case '\'':
+    case '"':
+        return c;
+    default:
+        return -1;
+    }
+}
+
+Literal parseLiteral(std::string_view str, unsigned bits)
 {
-    std::int32_t value;
-    // Check for hexadecimal format
-    if (str.rfind("0x", 0) == 0)
+    if (str.empty())
+    {
+        return {0, LiteralError::EMPTY};
+    }
+    // Character literal
+    if (str.front() == '\'')
+    {
+        int value = -1;
+        if (str.size() == 3 && str[2] == '\'')
+        {
+            value = static_cast<unsigned char>(str[1]);
+        }
+        else if (str.size() == 4 && str[1] == '\\' && str[3] == '\'')
+        {
+            value = decodeEscape(str[2]);
+        }
+        return value < 0 ? Literal{0, LiteralError::INVALID} : Literal{value, LiteralError::NONE};
+    }
+    // Sign
+    std::size_t i = 0;
+    bool negative = false;
+    if (str[0] == '-' || str[0] == '+')
+    {
+        negative = str[0] == '-';
+        i = 1;
+    }
+    if (i >= str.size() || str[i] < '0' || str[i] > '9')
+    {
+        return {0, i == 0 ? LiteralError::NOT_LITERAL : LiteralError::INVALID};
+    }
+    // Base
+    int base = 10;
+    if (i + 1 < str.size() && str[i] == '0' && (str[i + 1] == 'x' || str[i + 1] == 'X'))
+    {
+        base = 16;
+        i += 2;
+    }
+    const char *first = str.data() + i;
+    const char *last = str.data() + str.size();
+    std::uint64_t magnitude = 0;
+    auto [ptr, ec] = std::from_chars(first, last, magnitude, base);
+    if (ec == std::errc::result_out_of_range)
+    {
+        return {0, LiteralError::OUT_OF_RANGE};
+    }
+    if (ec != std::errc() || ptr != last)
+    {
+        return {0, LiteralError::INVALID};
+    }
+    // Range check before narrowing
+    std::int64_t min = bits >= 32 ? std::numeric_limits<std::int32_t>::min() : -(std::int64_t(1) << (bits - 1));
+    std::int64_t max = bits >= 32 ? std::numeric_limits<std::uint32_t>::max() : (std::int64_t(1) << (bits - 1)) - 1;
+    if (magnitude > static_cast<std::uint64_t>(max) + 1)
     {
-        value = std::stoi(str, nullptr, 16); // Convert from hex
+        return {0, LiteralError::OUT_OF_RANGE};
     }
-    else
+    std::int64_t value = negative ? -static_cast<std::int64_t>(magnitude) : static_cast<std::int64_t>(magnitude);
+    if (value < min || value > max)
     {
-        value = std::stoi(str, nullptr, 10); // Convert from decimal
+        return {0, LiteralError::OUT_OF_RANGE};
     }
-    return value;
+    return {static_cast<std::int32_t>(static_cast<std::uint32_t>(value)), LiteralError::NONE};
 }
 
-bool isInteger(const std::string &str)
+std::int32_t handleValue(std::string_view str)
 {
-    std::regex integerRegex("^[+-]?\\d+$");
-    return std::regex_match(str, integerRegex);
+    Literal literal = parseLiteral(str);
+    if (literal.error == LiteralError::OUT_OF_RANGE)
+    {
+        throw std::out_of_range("Value out of range: " + std::string(str));
+    }
+    if (literal.error != LiteralError::NONE)
+    {
+        throw std::invalid_argument("Invalid value: " + std::string(str));
+    }
+    return literal.value;
 }
 
-bool isHexadecimal(const std::string &str)
+std::vector<std::string_view> splitFields(std::string_view text, char separator)
 {
-    std::regex hexRegex("^0[xX][0-9a-fA-F]+$");
-    return std::regex_match(str, hexRegex);
-}
\ No newline at end of file
+    std::vector<std::string_view> fields;
+    for (;;)
+    {
+        std::size_t at = text.find(separator);
+        fields.push_back(text.substr(0, at));
+        if (at == std::string_view::npos)
+        {
+            return fields;
+        }
+        text.remove_prefix(at + 1);
+    }
+}
@@ -4,180 +4,88 @@
 #include <stdexcept>
 #include <format>
 #include <sstream>
-// Mapping Instructions to the correct size for inputs
-const std::unordered_map<std::string, int> Instruction::LAYOUT_INPUT_SIZES = {
-    {"DST", 4},      //  $d, $s, $t
-    {"ST", 3},       // mult $s, $t
-    {"S", 2},        // jr $s
-    {"DTSHA", 4},    // sll $d, $t, shamt
-    {"TSIMM", 4},    // addi $t, $s, imm
-    {"TIMM", 3},     // lui $t, imm
-    {"STOFF", 4},    // beq $s, $t, offset
-    {"TOFFS", 3},    // lw $t, offset($s)
-    {"SOFF", 3},     // bgtz $s, offset
-    {"TARG", 2},     // j target
-    {"SYSCALL", 1}}; // syscall
-
-// Mapping Instructions to their functions that parse them
-const std::unordered_map<std::string, std::function<void(Instruction &, std::vector<std::string> &)>> Instruction::MNEMONIC_FUNCTION_MAP = {
-    {"add", parseDST},  // add $d, $s, $t
-    {"addu", parseDST}, // addu $d, $s, $t
-    {"sub", parseDST},  // sub $d, $s, $t
-    {"subu", parseDST}, // subu $d, $s, $t
-    {"and", parseDST},  // and $d, $s, $t
-    {"or", parseDST},   // or $d, $s, $t
-    {"xor", parseDST},  // xor $d, $s, $t
-    {"nor", parseDST},  // nor $d, $s, $t
-    {"slt", parseDST},  // slt $d, $s, $t
-    {"sltu", parseDST}, // sltu $d, $s, $t
-
-    {"mult", parseST},  // mult $s, $t
-    {"multu", parseST}, // multu $s, $t
-    {"div", parseST},   // div $s, $t
-    {"divu", parseST},  // divu $s, $t
-
-    {"jr", parseS}, // jr $s
-
-    {"sll", parseDTSHA}, // sll $d, $t, shamt
-    {"srl", parseDTSHA}, // srl $d, $t, shamt
-    {"sra", parseDTSHA}, // sra $d, $t, shamt
-
-    {"addi", parseTSIMM},  // addi $t, $s, imm
-    {"addiu", parseTSIMM}, // addiu $t, $s, imm
-    {"andi", parseTSIMM},  // andi $t, $s, imm
-    {"ori", parseTSIMM},   // ori $t, $s, imm
-    {"xori", parseTSIMM},  // xori $t, $s, imm
-    {"slti", parseTSIMM},  // slti $t, $s, imm
-    {"sltiu", parseTSIMM}, // sltiu $t, $s, imm
-
-    {"lui", parseTIMM}, // lui $t, imm
-
-    {"beq", parseSTOFF}, // beq $s, $t, offset
-    {"bne", parseSTOFF}, // bne $s, $t, offset
-
-    {"lw", parseTOFFS},  // lw $t, offset($s)
-    {"sw", parseTOFFS},  // sw $t, offset($s)
-    {"lb", parseTOFFS},  // lb $t, offset($s)
-    {"sb", parseTOFFS},  // sb $t, offset($s)
-    {"lbu", parseTOFFS}, // lbu $t, offset($s)
-    {"lh", parseTOFFS},  // lh $t, offset($s)
-    {"sh", parseTOFFS},  // sh $t, offset($s)
-
-    {"bgtz", parseSOFF}, // bgtz $s, offset
-    {"bltz", parseSOFF}, // bltz $s, offset
-
-    {"j", parseTARG},   // j target
-    {"jal", parseTARG}, // jal target
-
-    {"syscall", parseSyscall} // syscall
-};
-
-// Mapping Instructions to their opcode and function values
-const std::unordered_map<std::string, InstructionInfo> Instruction::INSTRUCTIONMAP = {
-    // Arithmetic and Logical Instructions
-    {"add", {"000000", "100000"}},
-    {"addu", {"000000", "100001"}},
-    {"sub", {"000000", "100010"}},
-    {"subu", {"000000", "100011"}},
-    {"mult", {"000000", "011000"}},
-    {"multu", {"000000", "011001"}},
-    {"div", {"000000", "011010"}},
-    {"divu", {"000000", "011011"}},
-    {"and", {"000000", "100100"}},
-    {"or", {"000000", "100101"}},
-    {"xor", {"000000", "100110"}},
-    {"nor", {"000000", "100111"}},
-    {"sll", {"000000", "000000"}},
-    {"srl", {"000000", "000010"}},
-    {"sra", {"000000", "000011"}},
-    {"slt", {"000000", "101010"}},
-    {"sltu", {"000000", "101011"}},
-
-    // Data Transfer Instructions
-    {"lw", {"100011", ""}},
-    {"sw", {"101011", ""}},
-    {"lb", {"100000", ""}},
-    {"sb", {"101000", ""}},
-    {"lbu", {"100100", ""}},
-    {"lh", {"100001", ""}},
-    {"sh", {"101001", ""}},
-    {"lui", {"001111", ""}},
-
-    // Branch and Jump Instructions
-    {"beq", {"000100", ""}},
-    {"bne", {"000101", ""}},
-    {"bgtz", {"000111", ""}},
-    {"bltz", {"000001", ""}},
-    {"j", {"000010", ""}},
-    {"jal", {"000011", ""}},
-    {"jr", {"000000", "001000"}},
-
-    // Immediate Instructions
-    {"addi", {"001000", ""}},
-    {"addiu", {"001001", ""}},
-    {"andi", {"001100", ""}},
-    {"ori", {"001101", ""}},
-    {"xori", {"001110", ""}},
-    {"slti", {"001010", ""}},
-    {"sltiu", {"001011", ""}},
-    {"li", {"001101", ""}},
-
-    // Special Instructions
-    {"nop", {"000000", "000000"}},
-    {"syscall", {"000000", "001100"}}};
-
-// Mapping Registers to their binary and decimal representations
-const std::unordered_map<std::string, RegisterInfo> Instruction::REGISTER_MAP = {
-    {"", {0, ""}},
-    {"$zero", {0, "00000"}},
-    {"$at", {1, "00001"}},
-    {"$v0", {2, "00010"}},
-    {"$v1", {3, "00011"}},
-    {"$a0", {4, "00100"}},
-    {"$a1", {5, "00101"}},
-    {"$a2", {6, "00110"}},
-    {"$a3", {7, "00111"}},
-    {"$t0", {8, "01000"}},
-    {"$t1", {9, "01001"}},
-    {"$t2", {10, "01010"}},
-    {"$t3", {11, "01011"}},
-    {"$t4", {12, "01100"}},
-    {"$t5", {13, "01101"}},
-    {"$t6", {14, "01110"}},
-    {"$t7", {15, "01111"}},
-    {"$s0", {16, "10000"}},
-    {"$s1", {17, "10001"}},
-    {"$s2", {18, "10010"}},
-    {"$s3", {19, "10011"}},
-    {"$s4", {20, "10100"}},
-    {"$s5", {21, "10101"}},
-    {"$s6", {22, "10110"}},
-    {"$s7", {23, "10111"}},
-    {"$t8", {24, "11000"}},
-    {"$t9", {25, "11001"}},
-    {"$k0", {26, "11010"}},
-    {"$k1", {27, "11011"}},
-    {"$gp", {28, "11100"}},
-    {"$sp", {29, "11101"}},
-    {"$fp", {30, "11110"}},
-    {"$ra", {31, "11111"}}};
-
-Instruction::Instruction(const std::string &curInstruction, uint32_t pc, const std::unordered_map<std::string, uint32_t> &labelTable, const std::unordered_map<std::string, Data> &dataTable)
-    : ASMInstruction(curInstruction), address(pc), labelTable(labelTable), dataTable(dataTable)
+#include <bitset>
+// Register names indexed by number
+const char *const Instruction::REGISTER_NAMES[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"};
+
+Instruction::Instruction()
+    : machine(0), address(0), line(0), imm(0), opcode(0), funct(0), rd(0), rs(0), rt(0)
 {
-    std::vector tokens = split(curInstruction, ' ');
-    std::string mnemonic = tokens[0];
-    if (Instruction::INSTRUCTIONMAP.find(mnemonic) == Instruction::INSTRUCTIONMAP.end())
+}
+
+Instruction::Instruction(std::span<const Token> toks, uint32_t pc, uint32_t line, std::string_view &symbol)
+    : machine(0), address(pc), line(line), imm(0), opcode(0), funct(0), rd(0), rs(0), rt(0)
+{
+    const InstructionInfo *info = Instruction::INSTRUCTIONMAP.find(toks[0].text);
+    if (info == nullptr)
     {
-        throw std::runtime_error("Mnemonic not found: " + mnemonic);
+        throw std::runtime_error("Mnemonic not found: " + std::string(toks[0].text));
     }
-    this->mnemonic = mnemonic;
-    this->opcode = Instruction::INSTRUCTIONMAP.at(this->mnemonic).opcode;
-    this->funct = Instruction::INSTRUCTIONMAP.at(this->mnemonic).funct;
+    this->opcode = info->opcode;
+    this->funct = info->funct;
 
     // Adding registers
-    parseInstruction(*this, tokens);
-    std::cout << *this << std::endl;
+    symbol = {};
+    parseInstruction(info->layout, *this, toks, symbol);
+}
+
+Instruction::Instruction(const InstructionInfo &info, uint8_t rd, uint8_t rs, uint8_t rt, int32_t imm, uint32_t pc, uint32_t line)
+    : machine(0), address(pc), line(line), imm(imm), opcode(info.opcode), funct(info.funct), rd(rd), rs(rs), rt(rt)
+{
+    switch (info.layout)
+    {
+    case Layout::DTSHA:
+        encodeR(static_cast<uint8_t>(imm));
+        break;
+    case Layout::DST:
+    case Layout::ST:
+    case Layout::S:
+    case Layout::D:
+    case Layout::SYSCALL:
+        encodeR();
+        break;
+    case Layout::TARG:
+        encodeJ();
+        break;
+    default:
+        encodeI();
+        break;
+    }
+}
+
+/**
+ * Fields are read back the way the encoders packed them, immediates sign
+ * extended, the shift amount in imm for R-format and the 26-bit target for jumps
+ */
+Instruction Instruction::decode(uint32_t machine, uint32_t address, uint32_t line)
+{
+    Instruction instr;
+    instr.machine = machine;
+    instr.address = address;
+    instr.line = line;
+    instr.opcode = static_cast<uint8_t>(machine >> 26);
+    if (instr.isJump())
+    {
+        instr.imm = static_cast<int32_t>(machine & 0x3FFFFFF);
+        return instr;
+    }
+    instr.rs = static_cast<uint8_t>((machine >> 21) & 0x1F);
+    instr.rt = static_cast<uint8_t>((machine >> 16) & 0x1F);
+    if (instr.opcode == 0)
+    {
+        instr.rd = static_cast<uint8_t>((machine >> 11) & 0x1F);
+        instr.imm = static_cast<int32_t>((machine >> 6) & 0x1F);
+        instr.funct = static_cast<uint8_t>(machine & 0x3F);
+    }
+    else
+    {
+        instr.imm = static_cast<int16_t>(machine & 0xFFFF);
+    }
+    return instr;
 }
 
 Instruction::~Instruction()
@@ -188,443 +96,453 @@ Instruction::~Instruction()
 // Define the operator<< function
 std::ostream &operator<<(std::ostream &os, const Instruction &instruction)
 {
-    os << "Instruction: " << instruction.ASMInstruction << "\n"
-       << "Mnemonic: " << instruction.mnemonic << "\n"
-       << "Opcode: " << instruction.opcode << "\n"
-       << "Funct: " << (instruction.funct.empty() ? "None" : instruction.funct) << "\n"
-       << "Label: " << (instruction.label.empty() ? "None" : instruction.label) << "\n"
-       << "Data: " << (instruction.data.empty() ? "None" : instruction.data) << "\n"
+    os << "Instruction: " << instruction.disassemble() << "\n"
+       << "Mnemonic: " << instruction.mnemonic() << "\n"
+       << "Opcode: " << std::bitset<6>(instruction.opcode) << "\n"
+       << "Funct: " << (instruction.opcode ? "None" : std::bitset<6>(instruction.funct).to_string()) << "\n"
        << "Address: " << "0x" << std::hex << instruction.address << std::dec << "\n" // Format address as hex
        << "Registers: " << "\n"
-       << "  RD Name: " << (instruction.rdName.empty() ? "None" : instruction.rdName) << "\n"
-       << "  RS Name: " << (instruction.rsName.empty() ? "None" : instruction.rsName) << "\n"
-       << "  RT Name: " << (instruction.rtName.empty() ? "None" : instruction.rtName) << "\n"
-       << "Decimal Representations: " << "\n"
-       << "  Immediate: " << instruction.imm << "\n"
-       << "  RD: " << static_cast<int>(instruction.rd) << "\n" // Casting to int for better readability
-       << "  RS: " << static_cast<int>(instruction.rs) << "\n"
-       << "  RT: " << static_cast<int>(instruction.rt) << "\n"
-       << "Binary Representations: " << "\n"
-       << "  RD Bit: " << (instruction.rdBit.empty() ? "None" : instruction.rdBit) << "\n"
-       << "  RS Bit: " << (instruction.rsBit.empty() ? "None" : instruction.rsBit) << "\n"
-       << "  RT Bit: " << (instruction.rtBit.empty() ? "None" : instruction.rtBit) << "\n"
-       << "  Immediate Bit: " << (instruction.immBit.empty() ? "None" : instruction.immBit) << "\n"
-       << "Machine Code: " << instruction.machine << "\n";
+       << "  RD: " << Instruction::REGISTER_NAMES[instruction.rd] << " (" << static_cast<int>(instruction.rd) << ")\n"
+       << "  RS: " << Instruction::REGISTER_NAMES[instruction.rs] << " (" << static_cast<int>(instruction.rs) << ")\n"
+       << "  RT: " << Instruction::REGISTER_NAMES[instruction.rt] << " (" << static_cast<int>(instruction.rt) << ")\n"
+       << "Immediate: " << instruction.imm << "\n"
+       << "Machine Code: " << instruction.machineBits() << "\n";
 
     return os;
 }
 
-std::string Instruction::buildMachine(std::string one, std::string two = "", std::string three = "", std::string four = "", std::string five = "", std::string six = "")
+/**
+ * Replaces the immediate (or 26-bit target) field of the machine code
+ */
+void Instruction::patch(int32_t value)
 {
-    std::ostringstream oss;
-    oss << one << two << three << four << five << six;
-    std::string machine = oss.str();
-    if (machine.length() != 32)
+    this->imm = value;
+    if (isJump())
+    {
+        encodeJ();
+    }
+    else
     {
-        std::ostringstream oss;
-        oss << "Invalid machine code length: " << machine.size();
-        throw std::range_error(oss.str());
+        encodeI();
     }
-    return machine;
+}
+
+bool Instruction::isJump() const
+{
+    return this->opcode == 0b000010 || this->opcode == 0b000011;
 }
 
 /**
- * Validates if a register is valid and returns the infor
+ * Looks the mnemonic back up from the opcode and funct
  */
-RegisterInfo Instruction::validateRegister(const std::string &reg)
+std::string Instruction::mnemonic() const
 {
-    try
+    for (const InstructionInfo &info : Instruction::INSTRUCTIONMAP.all())
     {
-        RegisterInfo regInfo = Instruction::REGISTER_MAP.at(reg);
-        return regInfo;
-    }
-    catch (const std::out_of_range &e)
-    {
-        throw std::runtime_error("Invalid register: " + reg);
+        // nop shares its encoding with sll
+        if (info.name == "nop")
+        {
+            continue;
+        }
+        if (info.opcode == this->opcode && (this->opcode != 0 || info.funct == this->funct))
+        {
+            return std::string(info.name);
+        }
     }
+    return "unknown";
 }
 
-/**
- * Setting a register to their according values
- */
-void Instruction::setRegisters(std::string &reg, std::string &regName, uint8_t &dec, std::string &bit)
+std::string Instruction::machineBits() const
 {
-    RegisterInfo regInfo = validateRegister(reg);
-    regName = reg;
-    dec = regInfo.decVal;
-    bit = regInfo.binStr;
+    return std::bitset<32>(this->machine).to_string();
 }
 
 /**
- * Setting a register to their according values
+ * Formats the instruction back into assembly text
  */
-void Instruction::setOffset(std::string &offset, Instruction &instr)
+std::string Instruction::disassemble() const
 {
-    auto dataKey = instr.dataTable.find(offset);
-    auto labelKey = instr.labelTable.find(offset);
-    // Check if lable or value
-    if (isInteger(offset) || isHexadecimal(offset))
+    const char *d = REGISTER_NAMES[this->rd];
+    const char *s = REGISTER_NAMES[this->rs];
+    const char *t = REGISTER_NAMES[this->rt];
+    std::string name = mnemonic();
+    if (this->opcode == 0)
     {
-        std::int32_t imm = handleValue(offset);
-        if (!fitsIn16Bits(imm))
+        switch (this->funct)
         {
-            std::string output = std::format("Instruction: {} contains invalid immediate", instr.ASMInstruction);
-            throw std::out_of_range(output);
+        case 0b000000:
+        case 0b000010:
+        case 0b000011:
+            return std::format("{} {}, {}, {}", name, d, t, this->imm);
+        case 0b001000:
+            return std::format("{} {}", name, s);
+        case 0b010000:
+        case 0b010010:
+            return std::format("{} {}", name, d);
+        case 0b001100:
+            return name;
+        case 0b011000:
+        case 0b011001:
+        case 0b011010:
+        case 0b011011:
+            return std::format("{} {}, {}", name, s, t);
+        default:
+            return std::format("{} {}, {}, {}", name, d, s, t);
         }
-        instr.imm = static_cast<std::int16_t>(imm);
-        instr.immBit = toBinaryString(instr.imm, 16);
-        instr.label = "";
-        instr.data = "";
     }
-    // Checking if offset is data
-    else if (dataKey != instr.dataTable.end())
+    if (isJump())
     {
-        // Setting value
-        instr.data = offset;
-        instr.label = "";
-        // Data value
-        Data dataTarget = dataKey->second;
-        int16_t newOffset = static_cast<std::int16_t>(dataTarget.address - DATA_START);
-        instr.imm = newOffset;
-        instr.immBit = toBinaryString(instr.imm, 16);
+        return std::format("{} 0x{:x}", name, static_cast<uint32_t>(this->imm) << 2);
     }
-    else if (labelKey != instr.labelTable.end())
+    if (this->opcode == 0b000100 || this->opcode == 0b000101)
     {
-        // Setting value
-        instr.data = "";
-        instr.label = offset;
-        // Data value
-        uint32_t labelTarget = labelKey->second;
-        int16_t newOffset = static_cast<std::int16_t>((labelTarget - (instr.address + 4)) / 4);
-        instr.imm = newOffset;
-        instr.immBit = toBinaryString(instr.imm, 16);
+        return std::format("{} {}, {}, {}", name, s, t, this->imm);
     }
-    else
+    if (this->opcode == 0b000111 || this->opcode == 0b000001)
+    {
+        return std::format("{} {}, {}", name, s, this->imm);
+    }
+    if (this->opcode == 0b001111)
+    {
+        return std::format("{} {}, {}", name, t, this->imm);
+    }
+    if (this->opcode & 0b100000)
     {
-        throw std::runtime_error("Error: String is not a valid offset: " + offset);
+        return std::format("{} {}, {}({})", name, t, this->imm, s);
     }
+    return std::format("{} {}, {}, {}", name, t, s, this->imm);
+}
+
+/**
+ * Format: opcode | rs | rt | rd | shamt | funct
+ */
+void Instruction::encodeR(uint8_t shamt)
+{
+    this->machine = (static_cast<uint32_t>(this->opcode) << 26) | (static_cast<uint32_t>(this->rs) << 21) |
+                    (static_cast<uint32_t>(this->rt) << 16) | (static_cast<uint32_t>(this->rd) << 11) |
+                    (static_cast<uint32_t>(shamt) << 6) | this->funct;
+}
+
+/**
+ * Format: opcode | rs | rt | imm
+ */
+void Instruction::encodeI()
+{
+    this->machine = (static_cast<uint32_t>(this->opcode) << 26) | (static_cast<uint32_t>(this->rs) << 21) |
+                    (static_cast<uint32_t>(this->rt) << 16) | (static_cast<uint32_t>(this->imm) & 0xFFFF);
+}
+
+/**
+ * Format: opcode | target
+ */
+void Instruction::encodeJ()
+{
+    this->machine = (static_cast<uint32_t>(this->opcode) << 26) | (static_cast<uint32_t>(this->imm) & 0x3FFFFFF);
+}
+
+/**
+ * Validates if a register is valid and returns the infor
+ */
+RegisterInfo Instruction::validateRegister(std::string_view reg)
+{
+    const RegisterInfo *regInfo = Instruction::REGISTER_MAP.find(reg);
+    if (regInfo == nullptr)
+    {
+        throw std::runtime_error("Invalid register: " + std::string(reg));
+    }
+    return *regInfo;
 }
 
 /**
  * Setting a register to their according values
  */
-void Instruction::setIMM(std::string &immStr, Instruction &instr)
+void Instruction::setRegisters(std::string_view reg, uint8_t &dec)
+{
+    dec = validateRegister(reg).decVal;
+}
+
+/**
+ * Setting an offset, symbols are left as zero for the parser to patch
+ */
+void Instruction::setOffset(std::string_view offset, Instruction &instr, std::string_view &symbol)
 {
     // Check if lable or value
-    if (isInteger(immStr) || isHexadecimal(immStr))
+    Literal literal = parseLiteral(offset, 16);
+    switch (literal.error)
     {
-        std::int32_t imm = handleValue(immStr);
-        if (!fitsIn16Bits(imm))
-        {
-            std::string output = std::format("Instruction: {} contains invalid immediate", instr.ASMInstruction);
-            throw std::out_of_range(output);
-        }
-        instr.imm = static_cast<std::int16_t>(imm);
-        instr.immBit = toBinaryString(instr.imm, 16);
-        instr.label = "";
+    case LiteralError::NONE:
+        instr.imm = literal.value;
+        break;
+    case LiteralError::NOT_LITERAL:
+        // Label or data resolved through a fixup
+        symbol = offset;
+        instr.imm = 0;
+        break;
+    case LiteralError::OUT_OF_RANGE:
+        throw std::out_of_range("Offset out of range: " + std::string(offset));
+    default:
+        throw std::runtime_error("Error: String is not a valid offset: " + std::string(offset));
     }
-    else
+}
+
+/**
+ * Setting a register to their according values
+ */
+void Instruction::setIMM(std::string_view immStr, Instruction &instr)
+{
+    Literal literal = parseLiteral(immStr, 16);
+    if (literal.error == LiteralError::OUT_OF_RANGE)
     {
-        throw std::runtime_error("Error: String is not a valid integer: " + immStr);
+        throw std::out_of_range("Immediate out of range: " + std::string(immStr));
     }
+    if (literal.error != LiteralError::NONE)
+    {
+        throw std::runtime_error("Error: String is not a valid integer: " + std::string(immStr));
+    }
+    instr.imm = literal.value;
 }
 
 /**
  * Parses all instructions with specific layouts
  */
-void Instruction::parseInstruction(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseInstruction(Layout layout, Instruction &instr, std::span<const Token> toks, std::string_view &symbol)
 {
-    try
-    {
-        auto func = Instruction::MNEMONIC_FUNCTION_MAP.at(instr.mnemonic);
-        func(instr, toks);
-    }
-    catch (const std::out_of_range &e)
+    switch (layout)
     {
-        throw std::runtime_error("Mnemonic not mapped to a function");
+    case Layout::DST:
+        return parseDST(instr, toks);
+    case Layout::ST:
+        return parseST(instr, toks);
+    case Layout::S:
+        return parseS(instr, toks);
+    case Layout::D:
+        return parseD(instr, toks);
+    case Layout::DTSHA:
+        return parseDTSHA(instr, toks);
+    case Layout::TSIMM:
+        return parseTSIMM(instr, toks);
+    case Layout::TIMM:
+        return parseTIMM(instr, toks);
+    case Layout::STOFF:
+        return parseSTOFF(instr, toks, symbol);
+    case Layout::TOFFS:
+        return parseTOFFS(instr, toks, symbol);
+    case Layout::SOFF:
+        return parseSOFF(instr, toks, symbol);
+    case Layout::TARG:
+        return parseTARG(instr, toks, symbol);
+    case Layout::SYSCALL:
+        return parseSyscall(instr, toks);
     }
+    throw std::runtime_error("Mnemonic not mapped to a function");
 }
 
 /**
  * Format:
  * mnemonic $d, $s, $t
  */
-void Instruction::parseDST(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseDST(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("DST"), toks);
+    validateTokenCount(layoutSize(Layout::DST), toks);
     // Register $d
-    setRegisters(toks[1], instr.rdName, instr.rd, instr.rdBit);
+    setRegisters(toks[1].text, instr.rd);
     // Register $s
-    setRegisters(toks[2], instr.rsName, instr.rs, instr.rsBit);
+    setRegisters(toks[2].text, instr.rs);
     // Register $t
-    setRegisters(toks[3], instr.rtName, instr.rt, instr.rtBit);
-    // Setting everything else to none
-    instr.label = "";
-    instr.data = "";
-    instr.imm = 255;
-    instr.immBit = "";
+    setRegisters(toks[3].text, instr.rt);
     // Making machine code
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, instr.rdBit, "00000", instr.funct);
+    instr.encodeR();
 }
 
 /**
  * Format:
  * mnemonic $s, $t
  */
-void Instruction::parseST(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseST(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("ST"), toks);
+    validateTokenCount(layoutSize(Layout::ST), toks);
     // Register $s
-    setRegisters(toks[1], instr.rsName, instr.rs, instr.rsBit);
+    setRegisters(toks[1].text, instr.rs);
     // Register $t
-    setRegisters(toks[2], instr.rtName, instr.rt, instr.rtBit);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    instr.label = "";
-    instr.data = "";
-    instr.imm = 255;
-    instr.immBit = "";
+    setRegisters(toks[2].text, instr.rt);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, "0000000000", instr.funct);
+    instr.encodeR();
 }
 
 /**
  * Format:
  * mnemonic $s
  */
-void Instruction::parseS(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseS(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("S"), toks);
+    validateTokenCount(layoutSize(Layout::S), toks);
     // Register $s
-    setRegisters(toks[1], instr.rsName, instr.rs, instr.rsBit);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    setRegisters(reg, instr.rtName, instr.rt, instr.rtBit);
-    instr.label = "";
-    instr.data = "";
-    instr.imm = 255;
-    instr.immBit = "";
+    setRegisters(toks[1].text, instr.rs);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, "000000000000000", instr.funct);
+    instr.encodeR();
+}
+
+/**
+ * Format:
+ * mnemonic $d
+ */
+void Instruction::parseD(Instruction &instr, std::span<const Token> toks)
+{
+    // Size check
+    validateTokenCount(layoutSize(Layout::D), toks);
+    // Register $d
+    setRegisters(toks[1].text, instr.rd);
+    // Machine
+    instr.encodeR();
 }
 
 /**
  * Format:
  * mnemonic $d, $t shamt
  */
-void Instruction::parseDTSHA(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseDTSHA(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("DTSHA"), toks);
+    validateTokenCount(layoutSize(Layout::DTSHA), toks);
     // Register $d
-    setRegisters(toks[1], instr.rdName, instr.rd, instr.rdBit);
+    setRegisters(toks[1].text, instr.rd);
     // Register $t
-    setRegisters(toks[2], instr.rtName, instr.rt, instr.rtBit);
+    setRegisters(toks[2].text, instr.rt);
     // Immediate
-    if (isInteger(toks[3]) || isHexadecimal(toks[3]))
+    Literal literal = parseLiteral(toks[3].text);
+    if (literal.error != LiteralError::NONE)
     {
-        std::int32_t imm = handleValue(toks[3]);
-        if (!fitsIn16Bits(imm))
-        {
-            std::string output = std::format("Instruction: {} contains invalid immediate", instr.ASMInstruction);
-            throw std::out_of_range(output);
-        }
-        instr.imm = static_cast<std::int16_t>(imm);
-        instr.immBit = toBinaryString(instr.imm, 5);
+        throw std::invalid_argument("Invalid shamt: " + tokensToString(toks));
     }
-    else
+    if (literal.value < 0 || literal.value > 31)
     {
-        throw std::invalid_argument("Invalid shamt: " + instr.ASMInstruction);
+        throw std::out_of_range("Invalid shamt: " + tokensToString(toks));
     }
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-    instr.label = "";
-    instr.data = "";
+    instr.imm = literal.value;
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, "00000", instr.rtBit, instr.rdBit, instr.immBit);
+    instr.encodeR(static_cast<uint8_t>(instr.imm));
 }
 
 /**
  * Format:
  * mnemonic $t, $s imm
  */
-void Instruction::parseTSIMM(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseTSIMM(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("TSIMM"), toks);
+    validateTokenCount(layoutSize(Layout::TSIMM), toks);
     // Register $t
-    setRegisters(toks[1], instr.rtName, instr.rt, instr.rtBit);
+    setRegisters(toks[1].text, instr.rt);
     // Register $s
-    setRegisters(toks[2], instr.rsName, instr.rs, instr.rsBit);
+    setRegisters(toks[2].text, instr.rs);
     // Immediate
-    setIMM(toks[3], instr);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    instr.label = "";
-    instr.data = "";
+    setIMM(toks[3].text, instr);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, instr.immBit);
+    instr.encodeI();
 }
 
 /**
  * Format:
  * mnemonic $t, imm
  */
-void Instruction::parseTIMM(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseTIMM(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("TIMM"), toks);
+    validateTokenCount(layoutSize(Layout::TIMM), toks);
     // Register $t
-    setRegisters(toks[1], instr.rtName, instr.rt, instr.rtBit);
+    setRegisters(toks[1].text, instr.rt);
     // Immediate
-    setIMM(toks[2], instr);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-    instr.label = "";
-    instr.data = "";
+    setIMM(toks[2].text, instr);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, "00000", instr.rtBit, instr.immBit);
+    instr.encodeI();
 }
 
 /**
  * Format:
  * mnemonic $s, $t, offset
  */
-void Instruction::parseSTOFF(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseSTOFF(Instruction &instr, std::span<const Token> toks, std::string_view &symbol)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("STOFF"), toks);
+    validateTokenCount(layoutSize(Layout::STOFF), toks);
     // Register $s
-    setRegisters(toks[1], instr.rsName, instr.rs, instr.rsBit);
+    setRegisters(toks[1].text, instr.rs);
     // Register $t
-    setRegisters(toks[2], instr.rtName, instr.rt, instr.rtBit);
+    setRegisters(toks[2].text, instr.rt);
     // Immediate
-    setOffset(toks[2], instr);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
+    setOffset(toks[3].text, instr, symbol);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, instr.immBit);
+    instr.encodeI();
 }
 
 /**
  * Format:
  * mnemonic $t, offset($s)
  */
-void Instruction::parseTOFFS(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseTOFFS(Instruction &instr, std::span<const Token> toks, std::string_view &symbol)
 {
 
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("TOFFS"), toks);
+    validateTokenCount(layoutSize(Layout::TOFFS), toks);
     // Register $t
-    setRegisters(toks[1], instr.rtName, instr.rt, instr.rtBit);
-    // Offset
-    std::string &combo = toks[2];
-    // Find the positions of the parentheses
-    int open = combo.find('(');
-    int close = combo.find(')');
-    // Check if both parentheses are present
-    auto dataKey = instr.dataTable.find(toks[2]);
-    if (open != std::string::npos && close != std::string::npos)
+    setRegisters(toks[1].text, instr.rt);
+    // Offset and register $s
+    if (toks[2].type == TokenType::MEMORY)
     {
-        // Offset
-        std::string imm = combo.substr(0, open);
-        setOffset(imm, instr);
-        // Register $s
-        std::string reg = combo.substr(open + 1, close - open - 1);
-        setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-    }
-    // Checking if offset is data
-    else if (dataKey != instr.dataTable.end())
-    {
-
-        // Setting value
-        instr.data = toks[2];
-        instr.label = "";
-        std::string reg = "$at";
-        setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-        // Data value
-        Data dataTarget = dataKey->second;
-        int16_t newOffset = static_cast<std::int16_t>(dataTarget.address - DATA_START);
-        instr.imm = newOffset;
-        instr.immBit = toBinaryString(instr.imm, 16);
-        instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, instr.immBit);
+        // An empty offset as in ($sp) is zero
+        setOffset(toks[2].text.empty() ? "0" : toks[2].text, instr, symbol);
+        setRegisters(toks[2].base, instr.rs);
     }
     else
     {
-        throw std::runtime_error("Invalid offset($s) or offset for instruction (" + instr.ASMInstruction + ") with offset: " + toks[2]);
+        // Bare labels are expanded with $at by the parser
+        throw std::runtime_error("Invalid offset($s) for instruction " + tokensToString(toks) + " with offset: " + std::string(toks[2].text));
     }
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
     // Machine Code
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, instr.rtBit, instr.immBit);
+    instr.encodeI();
 }
 
 /**
  * Format:
  * mnemonic $s, offset
  */
-void Instruction::parseSOFF(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseSOFF(Instruction &instr, std::span<const Token> toks, std::string_view &symbol)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("SOFF"), toks);
+    validateTokenCount(layoutSize(Layout::SOFF), toks);
     // Register $s
-    setRegisters(toks[1], instr.rsName, instr.rs, instr.rsBit);
+    setRegisters(toks[1].text, instr.rs);
     // Immediate
-    setOffset(toks[2], instr);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    setRegisters(reg, instr.rtName, instr.rt, instr.rtBit);
+    setOffset(toks[2].text, instr, symbol);
     // Machine Code
-    instr.machine = instr.buildMachine(instr.opcode, instr.rsBit, "00000", instr.immBit);
+    instr.encodeI();
 }
 
 /**
  * Format:
  * mnemonic target
  */
-void Instruction::parseTARG(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseTARG(Instruction &instr, std::span<const Token> toks, std::string_view &symbol)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("TARG"), toks);
+    validateTokenCount(layoutSize(Layout::TARG), toks);
     // Setting target
-    setOffset(toks[1], instr);
-    instr.immBit = toBinaryString(instr.imm, 26);
-    // Setting registers to null
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-    setRegisters(reg, instr.rtName, instr.rt, instr.rtBit);
+    setOffset(toks[1].text, instr, symbol);
     // Machine
-    instr.machine = instr.buildMachine(instr.opcode, instr.immBit);
+    instr.encodeJ();
 }
 
 /**
  * Format:
  * syscall
+ * nop
  */
-void Instruction::parseSyscall(Instruction &instr, std::vector<std::string> &toks)
+void Instruction::parseSyscall(Instruction &instr, std::span<const Token> toks)
 {
     // Size check
-    validateVectorSize(Instruction::LAYOUT_INPUT_SIZES.at("SYSCALL"), toks);
-    instr.label = "";
-    instr.data = "";
-    instr.imm = 255;
-    instr.immBit = "";
-    std::string reg = "";
-    setRegisters(reg, instr.rdName, instr.rd, instr.rdBit);
-    setRegisters(reg, instr.rsName, instr.rs, instr.rsBit);
-    setRegisters(reg, instr.rtName, instr.rt, instr.rtBit);
-    instr.machine = instr.buildMachine(instr.opcode, "00000000000000000000", instr.funct);
+    validateTokenCount(layoutSize(Layout::SYSCALL), toks);
+    instr.encodeR();
 }
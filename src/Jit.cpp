@@ -0,0 +1,526 @@
+#include "Jit.hpp"
+#include "Globals.hpp"
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+#if MIPS_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Executable memory reserved up front, compiling stops once it is full
+static constexpr std::size_t CODE_BUFFER_SIZE = 32 << 20;
+
+#if MIPS_JIT_SUPPORTED
+namespace
+{
+// x86-64 register numbers as they appear in ModRM fields
+constexpr uint8_t EAX = 0;
+constexpr uint8_t ECX = 1;
+constexpr uint8_t EDX = 2;
+constexpr uint8_t EBX = 3;
+constexpr uint8_t ESI = 6;
+
+// Condition codes of the short jcc forms (0x70 | cc) and setcc
+constexpr uint8_t JNO = 0x71;
+constexpr uint8_t JE = 0x74;
+constexpr uint8_t JNE = 0x75;
+constexpr uint8_t JA = 0x77;
+constexpr uint8_t JNS = 0x79;
+constexpr uint8_t JGE = 0x7D;
+constexpr uint8_t JLE = 0x7E;
+constexpr uint8_t SETB = 0x92;
+constexpr uint8_t SETL = 0x9C;
+
+/**
+ * Byte-level x86-64 encoder for the handful of forms the translation
+ * needs. Guest registers are memory operands off rbx, which holds the
+ * register file for the whole block.
+ */
+class Emitter
+{
+public:
+    std::vector<uint8_t> code;
+
+    std::size_t size() const
+    {
+        return this->code.size();
+    }
+
+    void bytes(std::initializer_list<uint8_t> list)
+    {
+        this->code.insert(this->code.end(), list);
+    }
+
+    void imm32(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            this->code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void imm64(uint64_t value)
+    {
+        imm32(static_cast<uint32_t>(value));
+        imm32(static_cast<uint32_t>(value >> 32));
+    }
+
+    // opcode with a [rbx + disp] operand, reg goes in the ModRM reg field
+    void rbxOperand(std::initializer_list<uint8_t> opcode, uint8_t reg, int32_t disp)
+    {
+        bytes(opcode);
+        if (disp >= -128 && disp <= 127)
+        {
+            bytes({static_cast<uint8_t>(0x40 | (reg << 3) | EBX), static_cast<uint8_t>(disp)});
+        }
+        else
+        {
+            bytes({static_cast<uint8_t>(0x80 | (reg << 3) | EBX)});
+            imm32(static_cast<uint32_t>(disp));
+        }
+    }
+
+    // mov reg, [rbx + disp]
+    void load(uint8_t reg, int32_t disp)
+    {
+        rbxOperand({0x8B}, reg, disp);
+    }
+
+    // mov [rbx + disp], reg
+    void store(int32_t disp, uint8_t reg)
+    {
+        rbxOperand({0x89}, reg, disp);
+    }
+
+    // mov dword [rbx + disp], value
+    void storeImm(int32_t disp, uint32_t value)
+    {
+        rbxOperand({0xC7}, 0, disp);
+        imm32(value);
+    }
+
+    // setcc al; movzx eax, al
+    void setFlag(uint8_t cc)
+    {
+        bytes({0x0F, cc, 0xC0, 0x0F, 0xB6, 0xC0});
+    }
+
+    // Short jump with its displacement left to bind()
+    std::size_t jumpShort(uint8_t opcode)
+    {
+        bytes({opcode, 0});
+        return size() - 1;
+    }
+
+    void bind(std::size_t at)
+    {
+        std::size_t distance = size() - (at + 1);
+        if (distance > 127)
+        {
+            throw std::logic_error("JIT short jump out of range");
+        }
+        this->code[at] = static_cast<uint8_t>(distance);
+    }
+
+    // jmp rel32 with its displacement left to bindNear()
+    std::size_t jumpNear()
+    {
+        bytes({0xE9});
+        imm32(0);
+        return size() - 4;
+    }
+
+    void bindNear(std::size_t at, std::size_t target)
+    {
+        uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&this->code[at], &rel, 4);
+    }
+
+    // mov rax, address; call rax
+    void call(const void *function)
+    {
+        bytes({0x48, 0xB8});
+        imm64(reinterpret_cast<uint64_t>(function));
+        bytes({0xFF, 0xD0});
+    }
+};
+
+// add, sub, and, or, xor with eax as destination and a memory source
+uint8_t aluOpcode(Handler handler)
+{
+    switch (handler)
+    {
+    case Handler::ADD:
+    case Handler::ADDU:
+        return 0x03;
+    case Handler::SUB:
+    case Handler::SUBU:
+        return 0x2B;
+    case Handler::AND:
+        return 0x23;
+    case Handler::XOR:
+        return 0x33;
+    default:
+        return 0x0B;
+    }
+}
+
+// Byte offset of a guest register in the register file
+int32_t reg(uint8_t number)
+{
+    return static_cast<int32_t>(number) * 4;
+}
+} // namespace
+#endif
+
+Jit::Jit(const JitTarget &target)
+    : target(target), buffer(nullptr), capacity(0), used(0), compiled(0)
+{
+#if MIPS_JIT_SUPPORTED
+    void *memory = ::mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED)
+    {
+        this->buffer = static_cast<uint8_t *>(memory);
+        this->capacity = CODE_BUFFER_SIZE;
+    }
+#endif
+}
+
+Jit::~Jit()
+{
+#if MIPS_JIT_SUPPORTED
+    if (this->buffer != nullptr)
+    {
+        ::munmap(this->buffer, this->capacity);
+    }
+#endif
+}
+
+/**
+ * Code is built in a scratch vector where every jump is relative, then
+ * copied into the buffer, which is only writable while the copy happens
+ */
+NativeBlock Jit::compile(const Block &block)
+{
+#if MIPS_JIT_SUPPORTED
+    if (this->buffer == nullptr)
+    {
+        return nullptr;
+    }
+    const JitTarget &t = this->target;
+    Emitter e;
+    std::vector<std::size_t> toEpilogue;
+
+    // push rbx; push r12; push r13 keeps rsp 16-byte aligned for the hook calls
+    e.bytes({0x53, 0x41, 0x54, 0x41, 0x55});
+    // mov rbx, rdi; mov r12, rsi
+    e.bytes({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+    const std::size_t body = e.size();
+
+    // Leaves with retired instructions counted, continuing at op index
+    auto leave = [&](uint32_t retired, uint32_t index)
+    {
+        if (retired > 0)
+        {
+            // add qword [rbx + executed], retired
+            e.rbxOperand({0x48, 0x81}, 0, t.executedOffset);
+            e.imm32(retired);
+        }
+        if (index == block.start && retired == block.instructions)
+        {
+            // mov rax, [rbx + executed]; add rax, instructions; cmp rax, [rbx + limit]
+            // loops while another pass stays within the limit
+            e.rbxOperand({0x48, 0x8B}, EAX, t.executedOffset);
+            e.bytes({0x48, 0x05});
+            e.imm32(block.instructions);
+            e.rbxOperand({0x48, 0x3B}, EAX, t.limitOffset);
+            std::size_t limited = e.jumpShort(JA);
+            std::size_t at = e.jumpNear();
+            e.bindNear(at, body);
+            e.bind(limited);
+        }
+        e.bytes({0xB8});
+        e.imm32(index);
+        toEpilogue.push_back(e.jumpNear());
+    };
+    // Hands the op at position and the rest of the block to the interpreter
+    auto fallBack = [&](uint32_t position)
+    {
+        leave(position, (block.start + position) | INTERPRET);
+    };
+    // Unless the preceding jcc skips it, falls back before the op at position
+    auto trap = [&](uint8_t skip, uint32_t position)
+    {
+        std::size_t at = e.jumpShort(skip);
+        fallBack(position);
+        e.bind(at);
+    };
+
+    for (uint32_t position = 0; position < block.ops.size(); ++position)
+    {
+        const Op &op = block.ops[position];
+        const uint32_t imm = static_cast<uint32_t>(op.imm);
+        switch (op.handler)
+        {
+        case Handler::ADD:
+        case Handler::ADDU:
+        case Handler::SUB:
+        case Handler::SUBU:
+        case Handler::AND:
+        case Handler::OR:
+        case Handler::XOR:
+        case Handler::NOR:
+        {
+            e.load(EAX, reg(op.rs));
+            e.rbxOperand({aluOpcode(op.handler)}, EAX, reg(op.rt));
+            if (op.handler == Handler::ADD || op.handler == Handler::SUB)
+            {
+                trap(JNO, position);
+            }
+            else if (op.handler == Handler::NOR)
+            {
+                // not eax
+                e.bytes({0xF7, 0xD0});
+            }
+            // add and sub into $zero only remain for their trap
+            if (op.rd != 0)
+            {
+                e.store(reg(op.rd), EAX);
+            }
+            break;
+        }
+        case Handler::SLT:
+        case Handler::SLTU:
+            e.load(EAX, reg(op.rs));
+            e.rbxOperand({0x3B}, EAX, reg(op.rt));
+            e.setFlag(op.handler == Handler::SLT ? SETL : SETB);
+            e.store(reg(op.rd), EAX);
+            break;
+        case Handler::SLL:
+        case Handler::SRL:
+        case Handler::SRA:
+            e.load(EAX, reg(op.rt));
+            e.bytes({0xC1, op.handler == Handler::SLL ? uint8_t{0xE0} : op.handler == Handler::SRL ? uint8_t{0xE8} : uint8_t{0xF8}, static_cast<uint8_t>(imm)});
+            e.store(reg(op.rd), EAX);
+            break;
+        case Handler::MULT:
+        case Handler::MULTU:
+            // imul or mul dword [rbx + rt] into edx:eax
+            e.load(EAX, reg(op.rs));
+            e.rbxOperand({0xF7}, op.handler == Handler::MULT ? 5 : 4, reg(op.rt));
+            e.store(t.loOffset, EAX);
+            e.store(t.hiOffset, EDX);
+            break;
+        case Handler::DIV:
+        {
+            // Zero divisors leave HI and LO alone and INT_MIN / -1 gives INT_MIN, 0 as in the interpreter
+            e.load(EAX, reg(op.rs));
+            e.load(ECX, reg(op.rt));
+            e.bytes({0x85, 0xC9});
+            std::size_t zero = e.jumpShort(JE);
+            e.bytes({0x83, 0xF9, 0xFF});
+            std::size_t divide = e.jumpShort(JNE);
+            e.bytes({0x3D});
+            e.imm32(0x80000000);
+            std::size_t divide2 = e.jumpShort(JNE);
+            e.store(t.loOffset, EAX);
+            e.storeImm(t.hiOffset, 0);
+            std::size_t done = e.jumpShort(0xEB);
+            e.bind(divide);
+            e.bind(divide2);
+            // cdq; idiv ecx
+            e.bytes({0x99, 0xF7, 0xF9});
+            e.store(t.loOffset, EAX);
+            e.store(t.hiOffset, EDX);
+            e.bind(zero);
+            e.bind(done);
+            break;
+        }
+        case Handler::DIVU:
+        {
+            e.load(EAX, reg(op.rs));
+            e.load(ECX, reg(op.rt));
+            e.bytes({0x85, 0xC9});
+            std::size_t zero = e.jumpShort(JE);
+            // xor edx, edx; div ecx
+            e.bytes({0x31, 0xD2, 0xF7, 0xF1});
+            e.store(t.loOffset, EAX);
+            e.store(t.hiOffset, EDX);
+            e.bind(zero);
+            break;
+        }
+        case Handler::MFHI:
+        case Handler::MFLO:
+            e.load(EAX, op.handler == Handler::MFHI ? t.hiOffset : t.loOffset);
+            e.store(reg(op.rd), EAX);
+            break;
+        case Handler::NOP:
+            break;
+        case Handler::LUI:
+            e.storeImm(reg(op.rt), imm);
+            break;
+        case Handler::ADDI:
+        case Handler::ADDIU:
+        case Handler::ANDI:
+        case Handler::ORI:
+        case Handler::XORI:
+        {
+            // op eax, imm32
+            static constexpr uint8_t OPCODES[] = {0x05, 0x05, 0x25, 0x0D, 0x35};
+            e.load(EAX, reg(op.rs));
+            e.bytes({OPCODES[static_cast<int>(op.handler) - static_cast<int>(Handler::ADDI)]});
+            e.imm32(imm);
+            if (op.handler == Handler::ADDI)
+            {
+                trap(JNO, position);
+            }
+            if (op.rt != 0)
+            {
+                e.store(reg(op.rt), EAX);
+            }
+            break;
+        }
+        case Handler::SLTI:
+        case Handler::SLTIU:
+            e.load(EAX, reg(op.rs));
+            e.bytes({0x3D});
+            e.imm32(imm);
+            e.setFlag(op.handler == Handler::SLTI ? SETL : SETB);
+            e.store(reg(op.rt), EAX);
+            break;
+        case Handler::LW:
+        case Handler::LB:
+        case Handler::LBU:
+        case Handler::LH:
+            // load(memory, rs + imm, kind), a negative result is a fault
+            e.load(ESI, reg(op.rs));
+            e.bytes({0x81, 0xC6});
+            e.imm32(imm);
+            e.bytes({0xBA});
+            e.imm32(static_cast<uint32_t>(op.handler));
+            e.bytes({0x4C, 0x89, 0xE7});
+            e.call(reinterpret_cast<const void *>(t.load));
+            e.bytes({0x48, 0x85, 0xC0});
+            trap(JNS, position);
+            if (op.rt != 0)
+            {
+                e.store(reg(op.rt), EAX);
+            }
+            break;
+        case Handler::SW:
+        case Handler::SB:
+        case Handler::SH:
+            // store(memory, rs + imm, rt, kind), false is a fault
+            e.load(ESI, reg(op.rs));
+            e.bytes({0x81, 0xC6});
+            e.imm32(imm);
+            e.load(EDX, reg(op.rt));
+            e.bytes({0xB9});
+            e.imm32(static_cast<uint32_t>(op.handler));
+            e.bytes({0x4C, 0x89, 0xE7});
+            e.call(reinterpret_cast<const void *>(t.store));
+            e.bytes({0x84, 0xC0});
+            trap(JNE, position);
+            break;
+        case Handler::BEQ:
+        case Handler::BNE:
+        {
+            e.load(EAX, reg(op.rs));
+            e.rbxOperand({0x3B}, EAX, reg(op.rt));
+            std::size_t notTaken = e.jumpShort(op.handler == Handler::BEQ ? JNE : JE);
+            leave(block.instructions, imm);
+            e.bind(notTaken);
+            leave(block.instructions, block.end);
+            goto finished;
+        }
+        case Handler::BGTZ:
+        case Handler::BLTZ:
+        {
+            // cmp dword [rbx + rs], 0
+            e.rbxOperand({0x83}, 7, reg(op.rs));
+            e.bytes({0x00});
+            std::size_t notTaken = e.jumpShort(op.handler == Handler::BGTZ ? JLE : JGE);
+            leave(block.instructions, imm);
+            e.bind(notTaken);
+            leave(block.instructions, block.end);
+            goto finished;
+        }
+        case Handler::JAL:
+            e.storeImm(reg(31), PC_START + block.end * 4);
+            [[fallthrough]];
+        case Handler::J:
+            leave(block.instructions, imm);
+            goto finished;
+        case Handler::JR:
+        {
+            // Index (rs - PC_START) / 4 in eax, misaligned or past HALT goes back to the interpreter
+            e.load(EAX, reg(op.rs));
+            e.bytes({0x2D});
+            e.imm32(PC_START);
+            e.bytes({0xA8, 0x03});
+            std::size_t misaligned = e.jumpShort(JNE);
+            e.bytes({0xC1, 0xE8, 0x02, 0x3D});
+            e.imm32(t.textCount);
+            std::size_t outside = e.jumpShort(JA);
+            e.rbxOperand({0x48, 0x81}, 0, t.executedOffset);
+            e.imm32(block.instructions);
+            toEpilogue.push_back(e.jumpNear());
+            e.bind(misaligned);
+            e.bind(outside);
+            fallBack(position);
+            goto finished;
+        }
+        case Handler::CHAIN:
+            leave(block.instructions, block.end);
+            goto finished;
+        default:
+            // Syscalls, HALT and BAD_TARGET stay with the interpreter
+            if (position == 0)
+            {
+                return nullptr;
+            }
+            fallBack(position);
+            goto finished;
+        }
+    }
+
+finished:
+    for (std::size_t at : toEpilogue)
+    {
+        e.bindNear(at, e.size());
+    }
+    // pop r13; pop r12; pop rbx; ret
+    e.bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+
+    if (this->used + e.size() > this->capacity)
+    {
+        return nullptr;
+    }
+    uint8_t *destination = this->buffer + this->used;
+    if (::mprotect(this->buffer, this->capacity, PROT_READ | PROT_WRITE) != 0)
+    {
+        return nullptr;
+    }
+    std::memcpy(destination, e.code.data(), e.size());
+    ::mprotect(this->buffer, this->capacity, PROT_READ | PROT_EXEC);
+    // Keep every block 16-byte aligned
+    this->used += (e.size() + 15) & ~std::size_t{15};
+    ++this->compiled;
+    return reinterpret_cast<NativeBlock>(destination);
+#else
+    (void)block;
+    return nullptr;
+#endif
+}
+
+std::size_t Jit::compiledBlocks() const
+{
+    return this->compiled;
+}
+
+std::size_t Jit::codeBytes() const
+{
+    return this->used;
+}
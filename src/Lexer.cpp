@@ -0,0 +1,217 @@
+#include "Lexer.hpp"
+#include <stdexcept>
+
+// Commas separate operands the same way spaces do
+static bool isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static bool isDelimiter(char c)
+{
+    return isSeparator(c) || c == '#' || c == '(' || c == ':';
+}
+
+static std::string_view trim(std::string_view text)
+{
+    while (!text.empty() && isSeparator(text.front()))
+    {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isSeparator(text.back()))
+    {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+Lexer::Lexer(std::string_view source)
+    : source(source), file(nullptr), pos(0), curLine(0)
+{
+}
+
+Lexer::Lexer(SourceFile &file)
+    : source(), file(&file), pos(0), curLine(0)
+{
+}
+
+bool Lexer::next(SourceLine &line)
+{
+    std::string_view text;
+    if (this->file != nullptr)
+    {
+        if (!this->file->nextLine(text))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        if (this->pos >= this->source.size())
+        {
+            return false;
+        }
+        std::size_t end = this->source.find('\n', this->pos);
+        if (end == std::string_view::npos)
+        {
+            end = this->source.size();
+        }
+        text = this->source.substr(this->pos, end - this->pos);
+        this->pos = end + 1;
+    }
+    lexLine(text, line);
+    this->curLine++;
+    return true;
+}
+
+uint32_t Lexer::lineNumber() const
+{
+    return this->curLine;
+}
+
+/**
+ * Splits a line into a label and tokens in one pass over the characters.
+ * Tokens are views into text, nothing is copied.
+ */
+void Lexer::lexLine(std::string_view text, SourceLine &line)
+{
+    line.label = {};
+    line.tokens.clear();
+    line.text = {};
+    std::size_t textStart = std::string_view::npos;
+    std::size_t textEnd = 0;
+    std::size_t i = 0;
+    const std::size_t n = text.size();
+
+    while (true)
+    {
+        while (i < n && isSeparator(text[i]))
+        {
+            i++;
+        }
+        // End of line or start of a comment
+        if (i >= n || text[i] == '#')
+        {
+            break;
+        }
+        std::size_t start = i;
+        char c = text[i];
+        Token tok{TokenType::SYMBOL, {}, {}};
+        if (c == '"')
+        {
+            // String literal, escapes are skipped and decoded later
+            i++;
+            while (i < n && text[i] != '"')
+            {
+                i += (text[i] == '\\') ? 2 : 1;
+            }
+            if (i >= n)
+            {
+                throw std::runtime_error("Unterminated string: " + std::string(text));
+            }
+            tok = {TokenType::STRING, text.substr(start + 1, i - start - 1), {}};
+            i++;
+        }
+        else if (c == '\'')
+        {
+            // Character literal, kept with its quotes
+            i += (i + 1 < n && text[i + 1] == '\\') ? 3 : 2;
+            if (i >= n || text[i] != '\'')
+            {
+                throw std::runtime_error("Unterminated character literal: " + std::string(text));
+            }
+            i++;
+            tok = {TokenType::LITERAL, text.substr(start, i - start), {}};
+        }
+        else if (c == ':')
+        {
+            i++;
+            tok = {TokenType::COLON, text.substr(start, 1), {}};
+        }
+        else
+        {
+            while (i < n && !isDelimiter(text[i]))
+            {
+                i++;
+            }
+            std::string_view word = text.substr(start, i - start);
+            if (i < n && text[i] == '(')
+            {
+                // offset($s), the offset may be empty, a number or a label
+                std::size_t close = text.find(')', i);
+                if (close == std::string_view::npos)
+                {
+                    throw std::runtime_error("Missing ')' in: " + std::string(text));
+                }
+                tok = {TokenType::MEMORY, word, trim(text.substr(i + 1, close - i - 1))};
+                i = close + 1;
+            }
+            else if (i < n && text[i] == ':' && line.tokens.empty() && line.label.empty())
+            {
+                // Label definition, the rest of the line is lexed as usual
+                line.label = word;
+                i++;
+                continue;
+            }
+            else if (c == '$')
+            {
+                tok = {TokenType::REGISTER, word, {}};
+            }
+            else if (c == '.')
+            {
+                tok = {TokenType::DIRECTIVE, word, {}};
+            }
+            else if ((c >= '0' && c <= '9') || c == '-' || c == '+')
+            {
+                tok = {TokenType::LITERAL, word, {}};
+            }
+            else
+            {
+                tok = {TokenType::SYMBOL, word, {}};
+            }
+        }
+        if (textStart == std::string_view::npos)
+        {
+            textStart = start;
+        }
+        textEnd = i;
+        line.tokens.push_back(tok);
+    }
+    if (textStart != std::string_view::npos)
+    {
+        line.text = text.substr(textStart, textEnd - textStart);
+    }
+}
+
+void validateTokenCount(std::size_t expSize, std::span<const Token> toks)
+{
+    if (toks.size() != expSize)
+    {
+        throw std::runtime_error("Incorrect number of tokens for instruction: " + tokensToString(toks));
+    }
+}
+
+std::string tokensToString(std::span<const Token> toks)
+{
+    std::string result;
+    for (const Token &tok : toks)
+    {
+        if (!result.empty())
+        {
+            result += ' ';
+        }
+        switch (tok.type)
+        {
+        case TokenType::MEMORY:
+            result.append(tok.text).append("(").append(tok.base).append(")");
+            break;
+        case TokenType::STRING:
+            result.append("\"").append(tok.text).append("\"");
+            break;
+        default:
+            result.append(tok.text);
+            break;
+        }
+    }
+    return result;
+}
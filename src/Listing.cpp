@@ -0,0 +1,170 @@
+#include "Listing.hpp"
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+Listing::Listing(std::ostream &out) : out(out)
+{
+    this->buffer.reserve(BUFFER_SIZE);
+}
+
+Listing::~Listing()
+{
+    flush();
+}
+
+void Listing::write(const MIPS &mips, Verbosity verbosity, ListingFormat format)
+{
+    switch (verbosity)
+    {
+    case Verbosity::QUIET:
+        return;
+    case Verbosity::LISTING:
+        if (format == ListingFormat::JSON)
+        {
+            writeJSON(mips);
+        }
+        else
+        {
+            writeText(mips);
+        }
+        break;
+    case Verbosity::VERBOSE:
+        writeVerbose(mips);
+        break;
+    }
+    flush();
+}
+
+void Listing::flush()
+{
+    if (!this->buffer.empty())
+    {
+        this->out.write(this->buffer.data(), static_cast<std::streamsize>(this->buffer.size()));
+        this->buffer.clear();
+    }
+    this->out.flush();
+}
+
+void Listing::append(std::string_view text)
+{
+    if (this->buffer.size() + text.size() > BUFFER_SIZE)
+    {
+        this->out.write(this->buffer.data(), static_cast<std::streamsize>(this->buffer.size()));
+        this->buffer.clear();
+    }
+    this->buffer.append(text);
+}
+
+/**
+ * Format:
+ * 0x00400000  0x3c011001  lw $t3, value
+ * Words expanded from the same source line leave the source column empty
+ */
+void Listing::writeText(const MIPS &mips)
+{
+    char line[64];
+    append("Address     Code        Source\n");
+    uint32_t lastLine = UINT32_MAX;
+    for (const Instruction &instr : mips.instructions)
+    {
+        auto end = std::format_to(line, "0x{:08x}  0x{:08x}  ", instr.address, instr.machine);
+        append(std::string_view(line, end - line));
+        if (instr.line != lastLine)
+        {
+            append(mips.textLines[instr.line]);
+            lastLine = instr.line;
+        }
+        append("\n");
+    }
+}
+
+void Listing::writeJSON(const MIPS &mips)
+{
+    char number[32];
+    append("{\"global\":");
+    appendJSONString(mips.global);
+    append(",\"instructions\":[");
+    for (std::size_t i = 0; i < mips.instructions.size(); ++i)
+    {
+        const Instruction &instr = mips.instructions[i];
+        auto end = std::format_to(number, "{}{{\"address\":{},\"machine\":{},\"source\":", i ? "," : "", instr.address, instr.machine);
+        append(std::string_view(number, end - number));
+        appendJSONString(mips.textLines[instr.line]);
+        append("}");
+    }
+
+    // Sorting symbols by address so the output is stable
+    std::vector<std::pair<uint32_t, std::string_view>> labels;
+    for (const auto &[name, address] : mips.labelTable)
+    {
+        labels.emplace_back(address, name);
+    }
+    std::sort(labels.begin(), labels.end());
+    append("],\"labels\":{");
+    for (std::size_t i = 0; i < labels.size(); ++i)
+    {
+        append(i ? "," : "");
+        appendJSONString(labels[i].second);
+        auto end = std::format_to(number, ":{}", labels[i].first);
+        append(std::string_view(number, end - number));
+    }
+
+    std::vector<const Data *> data;
+    for (const auto &[name, entry] : mips.dataTable)
+    {
+        data.push_back(&entry);
+    }
+    std::sort(data.begin(), data.end(), [](const Data *a, const Data *b)
+              { return a->address < b->address; });
+    append("},\"data\":{");
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        append(i ? "," : "");
+        appendJSONString(data[i]->label);
+        auto end = std::format_to(number, ":{{\"address\":{},\"size\":{},\"directive\":", data[i]->address, data[i]->size);
+        append(std::string_view(number, end - number));
+        appendJSONString(data[i]->directive);
+        append("}");
+    }
+    append("}}\n");
+}
+
+/**
+ * Every field of every instruction, as the assembler used to print while encoding
+ */
+void Listing::writeVerbose(const MIPS &mips)
+{
+    std::ostringstream oss;
+    for (const Instruction &instr : mips.instructions)
+    {
+        oss.str("");
+        oss << "Source: " << mips.textLines[instr.line] << "\n"
+            << instr << "\n";
+        append(oss.str());
+    }
+}
+
+void Listing::appendJSONString(std::string_view text)
+{
+    char escape[8];
+    append("\"");
+    std::size_t start = 0;
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c != '"' && c != '\\' && c >= 0x20)
+        {
+            continue;
+        }
+        append(text.substr(start, i - start));
+        auto end = std::format_to(escape, "\\u{:04x}", static_cast<unsigned>(c));
+        append(std::string_view(escape, end - escape));
+        start = i + 1;
+    }
+    append(text.substr(start));
+    append("\"");
+}
@@ -1,22 +1,52 @@
 #include "MIPS.hpp"
 #include "Helpers.hpp"
+#include "ProgramCache.hpp"
+#include "CPU.hpp"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
-int main()
+/**
+ * Loads the program from the cache when one is given and holds this exact
+ * source, otherwise assembles it and takes over the parser's results
+ */
+MIPS::MIPS(const std::string &filename, const AssemblerOptions &options)
 {
-    std::string filename = "assembly_files/fib.asm";
-    MIPS mips(filename);
+    auto file = std::make_unique<SourceFile>(filename);
+    std::optional<ProgramCache> cache;
+    uint64_t key = 0;
+    // Streamed input is assembled as it arrives and is never cached
+    if (!options.cacheDir.empty() && file->isMapped())
+    {
+        cache.emplace(options.cacheDir);
+        key = ProgramCache::keyFor(file->contents());
+        if (cache->load(key, *this))
+        {
+            return;
+        }
+    }
 
-    return 0;
+    MIPSParser parser(std::move(file), options.threads);
+    this->labelTable = std::move(parser.labelTable);
+    this->dataTable = std::move(parser.dataTable);
+    this->dataImage = std::move(parser.dataImage);
+    this->instructions = std::move(parser.instructions);
+    this->textLines = std::move(parser.textLines);
+    this->global = std::move(parser.global);
+    this->source = std::move(parser.source);
+    if (cache)
+    {
+        cache->store(key, *this);
+    }
 }
 
-MIPS::MIPS(const std::string &filename)
-    : parser(filename), labelTable(parser.labelTable), dataTable(parser.dataTable), instructions(parser.instructions), global(parser.global)
+MIPS::~MIPS()
 {
 }
 
-MIPS::~MIPS()
+int MIPS::run(std::istream &in, std::ostream &out) const
 {
-}
\ No newline at end of file
+    CPU cpu(*this, in, out);
+    return cpu.run();
+}
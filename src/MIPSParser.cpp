@@ -1,47 +1,76 @@
 #include "MIPSParser.hpp"
 #include "Helpers.hpp"
 #include "Globals.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
 #include <fstream>
-#include <sstream>
 #include <iostream>
 #include <string>
-#include <format>
 #include <vector>
 #include <stdexcept>
-#include <algorithm>
 
-const std::unordered_map<std::string, Section> MIPSParser::sectionMap = {
-    {".text", TEXT},
-    {".data", DATA},
-    {".bss", BSS},
-    {".rodata", RODATA}};
+// Instructions built by the pseudo instruction expansions
+static constexpr const InstructionInfo &ADDI = *Instruction::INSTRUCTIONMAP.find("addi");
+static constexpr const InstructionInfo &LUI = *Instruction::INSTRUCTIONMAP.find("lui");
+static constexpr const InstructionInfo &ORI = *Instruction::INSTRUCTIONMAP.find("ori");
+static constexpr const InstructionInfo &XORI = *Instruction::INSTRUCTIONMAP.find("xori");
+static constexpr const InstructionInfo &SLTIU = *Instruction::INSTRUCTIONMAP.find("sltiu");
+static constexpr const InstructionInfo &ADD = *Instruction::INSTRUCTIONMAP.find("add");
+static constexpr const InstructionInfo &SUB = *Instruction::INSTRUCTIONMAP.find("sub");
+static constexpr const InstructionInfo &XOR = *Instruction::INSTRUCTIONMAP.find("xor");
+static constexpr const InstructionInfo &NOR = *Instruction::INSTRUCTIONMAP.find("nor");
+static constexpr const InstructionInfo &SLT = *Instruction::INSTRUCTIONMAP.find("slt");
+static constexpr const InstructionInfo &SLTU = *Instruction::INSTRUCTIONMAP.find("sltu");
+static constexpr const InstructionInfo &BEQ = *Instruction::INSTRUCTIONMAP.find("beq");
+static constexpr const InstructionInfo &BNE = *Instruction::INSTRUCTIONMAP.find("bne");
+// Zero and assembler temporary registers
+static constexpr uint8_t ZERO = 0;
+static constexpr uint8_t AT = 1;
 
-const std::unordered_set<std::string> MIPSParser::PSEUDO_INSTRUCTIONS = {
-    "li",   // Load Immediate
-    "la",   // Load Address
-    "move", // Move from one register to another
-    "bne",  // Branch Not Equal
-    "beq",  // Branch Equal
-    "blt",  // Branch Less Than
-    "bgt",  // Branch Greater Than
-    "ble",  // Branch Less Than or Equal
-    "bge",  // Branch Greater Than or Equal
-    "beqz", // Branch if Equal to Zero
-    "bnez", // Branch if Not Equal to Zero
-    "not",  // Bitwise Not
-    "neg",  // Negate
-    "seq",  // Set on Equal
-    "sne",  // Set on Not Equal
-    "sle",  // Set on Less or Equal
-    "sge",  // Set on Greater or Equal
-};
+/**
+ * Loads and stores written as "lw $t, label" need $at to reach the data segment
+ */
+static bool isSymbolicMemoryAccess(std::span<const Token> toks)
+{
+    const InstructionInfo *info = Instruction::INSTRUCTIONMAP.find(toks[0].text);
+    return toks.size() == 3 && info != nullptr && info->layout == Layout::TOFFS && toks[2].type == TokenType::SYMBOL;
+}
 
-MIPSParser::MIPSParser(const std::string &inputfile)
-    : inputfile(inputfile), instructionfile(generateCleanName(inputfile))
+/**
+ * Picks how a symbol written directly in an instruction is encoded
+ */
+static FixupKind fixupKindFor(const Instruction &instr)
 {
-    // Creating instructions and symbol tables
-    createTables();
-    createInstructions();
+    if (instr.isJump())
+    {
+        return JUMP;
+    }
+    // Loads and stores (opcode 1xxxxx) keep label($s) relative to the data segment
+    if (instr.opcode & 0b100000)
+    {
+        return DATA_OFFSET;
+    }
+    return BRANCH;
+}
+
+static uint8_t registerNumber(const Token &tok)
+{
+    return static_cast<uint8_t>(Instruction::validateRegister(tok.text).decVal);
+}
+
+MIPSParser::MIPSParser(const std::string &inputfile, unsigned threads)
+    : inputfile(inputfile), source(std::make_unique<SourceFile>(inputfile))
+{
+    // Creating symbol tables, then instructions
+    assemble();
+    encode(threads);
+}
+
+MIPSParser::MIPSParser(std::unique_ptr<SourceFile> source, unsigned threads)
+    : inputfile(), source(std::move(source))
+{
+    assemble();
+    encode(threads);
 }
 
 MIPSParser::~MIPSParser()
@@ -49,177 +78,230 @@ MIPSParser::~MIPSParser()
     // Destructor implementation
 }
 
-void MIPSParser::createTables()
+void MIPSParser::assemble()
 {
     // Initializing variables
     uint32_t pc = PC_START;
     uint32_t dataAddress = DATA_START;
+    uint32_t instructionTotal = 0;
     Section curSection = NONE;
-    // Opening clean asm file
-    std::ifstream asmFile(this->inputfile);
-    if (!asmFile)
-    {
-        throw std::runtime_error("Failed to open file: " + this->inputfile);
-        return;
-    }
-    std::ofstream instrFile(this->instructionfile);
-    if (!instrFile)
-    {
-        throw std::runtime_error("Failed to open file: " + this->instructionfile);
-        return;
-    }
-    std::string curLine;
-    std::vector<std::string> stringVector;
+    Lexer lexer(*this->source);
+    SourceLine line;
+    // Label on its own line in .data, given to the next directive
+    std::string_view dataLabel;
     // Proccessing each line
-    while (std::getline(asmFile, curLine))
+    while (lexer.next(line))
     {
-        cleanASMLine(curLine);
-        stringVector = split(curLine, ' ');
-
-        // Check if empty string
-        if (!stringVector.size())
+        // Defining labels
+        if (!line.label.empty())
         {
-            continue;
+            if (curSection == DATA)
+            {
+                dataLabel = line.label;
+            }
+            else if (curSection == TEXT)
+            {
+                this->labelTable.insert_or_assign(std::string(line.label), pc);
+            }
         }
-        // Setting global
-        if (stringVector[0] == ".globl" && stringVector.size() == 2)
+        // Check if empty line
+        if (line.tokens.empty())
         {
-            this->global = stringVector[1];
             continue;
         }
-        // Determing section
-        auto sectionLoc = sectionMap.find(stringVector[0]);
-        if (sectionLoc != sectionMap.end())
+        std::span<const Token> toks = line.tokens;
+        if (toks[0].type == TokenType::DIRECTIVE)
         {
-            curSection = sectionLoc->second;
-
-            continue;
+            // Setting global
+            if (toks[0].text == ".globl" && toks.size() == 2)
+            {
+                this->global = toks[1].text;
+                continue;
+            }
+            // Determing section
+            if (const SectionInfo *sectionLoc = SECTION_MAP.find(toks[0].text))
+            {
+                curSection = sectionLoc->section;
+                continue;
+            }
         }
-        // Parsing labels, data, and isntructions
-        std::string textLabel;
-        std::size_t colonPos;
-        std::string instrOne;
-        std::string instrTwo;
+        // Parsing data and isntructions
         Data curData;
         switch (curSection)
         {
         case NONE:
             break;
         case TEXT:
-            colonPos = curLine.find(':');
-            if (colonPos != std::string::npos)
-            {
-                textLabel = stringVector[0].substr(0, colonPos);
-                this->labelTable[textLabel] = pc;
-                if (stringVector.size() > 1)
-                {
-                    stringVector.erase(stringVector.begin());
-                    curLine = curLine.substr(colonPos + 2);
-                }
-                else
-                {
-                    continue;
-                }
-            }
-            // Will change function
-            instrFile << curLine << std::endl;
-            pc += 4;
+            // Only the size is needed now, the line is encoded once every label is known
+            this->textLines.push_back(line.text);
+            this->lineStarts.push_back(instructionTotal);
+            instructionTotal += instructionCount(toks);
+            pc = PC_START + instructionTotal * 4;
             break;
         case DATA:
-            curData = Data(curLine, dataAddress);
-            dataTable[curData.label] = curData;
-            dataAddress += 4;
+            curData = Data(dataLabel, toks, dataAddress);
+            curData.writeImage(toks, this->dataImage);
+            if (!dataLabel.empty())
+            {
+                dataTable.insert_or_assign(curData.label, curData);
+                dataLabel = {};
+            }
+            dataAddress = curData.address + curData.size;
             break;
         case BSS:
-            std::cout << "BSS NOT IMPLEMENTED" << std::endl;
-            break;
+            throw std::runtime_error(".bss sections are not supported: " + std::string(line.text));
         case RODATA:
-            std::cout << "RODATA NOT IMPLEMENTED " << std::endl;
-            break;
+            throw std::runtime_error(".rodata sections are not supported: " + std::string(line.text));
         default:
-            std::cout << "NO MATCHES " << std::endl;
-            break;
+            throw std::runtime_error("Line outside any known section: " + std::string(line.text));
         }
     }
-    asmFile.close();
-    instrFile.close();
+    this->lineStarts.push_back(instructionTotal);
     return;
 }
 
-void MIPSParser::createInstructions()
+/**
+ * Pseudo instructions whose size depends on their operands are the only
+ * ones that need looking at past the mnemonic
+ */
+uint32_t MIPSParser::instructionCount(std::span<const Token> toks)
 {
-    // Initializing variables
-    uint32_t pc = PC_START;
-    std::ifstream instrFile(this->instructionfile);
-    if (!instrFile)
+    if (const PseudoInfo *pseudo = PSEUDO_INSTRUCTIONS.find(toks[0].text))
     {
-        throw std::runtime_error("Failed to open file: " + this->instructionfile);
+        if (pseudo->op == LI)
+        {
+            validateTokenCount(3, toks);
+            return fitsIn16Bits(handleValue(toks[2].text)) ? 1 : 2;
+        }
+        return pseudo->size;
+    }
+    return isSymbolicMemoryAccess(toks) ? 2 : 1;
+}
+
+/**
+ * Every line already has its slots, so chunks of lines encode independently
+ * and the result does not depend on how many threads ran
+ */
+void MIPSParser::encode(unsigned threads)
+{
+    this->instructions.resize(this->lineStarts.back());
+    std::size_t lineCount = this->textLines.size();
+    std::size_t chunks = (lineCount + ENCODE_CHUNK_LINES - 1) / ENCODE_CHUNK_LINES;
+    std::vector<EncodeBatch> batches(chunks);
+    auto encodeChunk = [&](std::size_t i)
+    {
+        std::size_t first = i * ENCODE_CHUNK_LINES;
+        encodeLines(first, std::min(first + ENCODE_CHUNK_LINES, lineCount), batches[i]);
+        resolveFixups(batches[i].fixups);
+    };
+    if (threads == 1 || chunks < 2)
+    {
+        for (std::size_t i = 0; i < chunks; ++i)
+        {
+            encodeChunk(i);
+        }
         return;
     }
-    std::string curLine;
-    std::vector<std::string> stringVector;
-    // Proccessing each line
-    while (std::getline(instrFile, curLine))
+    ThreadPool pool(threads);
+    pool.parallelFor(chunks, encodeChunk);
+}
+
+void MIPSParser::encodeLines(std::size_t first, std::size_t last, EncodeBatch &batch)
+{
+    SourceLine line;
+    std::string_view symbol;
+    for (std::size_t i = first; i < last; ++i)
     {
-        stringVector = split(curLine, ' ');
-        if (PSEUDO_INSTRUCTIONS.find(stringVector[0]) != PSEUDO_INSTRUCTIONS.end())
+        Lexer::lexLine(this->textLines[i], line);
+        std::span<const Token> toks = line.tokens;
+        uint32_t lineIndex = static_cast<uint32_t>(i);
+        uint32_t pc = PC_START + this->lineStarts[i] * 4;
+        batch.next = this->lineStarts[i];
+        if (const PseudoInfo *pseudo = PSEUDO_INSTRUCTIONS.find(toks[0].text))
         {
-            pc = handlePseudoInstr(stringVector, pc);
+            handlePseudoInstr(pseudo->op, toks, pc, lineIndex, batch);
+        }
+        else if (isSymbolicMemoryAccess(toks))
+        {
+            handleSymbolicMemory(toks, pc, lineIndex, batch);
         }
         else
         {
-            Instruction curInstr(curLine, pc, this->labelTable, this->dataTable);
-            this->instructions.push_back(curInstr);
-            pc += 4;
+            Instruction curInstr(toks, pc, lineIndex, symbol);
+            emitInstruction(batch, curInstr, symbol, fixupKindFor(curInstr));
+        }
+        if (batch.next != this->lineStarts[i + 1])
+        {
+            throw std::logic_error("Expansion size mismatch for: " + std::string(this->textLines[i]));
         }
     }
-    instrFile.close();
 }
 
-void cleanASMLine(std::string &curLine)
+/**
+ * Adds an encoded instruction, queueing a fixup when it references a symbol
+ */
+uint32_t MIPSParser::emitInstruction(EncodeBatch &batch, const Instruction &instr, std::string_view symbol, FixupKind kind)
 {
-    // Remove all commas from the line
-    std::replace(curLine.begin(), curLine.end(), ',', ' ');
-
-    // Reading only up to comment if existent
-    std::size_t pos = curLine.find('#');
-    if (pos != std::string::npos)
+    if (!symbol.empty())
     {
-        curLine = curLine.substr(0, pos);
+        batch.fixups.push_back({batch.next, symbol, kind});
     }
-    // Add a space after each colon if it is not followed by a space
-    std::string::size_type i = 0;
-    while (i < curLine.size())
+    this->instructions[batch.next++] = instr;
+    return instr.address + 4;
+}
+
+/**
+ * Patches every queued symbol reference with its final address
+ */
+void MIPSParser::resolveFixups(std::span<const Fixup> fixups)
+{
+    for (const Fixup &fixup : fixups)
     {
-        if (curLine[i] == ':')
+        Instruction &instr = this->instructions[fixup.index];
+        uint32_t target;
+        auto labelKey = this->labelTable.find(fixup.symbol);
+        auto dataKey = this->dataTable.find(fixup.symbol);
+        if (labelKey != this->labelTable.end())
         {
-            // Check if next character is not a space
-            if (i + 1 < curLine.size() && curLine[i + 1] != ' ')
-            {
-                curLine.insert(i + 1, " ");
-                i++; // Skip the added space
-            }
+            target = labelKey->second;
+        }
+        else if (dataKey != this->dataTable.end())
+        {
+            target = dataKey->second.address;
+        }
+        else
+        {
+            throw std::runtime_error("Undefined symbol: " + std::string(fixup.symbol) + " in instruction: " + std::string(this->textLines[instr.line]));
         }
-        i++;
-    }
-
-    // Removing trailing whitespace and making spaces a distance of 1 max
-    std::istringstream stream(curLine);
-    std::string word;
-    std::string result;
 
-    while (stream >> word)
-    {
-        if (!result.empty())
+        std::int32_t value = 0;
+        switch (fixup.kind)
+        {
+        case BRANCH:
+            value = static_cast<std::int32_t>(target - (instr.address + 4)) >> 2;
+            break;
+        case JUMP:
+            value = static_cast<std::int32_t>((target >> 2) & 0x3FFFFFF);
+            break;
+        case ADDR_HI:
+            value = static_cast<std::int16_t>(target >> 16);
+            break;
+        case ADDR_HI_ADJ:
+            value = static_cast<std::int16_t>((target + 0x8000) >> 16);
+            break;
+        case ADDR_LO:
+            value = static_cast<std::int16_t>(target & 0xFFFF);
+            break;
+        case DATA_OFFSET:
+            value = static_cast<std::int32_t>(target - DATA_START);
+            break;
+        }
+        if (fixup.kind != JUMP && !fitsIn16Bits(value))
         {
-            result += ' ';
+            throw std::out_of_range("Symbol " + std::string(fixup.symbol) + " out of range for instruction: " + std::string(this->textLines[instr.line]));
         }
-        result += word;
+        instr.patch(value);
     }
-
-    // Update the original string with the normalized result
-    curLine = result;
-    return;
 }
 
 void printFile(const std::string &inputfile)
@@ -248,150 +330,110 @@ void printFile(const std::string &inputfile)
     return;
 }
 
-const std::string generateCleanName(const std::string &filename)
-{
-    // Define the extension to be replaced
-    const std::string extension = ".asm";
-
-    // Check if the filename ends with the specified extension
-    if (filename.size() > extension.size() &&
-        filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0)
-    {
-        // Create the new filename by replacing the extension with "_clean.asm"
-        return filename.substr(0, filename.size() - extension.size()) + "_instructions" + extension;
-    }
-
-    // Return the original filename if it does not end with ".asm"
-    return filename;
-}
-
-uint32_t MIPSParser::handlePseudoInstr(std::vector<std::string> &stringVector, uint32_t pc)
+uint32_t MIPSParser::handlePseudoInstr(Pseudo op, std::span<const Token> toks, uint32_t pc, uint32_t line, EncodeBatch &batch)
 {
-    std::string instrOne = "";
-    std::string instrTwo = "";
-    std::string regOne;
-    std::string regTwo;
-    std::string label;
-    std::string immStr;
+    uint8_t regOne;
+    uint8_t regTwo;
+    uint8_t regThree;
     std::int32_t imm;
-    Data data;
-    // Will change function
-    if (stringVector[0] == "li")
+    switch (op)
     {
-        validateVectorSize(3, stringVector);
-        regOne = stringVector[1];
-        immStr = stringVector[2];
-        imm = handleValue(immStr);
-
+    case LI:
+        validateTokenCount(3, toks);
+        regOne = registerNumber(toks[1]);
+        imm = handleValue(toks[2].text);
         if (fitsIn16Bits(imm))
         {
-            instrOne = std::format("addi {} $zero {}", regOne, imm);
+            pc = emitInstruction(batch, Instruction(ADDI, 0, 0, regOne, imm, pc, line));
         }
         else
-        { // First line
-            std::int16_t upper = static_cast<std::int16_t>(imm >> 16);
-            instrOne = std::format("lui {} {}", regOne, upper);
-            // Second line
-            std::int16_t lower = imm & 0xFFFF;
-            instrTwo = std::format("ori {} {} {}", regOne, regOne, lower);
+        {
+            // Upper half then lower half
+            pc = emitInstruction(batch, Instruction(LUI, 0, 0, regOne, static_cast<std::int16_t>(imm >> 16), pc, line));
+            pc = emitInstruction(batch, Instruction(ORI, 0, regOne, regOne, static_cast<std::int16_t>(imm & 0xFFFF), pc, line));
         }
-    }
-    else if (stringVector[0] == "la")
-    {
-        validateVectorSize(3, stringVector);
-        regOne = stringVector[1];
-        data = this->dataTable.at(stringVector[2]);
-        imm = data.address;
-        if (fitsIn16Bits(imm))
+        return pc;
+    case LA:
+        validateTokenCount(3, toks);
+        regOne = registerNumber(toks[1]);
+        // Always lui/ori so the size is known before the address is
+        pc = emitInstruction(batch, Instruction(LUI, 0, 0, regOne, 0, pc, line), toks[2].text, ADDR_HI);
+        pc = emitInstruction(batch, Instruction(ORI, 0, regOne, regOne, 0, pc, line), toks[2].text, ADDR_LO);
+        return pc;
+    case MOVE:
+    case NOT:
+    case NEG:
+        validateTokenCount(3, toks);
+        regOne = registerNumber(toks[1]);
+        regTwo = registerNumber(toks[2]);
+        if (op == MOVE)
         {
-            instrOne = std::format("addi {} $zero {}", regOne, imm);
+            return emitInstruction(batch, Instruction(ADD, regOne, regTwo, ZERO, 0, pc, line));
         }
-        else
-        { // First line
-            std::int16_t upper = static_cast<std::int16_t>(imm >> 16);
-            instrOne = std::format("lui {} {}", regOne, upper);
-            // Second line
-            std::int16_t lower = imm & 0xFFFF;
-            instrTwo = std::format("ori {} {} {}", regOne, regOne, lower);
+        if (op == NOT)
+        {
+            return emitInstruction(batch, Instruction(NOR, regOne, regTwo, ZERO, 0, pc, line));
         }
+        return emitInstruction(batch, Instruction(SUB, regOne, ZERO, regTwo, 0, pc, line));
+    case BEQZ:
+    case BNEZ:
+        validateTokenCount(3, toks);
+        regOne = registerNumber(toks[1]);
+        return emitInstruction(batch, Instruction(op == BEQZ ? BEQ : BNE, 0, regOne, ZERO, 0, pc, line), toks[2].text, BRANCH);
+    case BLT:
+    case BGT:
+    case BLE:
+    case BGE:
+        // slt $at then branch on $at, bgt and ble compare the other way round
+        validateTokenCount(4, toks);
+        regOne = registerNumber(toks[1]);
+        regTwo = registerNumber(toks[2]);
+        if (op == BGT || op == BLE)
+        {
+            std::swap(regOne, regTwo);
+        }
+        pc = emitInstruction(batch, Instruction(SLT, AT, regOne, regTwo, 0, pc, line));
+        return emitInstruction(batch, Instruction(op == BLT || op == BGT ? BNE : BEQ, 0, AT, ZERO, 0, pc, line), toks[3].text, BRANCH);
+    case SEQ:
+    case SNE:
+    case SLE:
+    case SGE:
+        validateTokenCount(4, toks);
+        regOne = registerNumber(toks[1]);
+        regTwo = registerNumber(toks[2]);
+        regThree = registerNumber(toks[3]);
+        if (op == SEQ)
+        {
+            // Equal when the xor is zero
+            pc = emitInstruction(batch, Instruction(XOR, regOne, regTwo, regThree, 0, pc, line));
+            return emitInstruction(batch, Instruction(SLTIU, 0, regOne, regOne, 1, pc, line));
+        }
+        if (op == SNE)
+        {
+            pc = emitInstruction(batch, Instruction(XOR, regOne, regTwo, regThree, 0, pc, line));
+            return emitInstruction(batch, Instruction(SLTU, regOne, ZERO, regOne, 0, pc, line));
+        }
+        // s <= t is !(t < s) and s >= t is !(s < t)
+        if (op == SLE)
+        {
+            std::swap(regTwo, regThree);
+        }
+        pc = emitInstruction(batch, Instruction(SLT, regOne, regTwo, regThree, 0, pc, line));
+        return emitInstruction(batch, Instruction(XORI, 0, regOne, regOne, 1, pc, line));
+    default:
+        throw std::runtime_error("pseudocode not supported: " + std::string(toks[0].text));
     }
-    else if (stringVector[0] == "move")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "blt")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "bgt")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "ble")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "bge")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "beqz")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "bnez")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "not")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "neg")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "seq")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "sne")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "sle")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "sge")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "seq")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else if (stringVector[0] == "seq")
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    else
-    {
-        throw std::runtime_error("pseudocode not supported: " + stringVector[0]);
-    }
-    // Adding new instructions
-    if (!instrOne.empty())
-    {
-        Instruction curInstr(instrOne, pc, this->labelTable, this->dataTable);
-        this->instructions.push_back(curInstr);
-        pc += 4;
-    }
-    if (!instrTwo.empty())
-    {
-        Instruction curInstr(instrTwo, pc, this->labelTable, this->dataTable);
-        this->instructions.push_back(curInstr);
-        pc += 4;
-    }
+}
 
+/**
+ * Format:
+ * mnemonic $t, label
+ * Expands to lui $at, hi(label) followed by mnemonic $t, lo(label)($at)
+ */
+uint32_t MIPSParser::handleSymbolicMemory(std::span<const Token> toks, uint32_t pc, uint32_t line, EncodeBatch &batch)
+{
+    const InstructionInfo &info = *Instruction::INSTRUCTIONMAP.find(toks[0].text);
+    pc = emitInstruction(batch, Instruction(LUI, 0, 0, AT, 0, pc, line), toks[2].text, ADDR_HI_ADJ);
+    pc = emitInstruction(batch, Instruction(info, 0, AT, registerNumber(toks[1]), 0, pc, line), toks[2].text, ADDR_LO);
     return pc;
-}
\ No newline at end of file
+}
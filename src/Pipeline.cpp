@@ -0,0 +1,446 @@
+#include "Pipeline.hpp"
+#include "MIPS.hpp"
+#include "TextLabels.hpp"
+#include "Globals.hpp"
+#include <format>
+#include <numeric>
+#include <string>
+#include <utility>
+
+// Registers syscalls read and write, and the link register
+static constexpr uint8_t V0 = 2;
+static constexpr uint8_t A0 = 4;
+static constexpr uint8_t RA = 31;
+
+Pipeline::Pipeline(const std::vector<Op> &ops)
+    : timings(ops.size() - 2), counters(ops.size() - 1), results(ops.size() - 2)
+{
+    for (std::size_t i = 0; i < this->timings.size(); ++i)
+    {
+        const Op &op = ops[i];
+        Timing timing{ALU, {0, 0}, {0, 0}, 0, {}};
+        switch (op.handler)
+        {
+        case Handler::ADD:
+        case Handler::ADDU:
+        case Handler::SUB:
+        case Handler::SUBU:
+        case Handler::AND:
+        case Handler::OR:
+        case Handler::XOR:
+        case Handler::NOR:
+        case Handler::SLT:
+        case Handler::SLTU:
+            timing.sources = {op.rs, op.rt};
+            timing.destination = op.rd;
+            break;
+        case Handler::SLL:
+        case Handler::SRL:
+        case Handler::SRA:
+            timing.sources = {op.rt, 0};
+            timing.destination = op.rd;
+            break;
+        case Handler::MULT:
+        case Handler::MULTU:
+            timing.kind = MULT;
+            timing.sources = {op.rs, op.rt};
+            break;
+        case Handler::DIV:
+        case Handler::DIVU:
+            timing.kind = DIV;
+            timing.sources = {op.rs, op.rt};
+            break;
+        case Handler::MFHI:
+        case Handler::MFLO:
+            timing.kind = MOVE_FROM_HILO;
+            timing.destination = op.rd;
+            break;
+        case Handler::JR:
+            timing.kind = JUMP_REGISTER;
+            timing.sources = {op.rs, 0};
+            timing.adjust = {1, 0};
+            break;
+        case Handler::SYSCALL:
+            // The service number and first argument, reads and sbrk return in $v0
+            timing.sources = {V0, A0};
+            timing.destination = V0;
+            break;
+        case Handler::LW:
+        case Handler::LB:
+        case Handler::LBU:
+        case Handler::LH:
+            timing.kind = LOAD;
+            timing.sources = {op.rs, 0};
+            timing.destination = op.rt;
+            break;
+        case Handler::SW:
+        case Handler::SB:
+        case Handler::SH:
+            timing.kind = STORE;
+            timing.sources = {op.rs, op.rt};
+            timing.adjust = {0, -1};
+            break;
+        case Handler::BEQ:
+        case Handler::BNE:
+            timing.kind = BRANCH;
+            timing.sources = {op.rs, op.rt};
+            timing.adjust = {1, 1};
+            break;
+        case Handler::BGTZ:
+        case Handler::BLTZ:
+            timing.kind = BRANCH;
+            timing.sources = {op.rs, 0};
+            timing.adjust = {1, 0};
+            break;
+        case Handler::J:
+            timing.kind = JUMP;
+            break;
+        case Handler::JAL:
+            timing.kind = JUMP;
+            timing.destination = RA;
+            break;
+        case Handler::LUI:
+            timing.destination = op.rt;
+            break;
+        case Handler::ADDI:
+        case Handler::ADDIU:
+        case Handler::ANDI:
+        case Handler::ORI:
+        case Handler::XORI:
+        case Handler::SLTI:
+        case Handler::SLTIU:
+            timing.sources = {op.rs, 0};
+            timing.destination = op.rt;
+            break;
+        default:
+            break;
+        }
+        // Writes to $zero are discarded and never forwarded
+        if (timing.destination == 0)
+        {
+            timing.destination = NO_REGISTER;
+        }
+        for (int s = 0; s < 2; ++s)
+        {
+            // A branch reads in ID, a cycle before EX, and store data is only
+            // needed in MEM where it is never counted as forwarded
+            if (timing.sources[s] == 0 || timing.adjust[s] < 0)
+            {
+                timing.paths[s] = {NONE, NONE, NONE, NONE};
+            }
+            else if (timing.adjust[s] > 0)
+            {
+                timing.paths[s] = {NONE, TO_ID, TO_ID, NONE};
+            }
+            else
+            {
+                timing.paths[s] = {NONE, EX_MEM, MEM_WB, NONE};
+            }
+        }
+        this->timings[i] = timing;
+    }
+    clear();
+}
+
+uint64_t Pipeline::instructions() const
+{
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < this->timings.size(); ++i)
+    {
+        const auto &paths = this->counters[i].forwards[0];
+        total += std::accumulate(paths.begin(), paths.end(), uint64_t{0});
+    }
+    return total;
+}
+
+uint64_t Pipeline::cycles() const
+{
+    // The first instruction reaches EX in cycle 2, the last writes back two after its EX
+    return this->lastEx < 2 ? 0 : static_cast<uint64_t>(this->lastEx) + 3;
+}
+
+uint64_t Pipeline::stalls(Stall kind) const
+{
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < this->timings.size(); ++i)
+    {
+        total += this->counters[i].stalls[kind];
+    }
+    return total;
+}
+
+uint64_t Pipeline::forwards(Path path) const
+{
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < this->timings.size(); ++i)
+    {
+        total += this->counters[i].forwards[0][path] + this->counters[i].forwards[1][path];
+    }
+    return total;
+}
+
+void Pipeline::clear()
+{
+    std::fill(this->counters.begin(), this->counters.end(), Counters{});
+    for (std::vector<Result> &known : this->results)
+    {
+        known.clear();
+    }
+    this->window.fill({0, NO_REGISTER, 1});
+    this->hiloReady = 0;
+    // The first instruction follows no fetch at all, its lost fetch goes to
+    // the spare counters and puts it in EX in cycle 2
+    this->lastEx = 0;
+    this->lastIndex = static_cast<uint32_t>(this->timings.size());
+    this->pendingStart = 0;
+    this->pendingLength = 0;
+}
+
+void Pipeline::stop(uint32_t stop)
+{
+    place(this->pendingStart, opsRan(this->pendingStart, this->pendingLength, stop));
+    this->pendingLength = 0;
+    fold();
+}
+
+/**
+ * Only window entries less than three cycles back can stall or forward to
+ * the instruction at ex, so older ones are left out. Each entry takes nine
+ * bits (register, distance, latency) at its own slot, so states differing
+ * in any producer within reach never share a key. An entry writing no
+ * register leaves its slot zero, which no real entry is since writes to
+ * $zero have no destination. The cycles until HI and LO are ready, at most
+ * DIV_LATENCY, take the six bits above them.
+ */
+uint64_t Pipeline::stateAt(int64_t ex) const
+{
+    uint64_t state = static_cast<uint64_t>(std::clamp<int64_t>(this->hiloReady - ex, 0, 63)) << 27;
+    for (int k = 0; k < 3; ++k)
+    {
+        const Placed &placed = this->window[k];
+        int64_t distance = ex - placed.ex;
+        if (distance >= 3)
+        {
+            break;
+        }
+        // A branch or store writes nothing, but the producers behind it still count
+        if (placed.destination == NO_REGISTER)
+        {
+            continue;
+        }
+        uint64_t entry = placed.destination | static_cast<uint64_t>(distance) << 6 | static_cast<uint64_t>(placed.latency - 1) << 8;
+        state |= entry << (9 * k);
+    }
+    return state;
+}
+
+void Pipeline::place(uint32_t start, uint32_t length)
+{
+    // Blocks running off the end finish in the HALT op past the text
+    length = std::min<uint32_t>(length, static_cast<uint32_t>(this->timings.size()) - std::min<uint32_t>(start, this->timings.size()));
+    if (length == 0)
+    {
+        return;
+    }
+    int64_t ex = this->lastEx + 1;
+    // Fetch went on at the next address, anything else lost that fetch
+    if (start != this->lastIndex + 1)
+    {
+        ++ex;
+        ++this->counters[this->lastIndex].stalls[CONTROL];
+    }
+    const uint64_t state = stateAt(ex);
+    std::vector<Result> &known = this->results[start];
+    for (Result &result : known)
+    {
+        if (result.state == state && result.length == length)
+        {
+            ++result.pending;
+            for (int k = 0; k < 3; ++k)
+            {
+                this->window[k] = {ex + result.window[k].ex, result.window[k].destination, result.window[k].latency};
+            }
+            if (result.setsHilo)
+            {
+                this->hiloReady = ex + result.hiloReady;
+            }
+            this->lastEx = ex + result.cycles - 1;
+            this->lastIndex = start + length - 1;
+            return;
+        }
+    }
+    if (known.size() >= MAX_RESULTS)
+    {
+        score(start, length, ex, &this->counters[start]);
+        return;
+    }
+
+    Result result;
+    result.state = state;
+    result.length = length;
+    result.pending = 1;
+    result.counts.resize(length);
+    const int64_t hiloBefore = this->hiloReady;
+    score(start, length, ex, result.counts.data());
+    result.cycles = this->lastEx - ex + 1;
+    for (int k = 0; k < 3; ++k)
+    {
+        const Placed &placed = this->window[k];
+        // Entries already out of reach stay so, and must not tell entry states apart
+        bool reachable = placed.destination != NO_REGISTER && this->lastEx + 1 - placed.ex < 3;
+        result.window[k] = reachable ? Placed{placed.ex - ex, placed.destination, placed.latency} : Placed{0, NO_REGISTER, 1};
+    }
+    result.setsHilo = this->hiloReady != hiloBefore;
+    result.hiloReady = this->hiloReady - ex;
+    known.push_back(std::move(result));
+}
+
+void Pipeline::score(uint32_t start, uint32_t length, int64_t ex, Counters *counts)
+{
+    // Locals, so the loop does not wait on its own stores
+    std::array<Placed, 3> window = this->window;
+    int64_t hiloReady = this->hiloReady;
+    // Newest instruction in the window writing source, null for none
+    auto producerOf = [&window](uint8_t source) -> const Placed *
+    {
+        for (const Placed &placed : window)
+        {
+            if (placed.destination == source)
+            {
+                return &placed;
+            }
+        }
+        return nullptr;
+    };
+    // Far enough back to be neither waited for nor forwarded from
+    constexpr int64_t LONG_AGO = -1000;
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        const Timing &timing = this->timings[start + i];
+        Counters &counters = counts[i];
+        const Placed *first = producerOf(timing.sources[0]);
+        const Placed *second = producerOf(timing.sources[1]);
+        int64_t firstEx = first != nullptr ? first->ex : ex + LONG_AGO;
+        int64_t secondEx = second != nullptr ? second->ex : ex + LONG_AGO;
+        int64_t data = std::max(firstEx + (first != nullptr ? first->latency : 0) + timing.adjust[0],
+                                secondEx + (second != nullptr ? second->latency : 0) + timing.adjust[1]);
+        if (data > ex)
+        {
+            counters.stalls[timing.kind == BRANCH || timing.kind == JUMP_REGISTER ? BRANCH_DATA : LOAD_USE] += static_cast<uint64_t>(data - ex);
+            ex = data;
+        }
+        if (timing.kind >= MULT && hiloReady > ex)
+        {
+            counters.stalls[HILO] += static_cast<uint64_t>(hiloReady - ex);
+            ex = hiloReady;
+        }
+        // Distances past 2 read the register file, which the path tables count as NONE
+        ++counters.forwards[0][timing.paths[0][std::min<int64_t>(ex - firstEx, 3)]];
+        ++counters.forwards[1][timing.paths[1][std::min<int64_t>(ex - secondEx, 3)]];
+
+        if (timing.kind == MULT || timing.kind == DIV)
+        {
+            hiloReady = ex + (timing.kind == MULT ? MULT_LATENCY : DIV_LATENCY);
+        }
+        window = {Placed{ex, timing.destination, static_cast<uint8_t>(timing.kind == LOAD ? 2 : 1)}, window[0], window[1]};
+        ++ex;
+    }
+    this->window = window;
+    this->hiloReady = hiloReady;
+    this->lastEx = ex - 1;
+    this->lastIndex = start + length - 1;
+}
+
+void Pipeline::fold()
+{
+    for (std::size_t start = 0; start < this->results.size(); ++start)
+    {
+        for (Result &result : this->results[start])
+        {
+            if (result.pending == 0)
+            {
+                continue;
+            }
+            for (uint32_t i = 0; i < result.length; ++i)
+            {
+                Counters &total = this->counters[start + i];
+                const Counters &once = result.counts[i];
+                for (int k = 0; k < STALL_KINDS; ++k)
+                {
+                    total.stalls[k] += result.pending * once.stalls[k];
+                }
+                for (int s = 0; s < 2; ++s)
+                {
+                    for (int p = 0; p <= PATHS; ++p)
+                    {
+                        total.forwards[s][p] += result.pending * once.forwards[s][p];
+                    }
+                }
+            }
+            result.pending = 0;
+        }
+    }
+}
+
+/**
+ * Prints CPI, stalls and forwards for the run, then one row per label ranked
+ * by cycles. An instruction's cycles are one plus the stalls charged to it:
+ * data stalls to the instruction that waited, the lost fetch to the branch
+ * or jump
+ */
+void Pipeline::report(std::ostream &out, const MIPS &program, std::size_t hottest) const
+{
+    const uint32_t count = static_cast<uint32_t>(this->timings.size());
+    const uint64_t executed = instructions();
+    const uint64_t total = cycles();
+    auto cpi = [](uint64_t cycles, uint64_t instructions)
+    {
+        return instructions == 0 ? 0.0 : static_cast<double>(cycles) / static_cast<double>(instructions);
+    };
+
+    out << std::format("pipeline: {} instructions in {} cycles, CPI {:.3f}\n", executed, total, cpi(total, executed));
+    out << std::format("stalls:   {} load-use, {} branch operand, {} hi/lo, {} taken branch and jump\n", stalls(LOAD_USE),
+                       stalls(BRANCH_DATA), stalls(HILO), stalls(CONTROL));
+    out << std::format("forwards: {} EX/MEM to EX, {} MEM/WB to EX, {} to ID\n", forwards(EX_MEM), forwards(MEM_WB), forwards(TO_ID));
+
+    struct Row
+    {
+        std::string_view name;
+        uint64_t executed = 0;
+        uint64_t cycles = 0;
+        std::array<uint64_t, STALL_KINDS> stalls{};
+    };
+    const TextLabels labels(program, count);
+    std::vector<Row> rows;
+    for (const TextLabels::Range &label : labels.ranges())
+    {
+        Row row;
+        row.name = label.name;
+        for (uint32_t i = label.start; i < label.end; ++i)
+        {
+            const Counters &c = this->counters[i];
+            uint64_t executed = std::accumulate(c.forwards[0].begin(), c.forwards[0].end(), uint64_t{0});
+            row.executed += executed;
+            row.cycles += executed;
+            for (int k = 0; k < STALL_KINDS; ++k)
+            {
+                row.stalls[k] += c.stalls[k];
+                row.cycles += c.stalls[k];
+            }
+        }
+        if (row.executed > 0)
+        {
+            rows.push_back(row);
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.cycles > b.cycles; });
+
+    out << std::format("  {:<24} {:>14} {:>14} {:>6} {:>12} {:>12} {:>12} {:>12}\n", "label", "instructions", "cycles", "CPI", "load-use",
+                       "branch op", "hi/lo", "control");
+    for (std::size_t r = 0; r < std::min(hottest, rows.size()); ++r)
+    {
+        const Row &row = rows[r];
+        out << std::format("  {:<24} {:>14} {:>14} {:>6.3f} {:>12} {:>12} {:>12} {:>12}\n", row.name, row.executed, row.cycles,
+                           cpi(row.cycles, row.executed), row.stalls[LOAD_USE], row.stalls[BRANCH_DATA], row.stalls[HILO], row.stalls[CONTROL]);
+    }
+}
@@ -0,0 +1,155 @@
+#include "Profiler.hpp"
+#include "MIPS.hpp"
+#include "CPU.hpp"
+#include "Globals.hpp"
+#include "TextLabels.hpp"
+#include <algorithm>
+#include <format>
+#include <numeric>
+#include <string>
+#include <utility>
+
+Profiler::Profiler(std::size_t instructions)
+    : counts(instructions + 2), takenCounts(instructions + 2)
+{
+}
+
+uint64_t Profiler::executed(uint32_t index) const
+{
+    return index < this->counts.size() ? this->counts[index] : 0;
+}
+
+uint64_t Profiler::branchesTaken(uint32_t index) const
+{
+    return index < this->takenCounts.size() ? this->takenCounts[index] : 0;
+}
+
+uint64_t Profiler::total() const
+{
+    // HALT and BAD_TARGET are not instructions
+    return std::accumulate(this->counts.begin(), this->counts.end() - 2, uint64_t{0});
+}
+
+void Profiler::clear()
+{
+    std::fill(this->counts.begin(), this->counts.end(), 0);
+    std::fill(this->takenCounts.begin(), this->takenCounts.end(), 0);
+}
+
+static bool isBranch(Handler handler)
+{
+    return handler == Handler::BEQ || handler == Handler::BNE || handler == Handler::BGTZ || handler == Handler::BLTZ;
+}
+
+/**
+ * Functions are the entry point and every label a jal calls, so loop labels
+ * inside a function do not split it up. Each instruction belongs to the
+ * closest function label at or before it, and loops and hot instructions are
+ * named as in the other reports, see TextLabels. Loops are backward branches
+ * and jumps, measured by how often they were taken.
+ */
+void Profiler::report(std::ostream &out, const MIPS &program, std::size_t hottest) const
+{
+    const uint32_t count = static_cast<uint32_t>(program.instructions.size());
+    const std::vector<Op> ops = CPU::predecode(program.instructions);
+    const uint64_t all = total();
+    auto percent = [all](uint64_t n)
+    {
+        return all == 0 ? 0.0 : 100.0 * static_cast<double>(n) / static_cast<double>(all);
+    };
+
+    std::vector<bool> called(count + 2, false);
+    for (const Op &op : ops)
+    {
+        if (op.handler == Handler::JAL)
+        {
+            called[op.imm] = true;
+        }
+    }
+    // Execution starts at the global label, or at the first instruction without one
+    auto entry = program.labelTable.find(program.global);
+    uint32_t start = entry != program.labelTable.end() ? entry->second - PC_START : 0;
+    if (start < count * 4)
+    {
+        called[start / 4] = true;
+    }
+    // A function runs up to the next called label, and code before the first
+    // one is "(start)". Without any called label every label is a function.
+    const TextLabels labels(program, count);
+    const bool anyCalled = std::any_of(labels.ranges().begin(), labels.ranges().end(),
+                                       [&called](const TextLabels::Range &label) { return called[label.start]; });
+    std::vector<TextLabels::Range> functions;
+    for (const TextLabels::Range &label : labels.ranges())
+    {
+        if (label.start == label.end)
+        {
+            continue;
+        }
+        if (functions.empty() || !anyCalled || called[label.start])
+        {
+            functions.push_back({!anyCalled || called[label.start] ? label.name : "(start)", label.start, label.end});
+        }
+        else
+        {
+            functions.back().end = label.end;
+        }
+    }
+
+    out << std::format("profile: {} instructions executed\n", all);
+    out << "functions:\n";
+    std::vector<std::pair<uint64_t, std::string_view>> perFunction;
+    for (const TextLabels::Range &function : functions)
+    {
+        uint64_t n = std::accumulate(this->counts.begin() + function.start, this->counts.begin() + function.end, uint64_t{0});
+        if (n > 0 || function.name != "(start)")
+        {
+            perFunction.emplace_back(n, function.name);
+        }
+    }
+    std::stable_sort(perFunction.begin(), perFunction.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (const auto &[n, name] : perFunction)
+    {
+        out << std::format("  {:<24} {:>14} {:>7.2f}%\n", name, n, percent(n));
+    }
+
+    out << "loops:\n";
+    std::vector<std::pair<uint64_t, uint32_t>> loops;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Handler handler = ops[i].handler;
+        bool jump = handler == Handler::J;
+        if ((isBranch(handler) || jump) && static_cast<uint32_t>(ops[i].imm) <= i)
+        {
+            uint64_t iterations = jump ? this->counts[i] : this->takenCounts[i];
+            if (iterations > 0)
+            {
+                loops.emplace_back(iterations, i);
+            }
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (std::size_t l = 0; l < std::min(hottest, loops.size()); ++l)
+    {
+        uint32_t back = loops[l].second;
+        uint32_t head = static_cast<uint32_t>(ops[back].imm);
+        uint64_t body = std::accumulate(this->counts.begin() + head, this->counts.begin() + back + 1, uint64_t{0});
+        out << std::format("  {:<24} 0x{:08x}-0x{:08x} {:>12} iterations {:>7.2f}%\n",
+                           labels.nameOf(head), PC_START + head * 4, PC_START + back * 4, loops[l].first, percent(body));
+    }
+
+    out << "hottest instructions:\n";
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return this->counts[a] > this->counts[b]; });
+    for (std::size_t h = 0; h < std::min<std::size_t>(hottest, order.size()) && this->counts[order[h]] > 0; ++h)
+    {
+        uint32_t i = order[h];
+        const Instruction &instr = program.instructions[i];
+        out << std::format("  0x{:08x} {:>14} {:>7.2f}%  {:<16} {:<24} {}\n", instr.address, this->counts[i], percent(this->counts[i]),
+                           labels.nameOf(i), instr.disassemble(), program.textLines[instr.line]);
+        if (isBranch(ops[i].handler))
+        {
+            out << std::format("  {:>10} {} taken, {} not taken\n", "", this->takenCounts[i], this->counts[i] - this->takenCounts[i]);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#include "Program.hpp"
+#include "MIPS.hpp"
+#include "CPU.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+
+Program::Program(const MIPS &assembled)
+    : ops(CPU::predecode(assembled.instructions)), text(assembled.instructions.size() * 4), data(assembled.dataImage), entry(PC_START)
+{
+    for (std::size_t i = 0; i < assembled.instructions.size(); ++i)
+    {
+        uint32_t machine = assembled.instructions[i].machine;
+        this->text[i * 4] = static_cast<uint8_t>(machine >> 24);
+        this->text[i * 4 + 1] = static_cast<uint8_t>(machine >> 16);
+        this->text[i * 4 + 2] = static_cast<uint8_t>(machine >> 8);
+        this->text[i * 4 + 3] = static_cast<uint8_t>(machine);
+    }
+    for (const auto &[name, address] : assembled.labelTable)
+    {
+        uint32_t offset = address - PC_START;
+        if (offset % 4 == 0 && offset / 4 <= assembled.instructions.size())
+        {
+            this->labels.push_back(offset / 4);
+        }
+    }
+    auto label = assembled.labelTable.find(assembled.global);
+    if (label != assembled.labelTable.end())
+    {
+        this->entry = label->second;
+    }
+    uint32_t size = std::max<uint32_t>(DATA_SEGMENT_SIZE, static_cast<uint32_t>(this->data.size()));
+    this->dataEnd = (DATA_START + size + DataSegment::PAGE_SIZE - 1) & ~(DataSegment::PAGE_SIZE - 1);
+}
@@ -0,0 +1,340 @@
+#include "ProgramCache.hpp"
+#include "MIPS.hpp"
+#include "Globals.hpp"
+#include "SourceFile.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+
+// Start of every entry, followed by the key, payload size and payload checksum
+static constexpr std::string_view MAGIC = "MIPSPROG";
+static constexpr std::size_t HEADER_SIZE = 8 + 3 * 8;
+
+/**
+ * FNV-1a style hash taking 8 bytes per step, with a rotate so high bits reach
+ * the low ones. Words are read in host order, so another host only misses.
+ */
+static uint64_t hashBytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull)
+{
+    constexpr uint64_t PRIME = 1099511628211ull;
+    std::size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = std::rotl((hash ^ word) * PRIME, 29);
+    }
+    for (; i < bytes.size(); ++i)
+    {
+        hash = (hash ^ static_cast<uint8_t>(bytes[i])) * PRIME;
+    }
+    return hash ^ (hash >> 32);
+}
+
+// Fixed width little-endian fields so entries do not depend on the host
+static void put32(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+}
+
+static void put64(std::string &out, uint64_t value)
+{
+    put32(out, static_cast<uint32_t>(value));
+    put32(out, static_cast<uint32_t>(value >> 32));
+}
+
+static void putString(std::string &out, std::string_view text)
+{
+    put32(out, static_cast<uint32_t>(text.size()));
+    out.append(text);
+}
+
+/**
+ * Reads fields back, any read past the end marks the entry as corrupt and
+ * returns zeros so callers only need to check ok() once they are done
+ */
+class EntryReader
+{
+public:
+    EntryReader(std::string_view data) : data(data), pos(0), valid(true) {}
+
+    uint32_t get32()
+    {
+        std::string_view bytes = take(4);
+        uint32_t value = 0;
+        for (std::size_t i = 0; i < bytes.size(); ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[i])) << (i * 8);
+        }
+        return value;
+    }
+
+    uint64_t get64()
+    {
+        uint64_t low = get32();
+        return low | (static_cast<uint64_t>(get32()) << 32);
+    }
+
+    std::string_view getString()
+    {
+        return take(get32());
+    }
+
+    std::string_view take(std::size_t size)
+    {
+        if (!this->valid || size > this->data.size() - this->pos)
+        {
+            this->valid = false;
+            return {};
+        }
+        std::string_view bytes = this->data.substr(this->pos, size);
+        this->pos += size;
+        return bytes;
+    }
+
+    // Rejecting counts that could not fit in what is left, before allocating for them
+    bool fits(uint32_t count, std::size_t minSize)
+    {
+        this->valid = this->valid && count <= (this->data.size() - this->pos) / minSize;
+        return this->valid;
+    }
+
+    bool ok() const
+    {
+        return this->valid;
+    }
+
+    bool atEnd() const
+    {
+        return this->pos == this->data.size();
+    }
+
+private:
+    std::string_view data;
+    std::size_t pos;
+    bool valid;
+};
+
+ProgramCache::ProgramCache(const std::string &directory)
+    : directory(directory)
+{
+}
+
+/**
+ * The segment addresses change every encoded address, so they are part of
+ * the key along with the version
+ */
+uint64_t ProgramCache::keyFor(std::string_view source)
+{
+    std::string prefix(ASSEMBLER_VERSION);
+    put32(prefix, PC_START);
+    put32(prefix, DATA_START);
+    return hashBytes(source, hashBytes(prefix));
+}
+
+std::string ProgramCache::pathFor(uint64_t key) const
+{
+    return std::format("{}/{:016x}.mipsprog", this->directory, key);
+}
+
+bool ProgramCache::load(uint64_t key, MIPS &mips) const
+{
+    std::string_view entry;
+    std::unique_ptr<SourceFile> file;
+    try
+    {
+        file = std::make_unique<SourceFile>(pathFor(key));
+        entry = file->contents();
+    }
+    catch (const std::runtime_error &)
+    {
+        return false;
+    }
+    EntryReader header(entry);
+    if (header.take(MAGIC.size()) != MAGIC || header.get64() != key)
+    {
+        return false;
+    }
+    uint64_t payloadSize = header.get64();
+    uint64_t checksum = header.get64();
+    std::string_view payload = entry.substr(std::min(entry.size(), HEADER_SIZE));
+    if (!header.ok() || payloadSize != payload.size() || hashBytes(payload) != checksum)
+    {
+        return false;
+    }
+
+    // Decoding into locals so a bad entry leaves mips untouched
+    EntryReader in(payload);
+    std::vector<Instruction> instructions;
+    uint32_t count = in.get32();
+    if (!in.fits(count, 8))
+    {
+        return false;
+    }
+    instructions.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t machine = in.get32();
+        uint32_t line = in.get32();
+        instructions.push_back(Instruction::decode(machine, PC_START + i * 4, line));
+    }
+
+    // Line lengths, then every line back to back
+    std::vector<uint32_t> lineLengths;
+    count = in.get32();
+    if (!in.fits(count, 4))
+    {
+        return false;
+    }
+    lineLengths.reserve(count);
+    uint64_t textSize = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        lineLengths.push_back(in.get32());
+        textSize += lineLengths.back();
+    }
+    std::string_view text = in.getString();
+    if (text.size() != textSize)
+    {
+        return false;
+    }
+    for (const Instruction &instr : instructions)
+    {
+        if (instr.line >= lineLengths.size())
+        {
+            return false;
+        }
+    }
+
+    std::string_view image = in.getString();
+
+    StringMap<uint32_t> labelTable;
+    count = in.get32();
+    if (!in.fits(count, 8))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        std::string_view name = in.getString();
+        labelTable.insert_or_assign(std::string(name), in.get32());
+    }
+
+    StringMap<Data> dataTable;
+    count = in.get32();
+    if (!in.fits(count, 20))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        Data data;
+        data.label = in.getString();
+        data.directive = in.getString();
+        data.val = in.getString();
+        data.address = in.get32();
+        data.size = in.get32();
+        std::string name = data.label;
+        dataTable.insert_or_assign(std::move(name), std::move(data));
+    }
+    std::string_view global = in.getString();
+    if (!in.ok() || !in.atEnd())
+    {
+        return false;
+    }
+
+    mips.instructions = std::move(instructions);
+    mips.cachedText = text;
+    mips.textLines.clear();
+    mips.textLines.reserve(lineLengths.size());
+    const char *line = mips.cachedText.data();
+    for (uint32_t length : lineLengths)
+    {
+        mips.textLines.emplace_back(line, length);
+        line += length;
+    }
+    mips.dataImage.assign(image.begin(), image.end());
+    mips.labelTable = std::move(labelTable);
+    mips.dataTable = std::move(dataTable);
+    mips.global = global;
+    mips.source.reset();
+    return true;
+}
+
+/**
+ * Written to a temporary name and renamed into place, so a reader never sees
+ * half an entry and concurrent writers of the same key do not interfere
+ */
+void ProgramCache::store(uint64_t key, const MIPS &mips) const
+{
+    std::string payload;
+    put32(payload, static_cast<uint32_t>(mips.instructions.size()));
+    for (const Instruction &instr : mips.instructions)
+    {
+        put32(payload, instr.machine);
+        put32(payload, instr.line);
+    }
+    put32(payload, static_cast<uint32_t>(mips.textLines.size()));
+    std::size_t textSize = 0;
+    for (std::string_view line : mips.textLines)
+    {
+        put32(payload, static_cast<uint32_t>(line.size()));
+        textSize += line.size();
+    }
+    put32(payload, static_cast<uint32_t>(textSize));
+    for (std::string_view line : mips.textLines)
+    {
+        payload.append(line);
+    }
+    putString(payload, std::string_view(reinterpret_cast<const char *>(mips.dataImage.data()), mips.dataImage.size()));
+    put32(payload, static_cast<uint32_t>(mips.labelTable.size()));
+    for (const auto &[name, address] : mips.labelTable)
+    {
+        putString(payload, name);
+        put32(payload, address);
+    }
+    put32(payload, static_cast<uint32_t>(mips.dataTable.size()));
+    for (const auto &[name, data] : mips.dataTable)
+    {
+        putString(payload, data.label);
+        putString(payload, data.directive);
+        putString(payload, data.val);
+        put32(payload, data.address);
+        put32(payload, data.size);
+    }
+    putString(payload, mips.global);
+
+    std::string header(MAGIC);
+    put64(header, key);
+    put64(header, payload.size());
+    put64(header, hashBytes(payload));
+
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    std::string path = pathFor(key);
+    std::string temporary = std::format("{}.{}.tmp", path, static_cast<long>(::getpid()));
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(header.data(), static_cast<std::streamsize>(header.size()));
+        file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+    }
+}
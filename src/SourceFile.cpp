@@ -0,0 +1,158 @@
+#include "SourceFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::SourceFile(const std::string &path)
+    : mapping(nullptr), mappedSize(0), pos(0), fd(-1), ownsFd(false), eof(false),
+      chunkSize(0), lineStart(nullptr), filled(nullptr), scan(nullptr)
+{
+    if (path == "-")
+    {
+        this->fd = STDIN_FILENO;
+    }
+    else
+    {
+        this->fd = ::open(path.c_str(), O_RDONLY);
+        if (this->fd < 0)
+        {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+        this->ownsFd = true;
+    }
+
+    struct stat info;
+    if (::fstat(this->fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        void *addr = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            // Lines are read front to back, the kernel can read ahead and drop pages behind
+            ::madvise(addr, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+            this->mapping = addr;
+            this->mappedSize = static_cast<std::size_t>(info.st_size);
+        }
+    }
+}
+
+SourceFile::~SourceFile()
+{
+    if (this->mapping != nullptr)
+    {
+        ::munmap(this->mapping, this->mappedSize);
+    }
+    if (this->ownsFd)
+    {
+        ::close(this->fd);
+    }
+}
+
+bool SourceFile::isMapped() const
+{
+    return this->mapping != nullptr;
+}
+
+std::string_view SourceFile::contents() const
+{
+    if (this->mapping == nullptr)
+    {
+        return {};
+    }
+    return std::string_view(static_cast<const char *>(this->mapping), this->mappedSize);
+}
+
+bool SourceFile::nextLine(std::string_view &line)
+{
+    if (this->mapping != nullptr)
+    {
+        if (this->pos >= this->mappedSize)
+        {
+            return false;
+        }
+        const char *base = static_cast<const char *>(this->mapping);
+        const void *newline = std::memchr(base + this->pos, '\n', this->mappedSize - this->pos);
+        std::size_t end = newline ? static_cast<std::size_t>(static_cast<const char *>(newline) - base) : this->mappedSize;
+        line = std::string_view(base + this->pos, end - this->pos);
+        this->pos = end + 1;
+        return true;
+    }
+
+    while (true)
+    {
+        if (this->scan < this->filled)
+        {
+            char *newline = static_cast<char *>(std::memchr(this->scan, '\n', static_cast<std::size_t>(this->filled - this->scan)));
+            if (newline != nullptr)
+            {
+                line = std::string_view(this->lineStart, static_cast<std::size_t>(newline - this->lineStart));
+                this->lineStart = this->scan = newline + 1;
+                return true;
+            }
+            this->scan = this->filled;
+        }
+        if (!refill())
+        {
+            break;
+        }
+    }
+    // Last line without a trailing '\n'
+    if (this->lineStart < this->filled)
+    {
+        line = std::string_view(this->lineStart, static_cast<std::size_t>(this->filled - this->lineStart));
+        this->lineStart = this->filled;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Reads into the free end of the last chunk. When it is full, the partial
+ * line is moved to a fresh chunk, earlier chunks stay where they are.
+ */
+bool SourceFile::refill()
+{
+    if (this->eof)
+    {
+        return false;
+    }
+    if (this->chunks.empty() || this->filled == this->chunks.back().get() + this->chunkSize)
+    {
+        std::size_t partial = static_cast<std::size_t>(this->filled - this->lineStart);
+        // A single line longer than a chunk gets a chunk of its own
+        std::size_t size = std::max(CHUNK_SIZE, partial * 2);
+        auto chunk = std::make_unique<char[]>(size);
+        if (partial > 0)
+        {
+            std::memcpy(chunk.get(), this->lineStart, partial);
+        }
+        this->lineStart = chunk.get();
+        this->filled = this->scan = chunk.get() + partial;
+        this->chunkSize = size;
+        this->chunks.push_back(std::move(chunk));
+    }
+    char *chunkEnd = this->chunks.back().get() + this->chunkSize;
+    while (true)
+    {
+        ssize_t count = ::read(this->fd, this->filled, static_cast<std::size_t>(chunkEnd - this->filled));
+        if (count > 0)
+        {
+            this->filled += count;
+            return true;
+        }
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            throw std::runtime_error(std::string("Failed to read source: ") + std::strerror(errno));
+        }
+        this->eof = true;
+        return false;
+    }
+}
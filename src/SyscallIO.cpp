@@ -0,0 +1,138 @@
+#include "SyscallIO.hpp"
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+SyscallIO::SyscallIO(std::istream &in, std::ostream &out)
+    : input(in.rdbuf()), out(out), buffer(new char[OUTPUT_BUFFER_SIZE]), used(0), buffered(true), written(0), flushes(0)
+{
+}
+
+SyscallIO::~SyscallIO()
+{
+    flush();
+}
+
+void SyscallIO::printInt(int32_t value)
+{
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    append(digits, static_cast<std::size_t>(result.ptr - digits));
+}
+
+void SyscallIO::printString(std::string_view text)
+{
+    append(text.data(), text.size());
+}
+
+void SyscallIO::printChar(char c)
+{
+    append(&c, 1);
+}
+
+/**
+ * Same rules as operator>> for int: leading whitespace is skipped, an
+ * optional sign and at least one digit are needed, and the value must fit
+ */
+bool SyscallIO::readInt(int32_t &value)
+{
+    flush();
+    constexpr int END = std::char_traits<char>::eof();
+    int c = this->input->sgetc();
+    while (c != END && std::isspace(c))
+    {
+        c = this->input->snextc();
+    }
+    bool negative = c == '-';
+    if (c == '-' || c == '+')
+    {
+        c = this->input->snextc();
+    }
+    if (c == END || !std::isdigit(c))
+    {
+        return false;
+    }
+    int64_t magnitude = 0;
+    for (; c != END && std::isdigit(c); c = this->input->snextc())
+    {
+        magnitude = std::min<int64_t>(magnitude * 10 + (c - '0'), int64_t{1} << 32);
+    }
+    int64_t signedValue = negative ? -magnitude : magnitude;
+    if (signedValue < std::numeric_limits<int32_t>::min() || signedValue > std::numeric_limits<int32_t>::max())
+    {
+        return false;
+    }
+    value = static_cast<int32_t>(signedValue);
+    return true;
+}
+
+std::string SyscallIO::readLine()
+{
+    flush();
+    std::string line;
+    for (int c = this->input->sbumpc(); c != std::char_traits<char>::eof(); c = this->input->sbumpc())
+    {
+        line += static_cast<char>(c);
+        if (c == '\n')
+        {
+            break;
+        }
+    }
+    return line;
+}
+
+int SyscallIO::readChar()
+{
+    flush();
+    return this->input->sbumpc();
+}
+
+void SyscallIO::flush()
+{
+    if (this->used > 0)
+    {
+        this->out.write(this->buffer.get(), static_cast<std::streamsize>(this->used));
+        this->used = 0;
+        ++this->flushes;
+    }
+    this->out.flush();
+}
+
+void SyscallIO::setBuffered(bool buffered)
+{
+    flush();
+    this->buffered = buffered;
+}
+
+uint64_t SyscallIO::bytesWritten() const
+{
+    return this->written;
+}
+
+uint64_t SyscallIO::flushCount() const
+{
+    return this->flushes;
+}
+
+// Text larger than the buffer skips it once what is pending has gone out
+void SyscallIO::append(const char *data, std::size_t size)
+{
+    this->written += size;
+    if (this->used + size > OUTPUT_BUFFER_SIZE)
+    {
+        flush();
+        if (size > OUTPUT_BUFFER_SIZE)
+        {
+            this->out.write(data, static_cast<std::streamsize>(size));
+            ++this->flushes;
+            size = 0;
+        }
+    }
+    std::memcpy(this->buffer.get() + this->used, data, size);
+    this->used += size;
+    if (!this->buffered)
+    {
+        flush();
+    }
+}
@@ -0,0 +1,40 @@
+#include "TextLabels.hpp"
+#include "MIPS.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <format>
+#include <utility>
+
+TextLabels::TextLabels(const MIPS &program, uint32_t count)
+{
+    std::vector<std::pair<uint32_t, std::string_view>> sorted;
+    for (const auto &[name, address] : program.labelTable)
+    {
+        uint32_t offset = address - PC_START;
+        if (offset % 4 == 0 && offset / 4 < count)
+        {
+            sorted.emplace_back(offset / 4, name);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.empty() || sorted.front().first != 0)
+    {
+        sorted.insert(sorted.begin(), {0, "(start)"});
+    }
+    for (std::size_t l = 0; l < sorted.size(); ++l)
+    {
+        uint32_t end = l + 1 < sorted.size() ? sorted[l + 1].first : count;
+        this->labels.push_back({sorted[l].second, sorted[l].first, end});
+    }
+}
+
+const std::vector<TextLabels::Range> &TextLabels::ranges() const
+{
+    return this->labels;
+}
+
+std::string TextLabels::nameOf(uint32_t index) const
+{
+    auto it = std::upper_bound(this->labels.begin(), this->labels.end(), index, [](uint32_t i, const Range &label) { return i < label.start; }) - 1;
+    return index == it->start ? std::string(it->name) : std::format("{}+{}", it->name, (index - it->start) * 4);
+}
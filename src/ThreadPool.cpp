@@ -0,0 +1,224 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <latch>
+
+ThreadPool::ThreadPool(unsigned threads)
+    : stopping(false)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // The thread calling parallelFor is one of the workers
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->available.notify_all();
+    for (std::thread &worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const
+{
+    return static_cast<unsigned>(this->workers.size() + 1);
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->available.wait(lock, [this]
+                                 { return this->stopping || !this->queue.empty(); });
+            if (this->queue.empty())
+            {
+                return;
+            }
+            job = std::move(this->queue.front());
+            this->queue.pop_front();
+        }
+        job();
+    }
+}
+
+/**
+ * Each helper claims the next unclaimed index until none are left, so uneven
+ * tasks balance themselves without a queue entry per index.
+ */
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)> &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::size_t errorIndex = count;
+    auto drain = [&]
+    {
+        for (std::size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (i < errorIndex)
+                {
+                    errorIndex = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::size_t helpers = std::min(this->workers.size(), count - 1);
+    std::latch done(static_cast<std::ptrdiff_t>(helpers));
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (std::size_t i = 0; i < helpers; ++i)
+        {
+            this->queue.emplace_back([&]
+                                     { drain(); done.count_down(); });
+        }
+    }
+    this->available.notify_all();
+    drain();
+    done.wait();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * Shares are only locked to take one index or to split, so with tasks much
+ * longer than a lock the threads never wait on each other. Long and short
+ * tasks mixed unevenly still balance, since idle threads split the busiest
+ * share instead of waiting for it.
+ */
+void ThreadPool::stealingFor(std::size_t count, const std::function<void(std::size_t, unsigned)> &task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    struct alignas(64) Share
+    {
+        std::mutex mutex;
+        std::size_t begin;
+        std::size_t end;
+    };
+    const std::size_t helpers = std::min(this->workers.size(), count - 1);
+    const std::size_t threads = helpers + 1;
+    std::vector<Share> shares(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        shares[i].begin = count * i / threads;
+        shares[i].end = count * (i + 1) / threads;
+    }
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::size_t errorIndex = count;
+
+    // Next index from the thread's own share, stealing when that is empty
+    auto take = [&](std::size_t slot, std::size_t &index)
+    {
+        Share &own = shares[slot];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin < own.end)
+            {
+                index = own.begin++;
+                return true;
+            }
+        }
+        while (true)
+        {
+            std::size_t victim = threads;
+            std::size_t largest = 0;
+            for (std::size_t i = 0; i < threads; ++i)
+            {
+                std::lock_guard<std::mutex> lock(shares[i].mutex);
+                if (shares[i].end - shares[i].begin > largest)
+                {
+                    largest = shares[i].end - shares[i].begin;
+                    victim = i;
+                }
+            }
+            if (victim == threads)
+            {
+                return false;
+            }
+            std::scoped_lock lock(own.mutex, shares[victim].mutex);
+            Share &from = shares[victim];
+            if (from.begin >= from.end)
+            {
+                // Drained while we looked, pick again
+                continue;
+            }
+            std::size_t middle = from.begin + (from.end - from.begin) / 2;
+            index = middle;
+            own.begin = middle + 1;
+            own.end = from.end;
+            from.end = middle;
+            return true;
+        }
+    };
+    auto drain = [&](unsigned slot)
+    {
+        std::size_t i;
+        while (take(slot, i))
+        {
+            try
+            {
+                task(i, slot);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (i < errorIndex)
+                {
+                    errorIndex = i;
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::latch done(static_cast<std::ptrdiff_t>(helpers));
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (std::size_t i = 0; i < helpers; ++i)
+        {
+            unsigned slot = static_cast<unsigned>(i + 1);
+            this->queue.emplace_back([&, slot]
+                                     { drain(slot); done.count_down(); });
+        }
+    }
+    this->available.notify_all();
+    drain(0);
+    done.wait();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,524 @@
+#include "Trace.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr std::string_view MAGIC = "MIPSTRC1";
+
+// Fixed width little-endian fields, as in the program cache
+static void put32(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+}
+
+static void putVarint(std::string &out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Small changes either way become small unsigned numbers
+static uint32_t zigzag(uint32_t delta)
+{
+    return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// Reads a varint at position, throwing when the block ends inside it
+static uint32_t getVarint(const std::string &in, std::size_t &position)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (position >= in.size())
+        {
+            throw std::runtime_error("Trace block ends inside a number");
+        }
+        uint8_t byte = static_cast<uint8_t>(in[position++]);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Trace block holds an overlong number");
+}
+
+/**
+ * LZ77 over the raw records: runs of literals alternate with copies of
+ * earlier bytes, found through a hash of the next four bytes. Each sequence
+ * is the literal count, the literals, then the copy length and distance,
+ * all varints. The records of a loop repeat almost byte for byte, so most
+ * of a block turns into copies.
+ */
+static std::string compressBlock(const std::string &raw)
+{
+    constexpr std::size_t MIN_MATCH = 4;
+    constexpr uint32_t HASH_BITS = 14;
+    std::vector<uint32_t> table(std::size_t{1} << HASH_BITS, UINT32_MAX);
+    auto read32 = [&raw](std::size_t at)
+    {
+        uint32_t word;
+        std::memcpy(&word, raw.data() + at, 4);
+        return word;
+    };
+    std::string out;
+    out.reserve(raw.size() / 2);
+    std::size_t anchor = 0;
+    std::size_t i = 0;
+    while (i + MIN_MATCH <= raw.size())
+    {
+        uint32_t hash = (read32(i) * 2654435761u) >> (32 - HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(i);
+        if (candidate == UINT32_MAX || read32(candidate) != read32(i))
+        {
+            // Step further the longer nothing matched, incompressible stretches pass quickly
+            i += 1 + ((i - anchor) >> 5);
+            continue;
+        }
+        std::size_t length = MIN_MATCH;
+        while (i + length + 8 <= raw.size())
+        {
+            uint64_t a;
+            uint64_t b;
+            std::memcpy(&a, raw.data() + candidate + length, 8);
+            std::memcpy(&b, raw.data() + i + length, 8);
+            if (a != b)
+            {
+                length += static_cast<std::size_t>(std::countr_zero(a ^ b)) / 8;
+                break;
+            }
+            length += 8;
+        }
+        while (i + length < raw.size() && raw[candidate + length] == raw[i + length])
+        {
+            ++length;
+        }
+        putVarint(out, static_cast<uint32_t>(i - anchor));
+        out.append(raw, anchor, i - anchor);
+        putVarint(out, static_cast<uint32_t>(length));
+        putVarint(out, static_cast<uint32_t>(i - candidate));
+        i += length;
+        anchor = i;
+    }
+    if (anchor < raw.size())
+    {
+        putVarint(out, static_cast<uint32_t>(raw.size() - anchor));
+        out.append(raw, anchor, raw.size() - anchor);
+    }
+    return out;
+}
+
+static std::string decompressBlock(const std::string &compressed, std::size_t rawSize)
+{
+    std::string raw;
+    raw.reserve(rawSize);
+    std::size_t position = 0;
+    while (raw.size() < rawSize)
+    {
+        uint32_t literals = getVarint(compressed, position);
+        if (literals > compressed.size() - position || raw.size() + literals > rawSize)
+        {
+            throw std::runtime_error("Trace block is corrupt");
+        }
+        raw.append(compressed, position, literals);
+        position += literals;
+        if (raw.size() == rawSize)
+        {
+            break;
+        }
+        uint32_t length = getVarint(compressed, position);
+        uint32_t distance = getVarint(compressed, position);
+        if (distance == 0 || distance > raw.size() || raw.size() + length > rawSize)
+        {
+            throw std::runtime_error("Trace block is corrupt");
+        }
+        // Copies may overlap what they produce, so byte by byte
+        std::size_t from = raw.size() - distance;
+        for (uint32_t k = 0; k < length; ++k)
+        {
+            raw.push_back(raw[from + k]);
+        }
+    }
+    return raw;
+}
+
+TraceStream::TraceStream(uint32_t id, std::vector<uint32_t> words, std::vector<uint8_t> destinations)
+    : id(id), words(std::move(words)), destinations(std::move(destinations)),
+      entries(new TraceEntry[CHUNK_ENTRIES * RING_CHUNKS]), counts{}, head(0), tail(0), writer(nullptr)
+{
+    this->cursor = chunk(0);
+    this->limit = this->cursor + CHUNK_ENTRIES;
+}
+
+TraceEntry *TraceStream::chunk(uint64_t sequence)
+{
+    return this->entries.get() + (sequence % RING_CHUNKS) * CHUNK_ENTRIES;
+}
+
+void TraceStream::finish(uint32_t stop)
+{
+    *this->cursor++ = {END, stop};
+    publish();
+}
+
+/**
+ * Hands the current chunk to the writer and moves on to the next slot,
+ * waiting while the writer still holds every slot
+ */
+void TraceStream::publish()
+{
+    uint64_t sequence = this->head.load(std::memory_order_relaxed);
+    this->counts[sequence % RING_CHUNKS] = static_cast<std::size_t>(this->cursor - chunk(sequence));
+    this->head.store(sequence + 1, std::memory_order_release);
+    this->writer->wake();
+    while (sequence + 1 - this->tail.load(std::memory_order_acquire) >= RING_CHUNKS)
+    {
+        std::this_thread::yield();
+    }
+    this->cursor = chunk(sequence + 1);
+    this->limit = this->cursor + CHUNK_ENTRIES;
+}
+
+// The writer's view of one stream
+struct TraceWriter::StreamState
+{
+    bool declared = false;
+    // Block entered last, written out once it is known where it stopped
+    bool running = false;
+    uint32_t start = 0;
+    uint32_t instructions = 0;
+    std::vector<uint32_t> addresses;
+    std::string raw;
+    std::string block;
+};
+
+TraceWriter::TraceWriter(const std::string &path)
+    : out(path, std::ios::binary | std::ios::trunc), stopping(false), signalled(false), recordCount(0), written(0)
+{
+    if (!this->out)
+    {
+        throw std::runtime_error("Cannot open trace file " + path);
+    }
+    this->out.write(MAGIC.data(), static_cast<std::streamsize>(MAGIC.size()));
+    this->written = MAGIC.size();
+    this->thread = std::thread(&TraceWriter::writerLoop, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+void TraceWriter::close()
+{
+    if (!this->thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->available.notify_one();
+    this->thread.join();
+}
+
+std::shared_ptr<TraceStream> TraceWriter::open(std::vector<uint32_t> words, std::vector<uint8_t> destinations)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto stream = std::make_shared<TraceStream>(static_cast<uint32_t>(this->streams.size()), std::move(words), std::move(destinations));
+    stream->writer = this;
+    this->streams.push_back(stream);
+    this->states.push_back(std::make_unique<StreamState>());
+    return stream;
+}
+
+uint64_t TraceWriter::records() const
+{
+    return this->recordCount.load();
+}
+
+uint64_t TraceWriter::bytesWritten() const
+{
+    return this->written.load();
+}
+
+void TraceWriter::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->signalled = true;
+    }
+    this->available.notify_one();
+}
+
+/**
+ * Sleeps until a stream publishes or the writer closes, then drains every
+ * stream. Closing drains once more so chunks published just before are kept.
+ */
+void TraceWriter::writerLoop()
+{
+    while (true)
+    {
+        bool last;
+        std::vector<std::shared_ptr<TraceStream>> current;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->available.wait_for(lock, std::chrono::milliseconds(50), [this]
+                                     { return this->signalled || this->stopping; });
+            this->signalled = false;
+            last = this->stopping;
+            current = this->streams;
+        }
+        bool busy = true;
+        while (busy)
+        {
+            busy = false;
+            for (const std::shared_ptr<TraceStream> &stream : current)
+            {
+                busy |= drain(*stream);
+            }
+        }
+        if (last)
+        {
+            this->out.flush();
+            return;
+        }
+    }
+}
+
+bool TraceWriter::drain(TraceStream &stream)
+{
+    uint64_t sequence = stream.tail.load(std::memory_order_relaxed);
+    if (sequence == stream.head.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    StreamState *state;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        state = this->states[stream.id].get();
+    }
+    if (!state->declared)
+    {
+        std::string declaration(1, 'S');
+        put32(declaration, stream.id);
+        put32(declaration, static_cast<uint32_t>(stream.words.size()));
+        for (std::size_t i = 0; i < stream.words.size(); ++i)
+        {
+            put32(declaration, stream.words[i]);
+            declaration.push_back(static_cast<char>(stream.destinations[i]));
+        }
+        this->out.write(declaration.data(), static_cast<std::streamsize>(declaration.size()));
+        this->written += declaration.size();
+        state->declared = true;
+    }
+
+    const uint32_t textCount = static_cast<uint32_t>(stream.words.size());
+    for (; sequence != stream.head.load(std::memory_order_acquire); ++sequence)
+    {
+        const TraceEntry *entries = stream.chunk(sequence);
+        std::size_t count = stream.counts[sequence % TraceStream::RING_CHUNKS];
+        std::string &raw = state->raw;
+        raw.clear();
+        uint32_t expected = 0;
+        uint32_t lastAddress = 0;
+        uint32_t runs = 0;
+        uint64_t instructions = 0;
+        // Writes the running block, of which length instructions ran
+        auto emit = [&](uint32_t length)
+        {
+            state->running = false;
+            // Blocks running off the end finish in the HALT op past the text
+            length = std::min(length, textCount - std::min(state->start, textCount));
+            if (length == 0)
+            {
+                return;
+            }
+            putVarint(raw, zigzag(state->start - expected));
+            putVarint(raw, length);
+            expected = state->start + length;
+            std::size_t next = 0;
+            for (uint32_t index = state->start; index < expected; ++index)
+            {
+                if (stream.destinations[index] & TraceStream::ACCESSES_MEMORY)
+                {
+                    uint32_t address = next < state->addresses.size() ? state->addresses[next++] : lastAddress;
+                    putVarint(raw, zigzag(address - lastAddress));
+                    lastAddress = address;
+                }
+            }
+            ++runs;
+            instructions += length;
+        };
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const TraceEntry &entry = entries[i];
+            if (entry.tag == TraceStream::MEMORY)
+            {
+                state->addresses.push_back(entry.value);
+                continue;
+            }
+            if (state->running)
+            {
+                uint32_t length = state->instructions;
+                if (entry.tag == TraceStream::END && entry.value != RUN_COMPLETE)
+                {
+                    // The op that stopped the run counts as run
+                    length = entry.value < state->start ? 0 : std::min(length, entry.value - state->start + 1);
+                }
+                emit(length);
+            }
+            state->addresses.clear();
+            if (entry.tag != TraceStream::END)
+            {
+                state->running = true;
+                state->start = entry.tag;
+                state->instructions = entry.value;
+            }
+        }
+        // The chunk's memory can be reused as soon as its entries are read
+        stream.tail.store(sequence + 1, std::memory_order_release);
+        if (runs == 0)
+        {
+            continue;
+        }
+        std::string compressed = compressBlock(raw);
+        std::string &block = state->block;
+        block.assign(1, 'B');
+        put32(block, stream.id);
+        put32(block, runs);
+        put32(block, static_cast<uint32_t>(raw.size()));
+        put32(block, static_cast<uint32_t>(compressed.size()));
+        block += compressed;
+        this->out.write(block.data(), static_cast<std::streamsize>(block.size()));
+        this->written += block.size();
+        this->recordCount += instructions;
+    }
+    return true;
+}
+
+TraceReader::TraceReader(const std::string &path)
+    : in(path, std::ios::binary), position(0)
+{
+    char magic[8] = {};
+    if (!this->in.read(magic, sizeof(magic)) || std::string_view(magic, sizeof(magic)) != MAGIC)
+    {
+        throw std::runtime_error("Not a trace file: " + path);
+    }
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    while (this->position >= this->records.size())
+    {
+        if (!readBlock())
+        {
+            return false;
+        }
+    }
+    record = this->records[this->position++];
+    return true;
+}
+
+bool TraceReader::readBlock()
+{
+    auto get32 = [this]
+    {
+        uint8_t bytes[4];
+        if (!this->in.read(reinterpret_cast<char *>(bytes), 4))
+        {
+            throw std::runtime_error("Trace file is truncated");
+        }
+        return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) | (static_cast<uint32_t>(bytes[2]) << 16) |
+               (static_cast<uint32_t>(bytes[3]) << 24);
+    };
+    int kind = this->in.get();
+    if (kind == std::char_traits<char>::eof())
+    {
+        return false;
+    }
+    uint32_t id = get32();
+    if (kind == 'S')
+    {
+        if (id >= this->texts.size())
+        {
+            this->texts.resize(id + 1);
+        }
+        Text &text = this->texts[id];
+        uint32_t size = get32();
+        text.words.resize(size);
+        text.destinations.resize(size);
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            text.words[i] = get32();
+            text.destinations[i] = static_cast<uint8_t>(this->in.get());
+        }
+        this->records.clear();
+        this->position = 0;
+        return true;
+    }
+    if (kind != 'B' || id >= this->texts.size())
+    {
+        throw std::runtime_error("Trace file is corrupt");
+    }
+    const Text &text = this->texts[id];
+    uint32_t count = get32();
+    uint32_t rawSize = get32();
+    uint32_t compressedSize = get32();
+    std::string compressed(compressedSize, '\0');
+    if (!this->in.read(compressed.data(), compressedSize))
+    {
+        throw std::runtime_error("Trace file is truncated");
+    }
+    std::string raw = decompressBlock(compressed, rawSize);
+
+    this->records.clear();
+    this->position = 0;
+    uint32_t expected = 0;
+    uint32_t lastAddress = 0;
+    std::size_t at = 0;
+    for (uint32_t run = 0; run < count; ++run)
+    {
+        uint32_t start = expected + unzigzag(getVarint(raw, at));
+        uint32_t length = getVarint(raw, at);
+        if (start >= text.words.size() || length > text.words.size() - start)
+        {
+            throw std::runtime_error("Trace record outside the text");
+        }
+        expected = start + length;
+        for (uint32_t index = start; index < expected; ++index)
+        {
+            uint8_t destination = text.destinations[index];
+            TraceRecord &record = this->records.emplace_back();
+            record.stream = id;
+            record.pc = PC_START + index * 4;
+            record.word = text.words[index];
+            record.reg = destination & ~TraceStream::ACCESSES_MEMORY;
+            record.memory = (destination & TraceStream::ACCESSES_MEMORY) != 0;
+            record.address = 0;
+            if (record.memory)
+            {
+                lastAddress += unzigzag(getVarint(raw, at));
+                record.address = lastAddress;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,433 @@
+#include "MIPS.hpp"
+#include "Helpers.hpp"
+#include "Listing.hpp"
+#include "CPU.hpp"
+#include "BatchRunner.hpp"
+#include "Globals.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <sstream>
+#include <string_view>
+#include <fstream>
+
+/**
+ * Runs the program once for every .in file in directory, each reading its
+ * file as stdin, and writes what it printed to the matching .out file.
+ * Returns 0 when every run exited.
+ */
+static int runBatch(const MIPS &mips, const std::filesystem::path &directory, unsigned threads, uint64_t budget, bool jit, bool stats)
+{
+    std::vector<std::filesystem::path> inputs;
+    for (const auto &entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".in")
+        {
+            inputs.push_back(entry.path());
+        }
+    }
+    std::sort(inputs.begin(), inputs.end());
+    std::vector<BatchJob> jobs(inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        std::ifstream file(inputs[i], std::ios::binary);
+        jobs[i].input.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        jobs[i].budget = budget;
+    }
+
+    Program program(mips);
+    BatchRunner runner(program, threads);
+    if (jit && !runner.enableJit())
+    {
+        std::cerr << "JIT not available on this host, interpreting\n";
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchResult> results = runner.run(jobs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int status = 0;
+    uint64_t executed = 0;
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        const BatchResult &result = results[i];
+        std::ofstream(std::filesystem::path(inputs[i]).replace_extension(".out"), std::ios::binary) << result.output;
+        executed += result.executed;
+        if (result.status == BatchResult::Status::EXITED)
+        {
+            std::cout << std::format("{}: exit {}, {} instructions\n", inputs[i].filename().string(), result.exitCode, result.executed);
+        }
+        else
+        {
+            std::cout << std::format("{}: {}\n", inputs[i].filename().string(), result.error);
+            status = 1;
+        }
+    }
+    if (stats)
+    {
+        std::cerr << std::format("batch:    {} runs on {} threads, {} instructions in {:.3f} s ({:.1f} M instr/s)\n",
+                                 results.size(), runner.threads(), executed, seconds, executed / std::max(seconds, 1e-9) / 1e6);
+    }
+    return status;
+}
+
+/**
+ * Reads debugger commands from standard input until the program exits or
+ * quit, which the program shares for its read syscalls. Stops and
+ * registers are reported on stderr. Returns the exit code, 1 on a fault.
+ *   break|b where, delete|d where   where is a text label or address
+ *   watch|w symbol [r|w|rw]         stops before stores (w, the default),
+ *   unwatch symbol                  loads (r) or both touching symbol
+ *   step|s [n], continue|c, regs|r, quit|q
+ */
+static int runDebugger(const MIPS &mips, CPU &cpu)
+{
+    Debugger debugger(cpu, mips);
+    int exitCode = 0;
+    auto where = [&mips](uint32_t pc)
+    {
+        uint32_t index = (pc - PC_START) / 4;
+        if (index >= mips.instructions.size())
+        {
+            return std::format("0x{:08x}", pc);
+        }
+        const Instruction &instr = mips.instructions[index];
+        return std::format("0x{:08x}  {:<24} {}", pc, instr.disassemble(), mips.textLines[instr.line]);
+    };
+    auto report = [&](const DebugStop &stop)
+    {
+        switch (stop.reason)
+        {
+        case DebugStop::EXITED:
+            exitCode = stop.exitCode;
+            std::cerr << std::format("exited with code {} after {} instructions\n", stop.exitCode, debugger.executed());
+            break;
+        case DebugStop::BREAKPOINT:
+            std::cerr << std::format("breakpoint at {}\n", where(stop.pc));
+            break;
+        case DebugStop::WATCHPOINT:
+            std::cerr << std::format("watchpoint {}: {} of 0x{:08x} at {}\n", stop.symbol, stop.write ? "write" : "read", stop.address, where(stop.pc));
+            break;
+        case DebugStop::STEPPED:
+            std::cerr << where(stop.pc) << "\n";
+            break;
+        }
+    };
+
+    std::string line;
+    while (!debugger.exited() && (std::cerr << "(mips) " << std::flush, std::getline(std::cin, line)))
+    {
+        std::istringstream words(line);
+        std::string command;
+        std::string argument;
+        std::string option;
+        words >> command >> argument >> option;
+        try
+        {
+            if (command == "break" || command == "b")
+            {
+                std::cerr << std::format("breakpoint at {}\n", where(debugger.addBreakpoint(argument)));
+            }
+            else if (command == "delete" || command == "d")
+            {
+                if (!debugger.removeBreakpoint(argument))
+                {
+                    std::cerr << std::format("no breakpoint at {}\n", argument);
+                }
+            }
+            else if (command == "watch" || command == "w")
+            {
+                uint8_t access = option == "r" ? Debugger::READ : option == "rw" ? Debugger::READ | Debugger::WRITE : Debugger::WRITE;
+                debugger.addWatchpoint(argument, access);
+            }
+            else if (command == "unwatch")
+            {
+                if (!debugger.removeWatchpoint(argument))
+                {
+                    std::cerr << std::format("no watchpoint on {}\n", argument);
+                }
+            }
+            else if (command == "step" || command == "s")
+            {
+                report(debugger.step(argument.empty() ? 1 : std::stoull(argument)));
+            }
+            else if (command == "continue" || command == "c")
+            {
+                report(debugger.resume());
+            }
+            else if (command == "regs" || command == "r")
+            {
+                for (int i = 0; i < 32; ++i)
+                {
+                    std::cerr << std::format("{:>5} 0x{:08x}{}", Instruction::REGISTER_NAMES[i], cpu.regs[i], i % 4 == 3 ? "\n" : "  ");
+                }
+                std::cerr << std::format("   hi 0x{:08x}     lo 0x{:08x}     pc 0x{:08x}\n", cpu.hi, cpu.lo, cpu.pc);
+            }
+            else if (command == "quit" || command == "q")
+            {
+                return 0;
+            }
+            else if (!command.empty())
+            {
+                std::cerr << std::format("unknown command {}\n", command);
+            }
+        }
+        catch (const std::exception &error)
+        {
+            std::cerr << "Runtime error: " << error.what() << "\n";
+            exitCode = 1;
+        }
+    }
+    return exitCode;
+}
+
+/**
+ * Usage: MIPSSimulator [--listing | --json | --verbose] [-o file] [-j threads] [--cache dir]
+ *                      [--run [--stats] [--jit] [--profile] [--timing] [--caches] [--l1i|--l1d|--l2 spec] [--predict spec] [--trace file] [--debug] [--unbuffered] [--budget n] | --batch dir] [file.asm | -]
+ * A file name of "-" reads the source from standard input
+ * Assembles silently unless a listing is requested, --run then executes the
+ * program and exits with its exit code, --stats reports the run on stderr
+ * and --jit compiles hot blocks to native code. Program output is buffered
+ * until exit or the next read syscall unless --unbuffered is given.
+ * --profile reports the hottest functions, loops and instructions on stderr.
+ * --timing reports cycles, CPI and stalls on the five-stage pipeline model.
+ * --caches reports hits and misses of split 8KB L1 caches, --l1i, --l1d and
+ * --l2 set one cache (size,ways,line[,lru|plru|random]) and imply --caches.
+ * --predict reports branch prediction accuracy per branch and label with a
+ * static, bimodal or gshare predictor (kind[,table bits[,stack depth]]).
+ * --trace writes every executed instruction to file, read it with mips_trace.
+ * --debug runs the program under the debugger, see runDebugger.
+ * --budget stops a run after about n instructions. --batch runs the program
+ * on every .in file of dir on -j threads, see runBatch
+ */
+int main(int argc, char *argv[])
+{
+    // Run output is buffered by the console, C stdio is never used alongside it
+    std::ios::sync_with_stdio(false);
+    std::string filename = "assembly_files/fib.asm";
+    std::string outputName;
+    Verbosity verbosity = Verbosity::QUIET;
+    ListingFormat format = ListingFormat::TEXT;
+    AssemblerOptions options;
+    bool run = false;
+    bool stats = false;
+    bool jit = false;
+    bool unbuffered = false;
+    bool profile = false;
+    bool timing = false;
+    bool caches = false;
+    CacheLevels cacheLevels;
+    std::optional<PredictorConfig> predictor;
+    bool debug = false;
+    std::string traceName;
+    uint64_t budget = 0;
+    std::string batchDir;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--listing")
+        {
+            verbosity = Verbosity::LISTING;
+        }
+        else if (arg == "--json")
+        {
+            verbosity = Verbosity::LISTING;
+            format = ListingFormat::JSON;
+        }
+        else if (arg == "--verbose")
+        {
+            verbosity = Verbosity::VERBOSE;
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            outputName = argv[++i];
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            options.threads = static_cast<unsigned>(handleValue(argv[++i]));
+        }
+        else if (arg == "--cache" && i + 1 < argc)
+        {
+            options.cacheDir = argv[++i];
+        }
+        else if (arg == "--run")
+        {
+            run = true;
+        }
+        else if (arg == "--stats")
+        {
+            stats = true;
+        }
+        else if (arg == "--jit")
+        {
+            jit = true;
+        }
+        else if (arg == "--unbuffered")
+        {
+            unbuffered = true;
+        }
+        else if (arg == "--profile")
+        {
+            profile = true;
+        }
+        else if (arg == "--timing")
+        {
+            timing = true;
+        }
+        else if (arg == "--caches")
+        {
+            caches = true;
+        }
+        else if ((arg == "--l1i" || arg == "--l1d" || arg == "--l2") && i + 1 < argc)
+        {
+            CacheConfig config = CacheConfig::parse(argv[++i]);
+            if (arg == "--l1i")
+            {
+                cacheLevels.instruction = config;
+            }
+            else if (arg == "--l1d")
+            {
+                cacheLevels.data = config;
+            }
+            else
+            {
+                cacheLevels.second = config;
+            }
+            caches = true;
+        }
+        else if (arg == "--predict" && i + 1 < argc)
+        {
+            predictor = PredictorConfig::parse(argv[++i]);
+        }
+        else if (arg == "--debug")
+        {
+            debug = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            traceName = argv[++i];
+        }
+        else if (arg == "--budget" && i + 1 < argc)
+        {
+            budget = std::stoull(argv[++i]);
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            batchDir = argv[++i];
+        }
+        else
+        {
+            filename = arg;
+        }
+    }
+    MIPS mips(filename, options);
+
+    if (verbosity != Verbosity::QUIET)
+    {
+        std::ofstream outputFile;
+        if (!outputName.empty())
+        {
+            outputFile.open(outputName);
+        }
+        Listing listing(outputName.empty() ? std::cout : outputFile);
+        listing.write(mips, verbosity, format);
+    }
+
+    if (!batchDir.empty())
+    {
+        return runBatch(mips, batchDir, options.threads, budget, jit, stats);
+    }
+    if (!run)
+    {
+        return 0;
+    }
+    // Declared before the CPU so its stream is drained after the run
+    std::unique_ptr<TraceWriter> tracer;
+    CPU cpu(mips);
+    cpu.console().setBuffered(!unbuffered);
+    cpu.setBudget(budget);
+    if (jit && !cpu.enableJit())
+    {
+        std::cerr << "JIT not available on this host, interpreting\n";
+    }
+    if (profile)
+    {
+        cpu.enableProfiler();
+    }
+    if (timing)
+    {
+        cpu.enableTiming();
+    }
+    if (caches)
+    {
+        cpu.enableCaches(cacheLevels);
+    }
+    if (predictor)
+    {
+        cpu.enablePredictor(*predictor);
+    }
+    if (!traceName.empty())
+    {
+        tracer = std::make_unique<TraceWriter>(traceName);
+        cpu.enableTrace(*tracer);
+    }
+    if (debug)
+    {
+        return runDebugger(mips, cpu);
+    }
+    int exitCode = 0;
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        exitCode = cpu.run();
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Runtime error: " << error.what() << "\n";
+        exitCode = 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (const Profiler *profiler = cpu.profiler())
+    {
+        profiler->report(std::cerr, mips);
+    }
+    if (const Pipeline *pipeline = cpu.pipeline())
+    {
+        pipeline->report(std::cerr, mips);
+    }
+    if (const CacheModel *model = cpu.cacheModel())
+    {
+        model->report(std::cerr, mips);
+    }
+    if (const BranchPredictor *branches = cpu.branchPredictor())
+    {
+        branches->report(std::cerr, mips);
+    }
+    if (stats)
+    {
+        std::cerr << std::format("executed: {} instructions in {:.3f} s ({:.1f} M instr/s)\n",
+                                 cpu.executed, seconds, cpu.executed / std::max(seconds, 1e-9) / 1e6);
+        BlockStats blocks = cpu.blockStats();
+        std::cerr << std::format("blocks:   {} translated, {:.2f} instructions on average, {:.2f}% of transfers chained\n",
+                                 blocks.blocks, blocks.averageLength, blocks.chainHitRate() * 100);
+        std::cerr << std::format("memory:   {} pages resident ({} KB)\n", cpu.residentPages(), cpu.residentPages() * DataSegment::PAGE_SIZE / 1024);
+        const Heap &heap = cpu.heapUsage();
+        std::cerr << std::format("heap:     {} bytes high water, {} KB mapped in {} growth events\n", heap.highWater(), heap.mapped() / 1024, heap.growthEvents());
+        std::cerr << std::format("io:       {} bytes written in {} flushes\n", cpu.console().bytesWritten(), cpu.console().flushCount());
+        if (tracer != nullptr)
+        {
+            // Waits for the writer so the counts are final
+            tracer->close();
+            std::cerr << std::format("trace:    {} records in {} bytes ({:.2f} bytes per record)\n", tracer->records(),
+                                     tracer->bytesWritten(), static_cast<double>(tracer->bytesWritten()) / std::max<uint64_t>(tracer->records(), 1));
+        }
+        if (const Jit *compiler = cpu.jit())
+        {
+            std::cerr << std::format("jit:      {} blocks compiled, {} bytes of code\n", compiler->compiledBlocks(), compiler->codeBytes());
+        }
+    }
+    return exitCode;
+}
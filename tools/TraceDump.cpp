@@ -0,0 +1,78 @@
+#include "Trace.hpp"
+#include "Instruction.hpp"
+#include <format>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+/**
+ * Usage: mips_trace [--summary] trace.bin
+ * Prints one line per traced instruction: stream, address, machine word,
+ * disassembly, then the register written and the memory address if any.
+ * --summary only counts records, register writes and memory accesses.
+ */
+int main(int argc, char *argv[])
+{
+    bool summary = false;
+    std::string path;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--summary")
+        {
+            summary = true;
+        }
+        else
+        {
+            path = arg;
+        }
+    }
+    if (path.empty())
+    {
+        std::cerr << "Usage: mips_trace [--summary] trace.bin\n";
+        return 2;
+    }
+
+    try
+    {
+        std::ios::sync_with_stdio(false);
+        TraceReader reader(path);
+        TraceRecord record;
+        uint64_t records = 0;
+        uint64_t writes = 0;
+        uint64_t accesses = 0;
+        std::string line;
+        while (reader.next(record))
+        {
+            ++records;
+            writes += record.reg != 0;
+            accesses += record.memory;
+            if (summary)
+            {
+                continue;
+            }
+            line = std::format("{} 0x{:08x} 0x{:08x}  {:<24}", record.stream, record.pc, record.word,
+                               Instruction::decode(record.word, record.pc, 0).disassemble());
+            if (record.reg != 0)
+            {
+                line += std::format(" -> {}", Instruction::REGISTER_NAMES[record.reg]);
+            }
+            if (record.memory)
+            {
+                line += std::format(" [0x{:08x}]", record.address);
+            }
+            line += '\n';
+            std::cout << line;
+        }
+        if (summary)
+        {
+            std::cout << std::format("{} records, {} register writes, {} memory accesses\n", records, writes, accesses);
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Error: " << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}